@@ -0,0 +1,423 @@
+/*
+ * DCMI power reading sampler
+ *
+ * Sends DCMI Get Power Reading (system power statistics) to the BMC
+ * at a fixed rate, on one /dev/ipmi0 session held open for the whole
+ * run, and records every answer in a memory-mapped ring file. The
+ * timer is a timerfd with absolute expiries a fixed interval apart,
+ * so a slow answer delays one sample but never shifts the ones after
+ * it; ticks missed while a command was outstanding are counted as
+ * overruns, not made up in a burst. -i 0 sends back to back, which
+ * shows the highest rate the BMC will take.
+ *
+ * Each record carries its CLOCK_MONOTONIC send time, the round trip
+ * time, the completion code and the BMC's current, minimum, maximum
+ * and average watts. The file header says how to turn the monotonic
+ * times into wall clock times, and is kept current through clock
+ * steps. The ring keeps the last -n records; other tools can map it
+ * while it is written, reading up to head and checking each record's
+ * sequence number.
+ *
+ * At exit it prints the achieved sample rate, overruns, failed
+ * commands and the response latency percentiles over the ring.
+ * -D prints a ring file as CSV.
+ *
+ *	$ gcc -O2 -o dcmipower dcmipower.c ipmicmd.c iptrace.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "ipmicmd.h"
+
+#define PWR_MAGIC	"DCMIPWR1"
+#define PWR_VERSION	2
+#define CC_NO_ANSWER	0xff	/* the driver gave no response */
+
+struct pwr_sample {
+	uint64_t	seq;		/* record index + 1, 0 while written */
+	uint64_t	t_ns;		/* CLOCK_MONOTONIC at send */
+	uint32_t	lat_us;		/* round trip */
+	uint8_t		cc;		/* completion code, or CC_NO_ANSWER */
+	uint8_t		state;		/* DCMI_POWER_ACTIVE */
+	uint16_t	cur;		/* watts */
+	uint16_t	min;
+	uint16_t	max;
+	uint16_t	avg;
+	uint16_t	pad;
+	uint32_t	bmc_time;	/* BMC timestamp, seconds */
+	uint32_t	period_ms;	/* BMC statistics period */
+};
+
+/*
+ * The ring file: this header, then capacity records. head counts the
+ * records ever written, so record i is at s[i % capacity], and the
+ * ring holds records max(0, head - capacity) to head - 1. The writer
+ * fills a record before it advances head.
+ *
+ * A reader that races the writer can still find record i being
+ * overwritten by record i + capacity, so each record carries its own
+ * sequence lock, as in ipmipub.h: the writer zeroes seq, fills the
+ * record and sets seq to i + 1. A reader keeps its copy of record i
+ * only if seq read i + 1 both before and after the copy.
+ *
+ * mono_to_real_ns is rewritten with every record, so it follows an
+ * NTP step; readers load it when they convert, not once at startup.
+ */
+struct pwr_ring {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	recsize;
+	uint64_t	capacity;
+	uint64_t	head;
+	int64_t		mono_to_real_ns;	/* add to t_ns for CLOCK_REALTIME */
+	uint32_t	interval_us;
+	uint32_t	pad;
+	struct pwr_sample s[];
+};
+
+static volatile sig_atomic_t stop;
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int64_t clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Writer side: publish *in as record head and advance head.
+ */
+static void ring_put(struct pwr_ring *r, const struct pwr_sample *in)
+{
+	struct pwr_sample *s = &r->s[r->head % r->capacity];
+	uint64_t i = r->head;
+
+	__atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((char *)s + sizeof(s->seq), (const char *)in + sizeof(in->seq),
+	       sizeof(*s) - sizeof(s->seq));
+	__atomic_store_n(&s->seq, i + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->mono_to_real_ns, clock_ns(CLOCK_REALTIME)
+			 - clock_ns(CLOCK_MONOTONIC), __ATOMIC_RELAXED);
+	__atomic_store_n(&r->head, i + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Reader side: copy record i into *out. Returns 0, or -1 if it has
+ * been overwritten or was being written during the copy.
+ */
+static int ring_get(const struct pwr_ring *r, uint64_t i,
+		    struct pwr_sample *out)
+{
+	const struct pwr_sample *s = &r->s[i % r->capacity];
+
+	if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != i + 1)
+		return -1;
+	memcpy(out, (const void *)s, sizeof(*out));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) == i + 1 ? 0 : -1;
+}
+
+static int cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static struct pwr_ring *ring_map(const char *path, uint64_t capacity,
+				 int create, size_t *len)
+{
+	struct pwr_ring *r;
+	struct stat st;
+	int fd;
+
+	fd = create ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)
+		    : open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (create) {
+		*len = sizeof(*r) + capacity * sizeof(r->s[0]);
+		if (ftruncate(fd, *len) < 0) {
+			close(fd);
+			return NULL;
+		}
+	} else {
+		if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*r)) {
+			close(fd);
+			return NULL;
+		}
+		*len = st.st_size;
+	}
+	r = mmap(NULL, *len, create ? PROT_READ | PROT_WRITE : PROT_READ,
+		 MAP_SHARED, fd, 0);
+	close(fd);
+	if (r == MAP_FAILED)
+		return NULL;
+
+	if (create) {
+		memcpy(r->magic, PWR_MAGIC, sizeof(r->magic));
+		r->version = PWR_VERSION;
+		r->recsize = sizeof(r->s[0]);
+		r->capacity = capacity;
+		r->mono_to_real_ns = clock_ns(CLOCK_REALTIME)
+				     - clock_ns(CLOCK_MONOTONIC);
+	} else if (memcmp(r->magic, PWR_MAGIC, sizeof(r->magic))
+		   || r->version != PWR_VERSION
+		   || r->recsize != sizeof(r->s[0])
+		   || sizeof(*r) + r->capacity * sizeof(r->s[0]) > *len) {
+		munmap(r, *len);
+		errno = EINVAL;
+		return NULL;
+	}
+	return r;
+}
+
+/*
+ * One Get Power Reading on the open session, into s.
+ */
+static void sample(int fd, struct pwr_sample *s)
+{
+	static const DcmiPowerReadingReq req = {
+		DCMI_GROUP_ID, DCMI_POWER_SYSTEM, 0, 0
+	};
+	uchar rsp[32];
+	const DcmiPowerReadingRsp *v;
+	int rc, rlen;
+
+	memset(s, 0, sizeof(*s));
+	s->t_ns = clock_ns(CLOCK_MONOTONIC);
+	rc = ipmicmd_fd(fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+			dcmi_get_power_reading.cmd, dcmi_get_power_reading.netfn,
+			0, (uchar *)&req, sizeof(req), rsp, sizeof(rsp), &rlen);
+	s->lat_us = (clock_ns(CLOCK_MONOTONIC) - s->t_ns) / 1000;
+
+	if (rc < 0 || rlen < 1) {
+		s->cc = CC_NO_ANSWER;
+		return;
+	}
+	s->cc = rsp[0];
+	v = ipmicmd_view(&dcmi_get_power_reading, rsp, rlen);
+	if (v == NULL) {
+		if (s->cc == 0)
+			s->cc = CC_NO_ANSWER;	/* short answer */
+		return;
+	}
+	s->cur = IPMI_LE16(v->current);
+	s->min = IPMI_LE16(v->minimum);
+	s->max = IPMI_LE16(v->maximum);
+	s->avg = IPMI_LE16(v->average);
+	s->bmc_time = IPMI_LE32(v->timestamp);
+	s->period_ms = IPMI_LE32(v->period);
+	s->state = v->state & DCMI_POWER_ACTIVE;
+}
+
+static void report(const struct pwr_ring *r, int64_t elapsed_ns,
+		   uint64_t overruns)
+{
+	uint64_t head = r->head;
+	uint64_t first = head > r->capacity ? head - r->capacity : 0;
+	uint64_t n = head - first, i, ok = 0, fail = 0;
+	int64_t *lat = malloc((n ? n : 1) * sizeof(*lat));
+	double watts = 0;
+
+	printf("%llu samples in %.1f s, %.1f/s", (unsigned long long)head,
+	       elapsed_ns / 1e9, elapsed_ns ? head / (elapsed_ns / 1e9) : 0);
+	if (r->interval_us)
+		printf(" of %.1f/s asked, %llu overruns",
+		       1e6 / r->interval_us, (unsigned long long)overruns);
+	printf("\n");
+	if (lat == NULL || n == 0) {
+		free(lat);
+		return;
+	}
+
+	for (i = first; i < head; i++) {
+		struct pwr_sample s;
+
+		if (ring_get(r, i, &s) < 0)
+			continue;
+		if (s.cc == 0) {
+			lat[ok++] = s.lat_us;
+			watts += s.cur;
+		} else
+			fail++;
+	}
+	printf("last %llu: %llu failed", (unsigned long long)n,
+	       (unsigned long long)fail);
+	if (ok) {
+		qsort(lat, ok, sizeof(*lat), cmp64);
+		printf(", mean %.1f W\nlatency us: min %lld  p50 %lld  p90 %lld"
+		       "  p99 %lld  max %lld", watts / ok,
+		       (long long)lat[0], (long long)lat[ok / 2],
+		       (long long)lat[(ok * 90) / 100],
+		       (long long)lat[(ok * 99) / 100],
+		       (long long)lat[ok - 1]);
+	}
+	printf("\n");
+	free(lat);
+}
+
+static int dump(const char *path)
+{
+	const struct pwr_ring *r;
+	uint64_t head, first, i, torn = 0;
+	int64_t off;
+	size_t len;
+
+	if ((r = ring_map(path, 0, 0, &len)) == NULL) {
+		perror(path);
+		return 1;
+	}
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	first = head > r->capacity ? head - r->capacity : 0;
+	off = __atomic_load_n(&r->mono_to_real_ns, __ATOMIC_RELAXED);
+
+	printf("time,mono_ns,latency_us,cc,active,current_w,min_w,max_w,"
+	       "avg_w,bmc_time,period_ms\n");
+	for (i = first; i < head; i++) {
+		struct pwr_sample s;
+		int64_t real;
+
+		if (ring_get(r, i, &s) < 0) {
+			torn++;
+			continue;
+		}
+		real = s.t_ns + off;
+		printf("%lld.%06lld,%llu,%u,0x%02x,%d,%u,%u,%u,%u,%u,%u\n",
+		       (long long)(real / 1000000000),
+		       (long long)(real % 1000000000 / 1000),
+		       (unsigned long long)s.t_ns, s.lat_us, s.cc,
+		       !!s.state, s.cur, s.min, s.max, s.avg,
+		       s.bmc_time, s.period_ms);
+	}
+	if (torn)
+		fprintf(stderr, "dcmipower: %llu records overwritten while "
+			"read, skipped\n", (unsigned long long)torn);
+	munmap((void *)r, len);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: dcmipower [-i ms] [-t secs] [-o file] [-n records] [-v]\n"
+		"       dcmipower -D file\n\n"
+		"  -i ms       sample interval, default 100; 0 for back to back\n"
+		"  -t secs     stop after this long, default at SIGINT\n"
+		"  -o file     ring file, default /tmp/dcmipower.ring\n"
+		"  -n records  ring size, default 65536\n"
+		"  -D file     print a ring file as CSV\n"
+		"  -v          verbose\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = "/tmp/dcmipower.ring";
+	double interval_ms = 100, secs = 0;
+	long capacity = 65536;
+	uint64_t overruns = 0, ticks;
+	struct pwr_ring *r;
+	struct sigaction sa;
+	size_t len;
+	int64_t t0, end;
+	int fd, tfd = -1, opt;
+
+	strncpy(toolname, "dcmipower", sizeof(toolname) - 1);
+
+	while ((opt = getopt(argc, argv, "i:t:o:n:D:v")) != -1) {
+		switch (opt) {
+		case 'i': interval_ms = atof(optarg); break;
+		case 't': secs = atof(optarg); break;
+		case 'o': path = optarg; break;
+		case 'n': capacity = atol(optarg); break;
+		case 'D': return dump(optarg);
+		case 'v': Verbose = 1; break;
+		default: usage();
+		}
+	}
+	if (interval_ms < 0 || secs < 0 || capacity < 1)
+		usage();
+
+	if ((fd = ipmi_open()) < 0)
+		return 1;
+	if ((r = ring_map(path, capacity, 1, &len)) == NULL) {
+		perror(path);
+		return 1;
+	}
+	r->interval_us = interval_ms * 1000;
+
+	/*
+	 * Without SA_RESTART, which signal() would set, a signal breaks
+	 * the wait on the timerfd, so Ctrl-C stops at once rather than
+	 * at the next tick.
+	 */
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = onstop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	t0 = clock_ns(CLOCK_MONOTONIC);
+	end = secs ? t0 + (int64_t)(secs * 1e9) : 0;
+	if (r->interval_us) {
+		struct itimerspec its;
+		int64_t first = t0 + r->interval_us * 1000LL;
+
+		its.it_value.tv_sec = first / 1000000000;
+		its.it_value.tv_nsec = first % 1000000000;
+		its.it_interval.tv_sec = r->interval_us / 1000000;
+		its.it_interval.tv_nsec = r->interval_us % 1000000 * 1000;
+		if ((tfd = timerfd_create(CLOCK_MONOTONIC, 0)) < 0
+		    || timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+			perror("timerfd");
+			return 1;
+		}
+	}
+
+	while (!stop && (!end || clock_ns(CLOCK_MONOTONIC) < end)) {
+		struct pwr_sample s;
+
+		if (tfd >= 0) {
+			if (read(tfd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+				if (errno == EINTR)
+					continue;
+				perror("timerfd");
+				break;
+			}
+			overruns += ticks - 1;
+		}
+
+		sample(fd, &s);
+		ring_put(r, &s);
+
+		if (Verbose)
+			printf("%8.3f s  %5u W  %6u us  cc 0x%02x\n",
+			       (s.t_ns - t0) / 1e9, s.cur, s.lat_us, s.cc);
+	}
+
+	report(r, clock_ns(CLOCK_MONOTONIC) - t0, overruns);
+	msync(r, len, MS_ASYNC);
+	munmap(r, len);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,292 @@
+/*
+ * Fault scenario suite for getInfoIPMI
+ *
+ * Runs getInfoIPMI -b -c -s, the boot path that reads the blade's
+ * cabinet, chassis and slot, against the simulated BMC of ipmifault,
+ * many times under each scenario, a fault schedule of ipmifault.h, with
+ * a different seed each run. For each scenario it reports how many
+ * runs gave the right answer, a wrong answer or failed, and the end to
+ * end time of the runs, median to worst, and the median time it took
+ * the failed ones to give up.
+ *
+ * The right answer is what the run without faults prints. The runs are
+ * separate processes, up to -j at a time; they spend their time waiting
+ * on the schedule, not on the cpu, so running them side by side does
+ * not change their times much.
+ *
+ * Scenarios are given as name=spec, spec as for IPMI_FAULT without sim
+ * and seed, which the suite adds; without any, a built-in set covering
+ * slow, lossy and busy BMCs is run.
+ *
+ *	$ gcc -O2 -DIPMI_FAULT -o getInfoIPMI getInfoIPMI.c ipmicmd.c \
+ *		ipmifault.c ipmifru.c iptrace.c
+ *	$ gcc -O2 -o faultsuite faultsuite.c
+ *	$ ./faultsuite -n 200
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define MAXJOBS		64
+#define OUTLEN		256
+
+struct scenario {
+	const char	*name;
+	const char	*spec;
+};
+
+static const struct scenario builtin[] = {
+	{ "clean",	"" },
+	{ "slow",	"delay=100:20-300" },
+	{ "stalls",	"delay=10:1500-2500" },
+	{ "long stalls", "delay=5:4000-7000" },
+	{ "drop 1%",	"drop=1" },
+	{ "drop 10%",	"drop=10" },
+	{ "busy boot",	"busy=3" },
+	{ "busy 5%",	"cc=c0:5" },
+	{ "timeout 5%",	"cc=c3:5" },
+	{ "short 5%",	"trunc=5" },
+	{ "mixed",	"delay=30:10-300,drop=2,cc=c0:2,trunc=1" },
+};
+
+struct job {
+	pid_t		pid;
+	int		fd;		/* read end of its stdout */
+	int64_t		t0_ns;
+};
+
+struct result {
+	int		ok, wrong, failed;
+	int64_t		*ms;		/* every run */
+	int64_t		*fail_ms;	/* failed runs */
+};
+
+static const char	*prog = "./getInfoIPMI";
+static char		reference[ OUTLEN ];
+
+static int64_t
+now_ns ( void )
+{
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int
+cmp64 ( const void *a, const void *b )
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int64_t
+pct ( int64_t *v, int n, int p )
+{
+	if ( n == 0 )
+		return 0;
+	return v[ (int64_t)(n - 1) * p / 100 ];
+}
+
+/*
+ * Start one run of prog with the schedule spec and seed, its stdout
+ * on a pipe and its stderr thrown away.
+ */
+static int
+start ( struct job *j, const char *spec, int seed )
+{
+	char		env[ 512 ];
+	int		pfd[2];
+
+	snprintf( env, sizeof(env), "sim,seed=%d%s%s", seed,
+		  *spec ? "," : "", spec );
+	if ( pipe( pfd ) < 0 )
+		return -1;
+
+	j->t0_ns = now_ns();
+	if ( (j->pid = fork()) < 0 )
+		return -1;
+	if ( j->pid == 0 )
+	{
+		int null = open( "/dev/null", O_WRONLY );
+
+		dup2( pfd[1], 1 );
+		dup2( null, 2 );
+		close( pfd[0] );
+		setenv( "IPMI_FAULT", env, 1 );
+		execl( prog, prog, "-b", "-c", "-s", "X86HOST", (char *)NULL );
+		_exit( 127 );
+	}
+	close( pfd[1] );
+	j->fd = pfd[0];
+	return 0;
+}
+
+/*
+ * Wait for any run to finish and account for it. The answer is a few
+ * lines, well under a pipe's buffer, so it is read after the exit.
+ */
+static void
+finish ( struct job *jobs, int *njobs, struct result *res, int *nms,
+	 int *nfail, char *out )
+{
+	int		status, k, n;
+	pid_t		pid;
+	int64_t		ms;
+	char		buf[ OUTLEN ];
+
+	while ( (pid = wait( &status )) < 0 && errno == EINTR )
+		;
+	for ( k = 0; k < *njobs && jobs[k].pid != pid; k++ )
+		;
+	if ( k == *njobs )
+		return;
+
+	ms = (now_ns() - jobs[k].t0_ns) / 1000000;
+	n = read( jobs[k].fd, buf, sizeof(buf) - 1 );
+	buf[ n > 0 ? n : 0 ] = '\0';
+	close( jobs[k].fd );
+	jobs[k] = jobs[ --*njobs ];
+
+	res->ms[ (*nms)++ ] = ms;
+	if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+	{
+		res->failed++;
+		res->fail_ms[ (*nfail)++ ] = ms;
+	}
+	else if ( out )
+		strcpy( out, buf );
+	else if ( strcmp( buf, reference ) )
+		res->wrong++;
+	else
+		res->ok++;
+}
+
+static int
+run ( const struct scenario *sc, int runs, int maxjobs, struct result *res,
+      char *out )
+{
+	struct job	jobs[ MAXJOBS ];
+	int		njobs = 0, nms = 0, nfail = 0, seed;
+
+	memset( res, 0, sizeof(*res) );
+	res->ms = calloc( runs, sizeof(int64_t) );
+	res->fail_ms = calloc( runs, sizeof(int64_t) );
+	if ( res->ms == NULL || res->fail_ms == NULL )
+		return -1;
+
+	for ( seed = 1; seed <= runs; seed++ )
+	{
+		if ( njobs == maxjobs )
+			finish( jobs, &njobs, res, &nms, &nfail, out );
+		if ( start( &jobs[ njobs ], sc->spec, seed ) < 0 )
+		{
+			perror( "faultsuite: cannot start a run" );
+			return -1;
+		}
+		njobs++;
+	}
+	while ( njobs > 0 )
+		finish( jobs, &njobs, res, &nms, &nfail, out );
+
+	qsort( res->ms, nms, sizeof(int64_t), cmp64 );
+	qsort( res->fail_ms, nfail, sizeof(int64_t), cmp64 );
+	return 0;
+}
+
+static void
+usage ( void )
+{
+	fprintf( stderr,
+		 "usage: faultsuite [-n runs] [-j jobs] [-p getInfoIPMI] [name=spec ...]\n\n"
+		 "  -n runs   runs per scenario, seeds 1 to runs, default 100\n"
+		 "  -j jobs   runs at a time, default 16\n"
+		 "  -p path   getInfoIPMI built with -DIPMI_FAULT\n" );
+	exit( 2 );
+}
+
+int
+main ( int argc, char **argv )
+{
+	struct scenario		*list;
+	struct scenario		clean = { "reference", "" };
+	struct result		res;
+	int			runs = 100, jobs = 16, nlist, i, opt;
+	char			*eq;
+
+	while ( (opt = getopt( argc, argv, "n:j:p:" )) != -1 )
+	{
+		switch ( opt ) {
+		case 'n': runs = atoi( optarg ); break;
+		case 'j': jobs = atoi( optarg ); break;
+		case 'p': prog = optarg; break;
+		default : usage();
+		}
+	}
+	if ( runs < 1 || jobs < 1 || jobs > MAXJOBS )
+		usage();
+
+	if ( optind == argc )
+	{
+		nlist = sizeof(builtin) / sizeof(builtin[0]);
+		list = (struct scenario *)builtin;
+	}
+	else
+	{
+		nlist = argc - optind;
+		list = calloc( nlist, sizeof(*list) );
+		for ( i = 0; i < nlist; i++ )
+		{
+			if ( (eq = strchr( argv[ optind + i ], '=' )) == NULL )
+				usage();
+			*eq = '\0';
+			list[i].name = argv[ optind + i ];
+			list[i].spec = eq + 1;
+		}
+	}
+
+	// what a run without faults prints is the right answer
+	if ( run( &clean, 1, 1, &res, reference ) < 0 || res.failed )
+	{
+		fprintf( stderr, "faultsuite: %s fails without faults\n", prog );
+		return 1;
+	}
+	free( res.ms );
+	free( res.fail_ms );
+
+	printf( "%-12s %5s %5s %5s %5s %7s %7s %7s %7s %9s\n", "scenario",
+		"runs", "ok", "wrong", "fail", "p50 ms", "p90 ms", "p99 ms",
+		"max ms", "fail p50" );
+
+	for ( i = 0; i < nlist; i++ )
+	{
+		if ( run( &list[i], runs, jobs, &res, NULL ) < 0 )
+			return 1;
+
+		printf( "%-12s %5d %5d %5d %5d %7lld %7lld %7lld %7lld ",
+			list[i].name, runs, res.ok, res.wrong, res.failed,
+			(long long)pct( res.ms, runs, 50 ),
+			(long long)pct( res.ms, runs, 90 ),
+			(long long)pct( res.ms, runs, 99 ),
+			(long long)res.ms[ runs - 1 ] );
+		if ( res.failed )
+			printf( "%9lld\n",
+				(long long)pct( res.fail_ms, res.failed, 50 ) );
+		else
+			printf( "%9s\n", "-" );
+		fflush( stdout );
+
+		free( res.ms );
+		free( res.fail_ms );
+	}
+	return 0;
+
+} // end of main()
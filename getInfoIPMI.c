@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -15,18 +16,25 @@
 #include <netinet/in.h>
 #include <net/if.h>
 #include <signal.h>
+#include <time.h>
+
+#include "ipmicmd.h"
+#include "ipmifault.h"
+#include "ipmifru.h"
+#include "iptrace.h"
+
+/*
+ *	$ gcc -o getInfoIPMI getInfoIPMI.c ipmicmd.c ipmifru.c iptrace.c
+ *
+ * Add -DIPMI_TRACE for the phase timing printed by --timing, and
+ * -DIPMI_FAULT with ipmifault.c to run against injected faults or the
+ * simulated BMC, as faultsuite does.
+ */
 
-#define uchar		unsigned char
 #define EXIT_SUCCESS	0
 #define EXIT_FAIL	1
 #define EXIT_USAGEERR	2
 #define DMIDECODE	"/usr/sbin/dmidecode"
-#define IPMI_DRIVER	"/dev/ipmi0"
-
-typedef	enum {
-	UNKNOWN = 0,
-	X86HOST,
-} product_t;
 
 typedef struct {
         int rack;
@@ -34,13 +42,63 @@ typedef struct {
         int slot;
 } HWlocation;
 
-#define _X86HOST			"X86HOST"
+/*
+ * Product plans
+ *
+ * A plan is the list of steps that find a product's location. A step
+ * is a command described in ipmicmd.h, or a local action, and names
+ * the steps it needs done first and the response bytes it extracts
+ * into plan variables; a request byte can come from a variable an
+ * earlier step set. read_address sends every step whose dependencies
+ * are done at once on one driver session and takes the answers in
+ * whatever order they come, so independent steps overlap. Supporting
+ * another platform means another table in products[].
+ */
+#define PV_NONE		0
+#define PV_LOGICAL	1	// logical slot
+#define PV_IPMBADDR	2
+#define PV_SLOT		3	// physical slot
+#define PV_SUBRACK	4
+#define PV_RACK		5
+#define PV_ENABLES	6	// BMC global enables
+#define PV_N		7
+
+#define PLAN_MAXSTEPS	32
+#define STEP(n)		( 1u << (n) )
+
+typedef struct {
+	int	var;		// PV_*, PV_NONE if unused
+	uchar	offset;		// response byte, cc is 0
+	uchar	mask;
+} PlanExtract;
+
+typedef struct {
+	const char	*name;
+	const IpmiCmdDesc *desc;	// NULL for a local step
+	int		addr_type;
+	uchar		req[4];
+	int		sreq;
+	int		reqvar;		// PV_* to put in req[reqpos]
+	int		reqpos;
+	int		skipvar;	// skip the step if this PV_* is set
+	unsigned	deps;		// STEP(i) if step i comes first
+	int		minrsp;		// response bytes the step needs, cc
+					// included; 0 for all of desc's
+	PlanExtract	get[2];
+	int		(*hook)( int *v, const uchar *rsp, int rlen );
+} PlanStep;
+
+typedef struct {
+	const char	*productid;	// prefix of the dmidecode name
+	const PlanStep	*steps;
+	int		nsteps;
+} ProductPlan;
 
 // Global Variables
-int		Verbose;
-product_t	product;
+const ProductPlan	*plan;
 char		productid[32];
-char		toolname[32];
+
+const ProductPlan *resolve_plan ( const char *id );
 
 void sigTermHandler(int sigNum) {
 	if (sigNum != SIGTERM)
@@ -57,220 +115,6 @@ void sigTermHandler(int sigNum) {
 	}
 	return;
 }
- 
-int
-setipmbaddr ( uchar ipmbaddr )
-{
-	int		rc;
-	int		fd;
-	struct ipmi_channel_lun_address_set	sChan;
-
-	/*
-	 *  IPMI allows multiple IPMB channels on a single interface, and
-	 *  each channel might have a different IPMB address.  However, the
-	 *  driver has only one IPMB address that it uses for everything.
-	 *  This procedure adds new IOCTLS and a new internal interface for
-	 *  setting per-channel IPMB addresses and LUNs.
-	 */
-	// open IPMI driver
-	if ( (fd = open( IPMI_DRIVER, O_RDWR )) < 0 )
-	{
-		fprintf( stderr,
-			"%s: Error: No device %s or IPMI driver not loaded\n",
-			toolname,IPMI_DRIVER);
-		return -1;
-	}
-
-	// find what it was set to
-	sChan.channel = 0;
-	sChan.value   = 0;
-	rc = ioctl( fd, IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD, &sChan );
-	if ( rc < 0 )
-	{
-		fprintf( stderr,
-			"%s: Error: IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD "
-			"ioctl_rc=%d errno=%d\n", toolname, rc, errno );
-		close( fd );
-		return -1;
-	}
-	if ( Verbose )
-	{
-		printf( "check default ADDRESS: channel = %d, addr = 0x%02X\n",
-			sChan.channel, sChan.value );
-	}
-
-	// set it to the new value
-	sChan.value = ipmbaddr;
-	rc = ioctl( fd, IPMICTL_SET_MY_CHANNEL_ADDRESS_CMD, &sChan );
-	if ( rc < 0 )
-	{
-		fprintf(stderr, "%s: Error: IPMICTL_SET_MY_CHANNEL_ADDRESS_CMD "
-			"ioctl_rc=%d errno=%d\n", toolname, rc, errno );
-		close( fd );
-		return -1;
-	}
-	if ( Verbose )
-	{
-		printf( "default ADDRESS changed channel = %d addr = 0x%02X\n",
-			sChan.channel, sChan.value );
-	}
-
-	// double check the setting
-	rc = ioctl( fd, IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD, &sChan );
-	if ( rc < 0 )
-	{
-		fprintf( stderr, "%s: Error: IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD"
-			" ioctl_rc=%d errno=%d\n", toolname, rc, errno );
-		close( fd );
-		return -1;
-	}
-	if ( Verbose )
-	{
-		printf( "new default ADDRESS: channel = %d, addr = 0x%02X\n",
-			sChan.channel, sChan.value );
-	}
-
-	if ( sChan.value != ipmbaddr )
-	{
-		fprintf( stderr, "%s: Error: Setting new address failed "
-			"value = 0x%02X addr = 0x%02X\n",
-			toolname, sChan.value, ipmbaddr );
-		close( fd );
-		return -1;
-	}
-
-	close( fd );
-	return 0;
-
-} // end of setipmbaddr()
-
-int
-ipmicmd_mv ( int addr_type, uchar cmd, uchar netfn, uchar lun,
-	     uchar *pdata, uchar sdata, uchar *presp, int sresp, int *rlen )
-
-{
-	/*
-	 * 
-	 * It opens the IPMI driver, formats an IPMI command for the
-	 * specified address type, and then sends it to IPMI. It waits
-	 * for a response and then updates *presp with the results.
-	 */
-
-	int		ipmi_fd;
-	fd_set		readfds;
-	int		rv;
-	char		*endptr;
-	struct timeval	tv;
-
-	struct ipmi_recv	rsp;
-	struct ipmi_addr	addr;
-	struct ipmi_req		req;
-	struct ipmi_ipmb_addr	ipmb_addr;
-	struct ipmi_system_interface_addr	bmc_addr;
-
-	static int	curr_seq = 0;
-
-	*rlen = 0;
-
-	// open IPMI driver
-	if ( (ipmi_fd = open( IPMI_DRIVER, O_RDWR )) < 0 )
-	{
-		fprintf( stderr,
-			"%s: Error: No device %s or IPMI driver not loaded\n",
-			toolname, IPMI_DRIVER);
-		return -1;
-	}
-
-	FD_ZERO( &readfds );
-	FD_SET( ipmi_fd, &readfds );
-
-	/*
-	 *  Send the IPMI command 
-	 */
-	switch (addr_type) {
-	case IPMI_IPMB_ADDR_TYPE:
-		ipmb_addr.addr_type  = IPMI_IPMB_ADDR_TYPE;
-		ipmb_addr.slave_addr = IPMI_BMC_SLAVE_ADDR;
-		ipmb_addr.channel    = 0x00;
-		ipmb_addr.lun        = lun;
-		req.addr     = (char *) &ipmb_addr;
-		req.addr_len = sizeof(ipmb_addr);
-		break;
-
-	case IPMI_SYSTEM_INTERFACE_ADDR_TYPE:
-		bmc_addr.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
-		bmc_addr.channel   = IPMI_BMC_CHANNEL;
-		bmc_addr.lun       = lun;	// BMC_LUN = 0
-		req.addr     = (char *) &bmc_addr;
-		req.addr_len = sizeof(bmc_addr);
-		break;
-
-	default:
-		fprintf( stderr, "%s: Error: Unknown addressing type %d\n",
-			toolname, addr_type );
-		close( ipmi_fd );
-		return -1;
-	}
-
-	req.msg.cmd	 = cmd;
-	req.msg.netfn	 = netfn;
-	req.msgid	 = curr_seq++;
-	req.msg.data	 = pdata;
-	req.msg.data_len = sdata;
-	if ( (rv = ioctl( ipmi_fd, IPMICTL_SEND_COMMAND, &req )) < 0 )
-	{
-		fprintf( stderr,
-			"%s: Error: IPMICTL_SEND_COMMAND "
-			"ioctl_rc=%d errno=%d\n", toolname, rv, errno );
-		close( ipmi_fd );
-		return -1;
-	}
-
-	/*
-	 *  Wait for response
-	 */
-	int dataToRead = 0;
-	int counter;
-	for ( counter = 0; counter < 3 && !dataToRead; counter++ )
-	{
-		tv.tv_sec = 2;
-		tv.tv_usec = 0;
-		rv = select( ipmi_fd+1, &readfds, NULL, NULL, &tv );
-		if ( rv && FD_ISSET( ipmi_fd, &readfds ) )
-	    		dataToRead = 1;
-	}
-	if ( !dataToRead  )
-	{
-		if ( Verbose )
-		{
-			fprintf( stderr, "%s: Error: No response from IPMI\n",
-				toolname);
-		}
-		close( ipmi_fd );
-		return -1;
-	}
-
-	/*
-	 *  Receive the IPMI response
-	 */
-	rsp.addr	 = (char *) &addr;
-	rsp.addr_len	 = sizeof(addr);
-	rsp.msg.data	 = presp;
-	rsp.msg.data_len = sresp;
-	if ( (rv = ioctl( ipmi_fd, IPMICTL_RECEIVE_MSG_TRUNC, &rsp )) < 0 )
-	{
-		fprintf( stderr,
-			"%s: Error: IPMICTL_RECEIVE_MSG_TRUNC "
-			"ioctl_rc=%d errno=%d\n", toolname, rv, errno );
-		close( ipmi_fd );
-		return -1;
-	}
-
-	*rlen = rsp.msg.data_len;
-	close( ipmi_fd );
-	return 0;
-
-} // end of ipmicmd_mv()
 
 int
 run_dmidecode ( char *dmi_option )
@@ -285,6 +129,7 @@ run_dmidecode ( char *dmi_option )
 	int counter = 0;
 
 	char cmd[ 256 ];
+	TRACE_SCOPE(TP_DMIDECODE);
 
 	// productid is a global set by this function
 	memset( productid, 0, sizeof(productid) );
@@ -295,6 +140,7 @@ run_dmidecode ( char *dmi_option )
 	sprintf( cmd, "%s -s %s", DMIDECODE, dmi_option );
 
 	fp = popen( cmd, "r" );
+	TRACE_FORK();
 	if ( fp == NULL )
 	{
 		fprintf( stderr, "%s: Error: popen of '%s' failed\n",
@@ -362,6 +208,8 @@ run_dmidecode ( char *dmi_option )
 int
 detect_hardware ( char *arg )
 {
+	TRACE_SCOPE(TP_DETECT);
+
 	if ( arg == NULL )
 	{
 		// no argument, then attempt to discover hardware
@@ -393,13 +241,8 @@ detect_hardware ( char *arg )
 		strncpy( productid, arg, sizeof(productid)-1 );
 	}
 
-	product = UNKNOWN;
-
-	if ( !strncmp( productid, _X86HOST, strlen(_X86HOST) ) )
-	{
-		product = X86HOST;
-	}
-	else
+	plan = resolve_plan( productid );
+	if ( plan == NULL )
 	{
 		fprintf( stderr, "%s: Error: unsupported productid '%s'\n",toolname,productid);
 		return -1;
@@ -414,283 +257,793 @@ detect_hardware ( char *arg )
 static int	conv_slot[ MAX_STA*2 ] = {  0,  7,  8,  6,  9,  5, 10,  4,
 					       11,  3, 12,  2, 13,  1, 14 };
 
+/*
+ * Shelf slot map
+ *
+ * scan_shelf sends Get Address Info for the hardware address of every
+ * site in the conv_slot range, with up to SCAN_WINDOW of them in flight
+ * on one driver session, and builds the logical-to-physical slot table
+ * from the answers. It is cached in SLOTMAP_CACHE so read_address on
+ * any blade in the shelf can look its slot up there for SLOTMAP_TTL
+ * seconds instead of asking the shelf again. Runs against the simulated
+ * BMC of ipmifault neither read nor write it.
+ */
+#define SLOTMAP_CACHE	"/run/getInfoIPMI.slotmap"
+#define SLOTMAP_TTL	600
+#define SCAN_WINDOW	8
+#define NSITES		( MAX_STA*2 )
 
+typedef struct {
+	int	present;
+	int	hwaddr;
+	int	ipmbaddr;
+	int	site;		// physical slot
+	int	sitetype;
+} SlotEntry;
+
+/*
+ * Returns the number of sites that could not be asked or did not
+ * answer, 0 for a complete map, or -1 if the driver can't be opened.
+ */
 int
-read_address (HWlocation *hwdata)
+scan_shelf ( SlotEntry *map, int window )
 {
-	char		rsp_data[40];
-	char		data[40];
-	int		rc, subr;
-	int		rlen;
-	int		fd;
-	int		mode;
-	int		i;
-	int		logical_slot;
-	char		line[200];
-	FILE*		fp;
-	uchar		ipmbaddr;
-
-	// Initialize
-	hwdata->rack = 0;
-	hwdata->subrack = 0;
-	hwdata->slot = 0;
-	logical_slot = 0;
+	PicmgAddrInfoReq	req;
+	const PicmgAddrInfoRsp	*info;
+	uchar		rsp_data[40];
+	long		msgid[ NSITES ];
+	long		rspid;
+	int		fd, rc, rlen;
+	int		next = 1, inflight = 0, done = 1;	// sites 1..NSITES-1
+	int		missing = 0;
+	int		k;
+
+	memset( map, 0, NSITES * sizeof(*map) );
+	for ( k = 0; k < NSITES; k++ )
+		msgid[k] = -1;
+
+	if ( (fd = ipmi_open()) < 0 )
+		return -1;
 
-	switch ( product ) 
+	while ( done < NSITES )
 	{
-	case X86HOST:
-
-		memset( data, 0, sizeof(data) );
-		memset( rsp_data, 0, sizeof(rsp_data) );
-		rc = ipmicmd_mv( IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
-				 0x01, 0x2c, 0, data, 1,
-				 rsp_data, sizeof(rsp_data), &rlen );
-
-		if ( rc < 0 || rlen < 4 )
+		// keep the window full
+		while ( inflight < window && next < NSITES )
 		{
-			fprintf( stderr,
-				"%s: Error: in ipmicmd_mv get address info "
-				"rc=%d rlen=%d\n", toolname, rc, rlen );
-			return -1;
+			/* PICMG id, FRU 0, key type hardware address */
+			memset( &req, 0, sizeof(req) );
+			req.key_type = PICMG_KEY_HWADDR;
+			req.key = 0x40 | next;
+			msgid[next] = ipmicmd_send( fd, IPMI_IPMB_ADDR_TYPE,
+					picmg_get_address_info.cmd,
+					picmg_get_address_info.netfn, 0,
+					(uchar *)&req, sizeof(req) );
+			if ( msgid[next] < 0 )
+			{
+				done++;
+				missing++;
+			}
+			else
+				inflight++;
+			next++;
 		}
-		if ( rsp_data[0] != 0 )
+		if ( inflight == 0 )
+			break;
+
+		// the driver answers every IPMB request, with a timeout
+		// completion code if need be, so 6 seconds of silence
+		// means it has stopped
+		rc = ipmicmd_recv( fd, rsp_data, sizeof(rsp_data), &rlen,
+				   &rspid, 6000 );
+		if ( rc != 0 )
 		{
-			fprintf( stderr, "%s: Error: in get address info "
-				"completion code 0x%2.2X\n",
-				toolname, rsp_data[0] & 0xff);
-			return -1;
+			fprintf( stderr, "%s: Error: shelf scan got no answer"
+				" for %d sites\n", toolname, inflight );
+			missing += inflight;
+			break;
 		}
 
+		for ( k = 1; k < NSITES && msgid[k] != rspid; k++ )
+			;
+		if ( k == NSITES )
+			continue;	// stale
+		msgid[k] = -1;
+		inflight--;
+		done++;
+
 		if ( Verbose )
 		{
-			int i = 0;
-			printf("Logical address query\n");
+			int i;
+			printf("Site 0x%02X address query\n", 0x40 | k);
 			for (i = 0; i < rlen; i++) {
 				printf("rsp_data[%i]  %02X\n", i, rsp_data[i]);
 			}
 		}
 
-		/* Store logical slot */
-		logical_slot = rsp_data[2] & 0x0F;
+		info = ipmicmd_view( &picmg_get_address_info, rsp_data, rlen );
+		if ( info == NULL )
+			continue;	// nothing there
+
+		map[k].present = 1;
+		map[k].hwaddr = info->hwaddr;
+		map[k].ipmbaddr = info->ipmbaddr;
+		map[k].site = info->site_number & 0x0F;
+		map[k].sitetype = info->site_type;
+		if ( map[k].site == 0 )
+			map[k].site = conv_slot[ k ];
+	}
 
-		// set IPMB address
-		ipmbaddr = rsp_data[3];
-		rc = setipmbaddr( ipmbaddr );
-		if ( rc < 0 )
-		{
-			fprintf( stderr,
-				"%s: Error: in setipmbaddr rc=%d ipmbaddr=%d\n",
-				toolname, rc, ipmbaddr);
-			return -1;
-		}		
+	close( fd );
+	return missing;
 
-		/*
-		 * This code queries the physical slot of a card given
-		 * the IPMB address.
-		 */
-		memset( data, 0, sizeof(data) );
-		memset( rsp_data, 0, sizeof(rsp_data) );
+} // end of scan_shelf()
 
-		/* Copying IPMB address. data 0 & 1 should be 0 */
-		data[2] = 1;
-		data[3] = ipmbaddr & 0xff ;
-		rc = ipmicmd_mv( IPMI_IPMB_ADDR_TYPE,
-				 0x01, 0x2c, 0, data, 4,
-				 rsp_data, sizeof(rsp_data), &rlen );
+int
+save_slotmap ( SlotEntry *map )
+{
+	char		tmp[ sizeof(SLOTMAP_CACHE) + 8 ];
+	FILE*		fp;
+	int		k;
 
-		if ( rc < 0 || rlen < 4 )
-		{
-			fprintf( stderr,
-				"%s: Error: in ipmicmd_mv get address "
-				"info rc=%d rlen=%d\n", toolname, rc, rlen );
-			return -1;
-		}
-		if ( rsp_data[0] != 0 )
-		{
-			fprintf( stderr,
-				"%s: Error: in get address info completion "
-				"code 0x%2.2X\n", toolname, rsp_data[0] & 0xff);
-			return -1;
-		}
+	// the simulated shelf is not the one the cache describes
+	if ( IPMI_SIM() )
+		return 0;
 
-		if ( Verbose )
-		{
-			int i = 0;
-			printf("Physical address query\n");
-			for (i = 0; i < rlen; i++) {
-				printf("rsp_data[%i]  %02X\n", i, rsp_data[i]);
-			}
-		}
+	snprintf( tmp, sizeof(tmp), "%s.tmp", SLOTMAP_CACHE );
+	if ( (fp = fopen( tmp, "w" )) == NULL )
+		return -1;
+
+	fprintf( fp, "# getInfoIPMI slot map %ld\n", (long)time(NULL) );
+	for ( k = 1; k < NSITES; k++ )
+	{
+		if ( map[k].present )
+			fprintf( fp, "%d %d %d %d %d\n", k, map[k].hwaddr,
+				 map[k].ipmbaddr, map[k].site,
+				 map[k].sitetype );
+	}
 
-		/* Physical slot */
-		hwdata->slot = rsp_data[6] & 0x0F;
+	if ( fclose( fp ) != 0 || rename( tmp, SLOTMAP_CACHE ) != 0 )
+	{
+		unlink( tmp );
+		return -1;
+	}
+	return 0;
+
+} // end of save_slotmap()
+
+int
+load_slotmap ( SlotEntry *map )
+{
+	struct stat	st;
+	char		line[200];
+	FILE*		fp;
+	SlotEntry	e;
+	int		k;
 
-		/* If slot was not retrieved, then use logical slot */
-		if (hwdata->slot == 0)
+	memset( map, 0, NSITES * sizeof(*map) );
+
+	if ( IPMI_SIM() )
+		return -1;
+	if ( stat( SLOTMAP_CACHE, &st ) < 0
+	     || time(NULL) - st.st_mtime > SLOTMAP_TTL )
+		return -1;
+	if ( (fp = fopen( SLOTMAP_CACHE, "r" )) == NULL )
+		return -1;
+
+	while ( fgets( line, sizeof(line), fp ) )
+	{
+		if ( sscanf( line, "%d %d %d %d %d", &k, &e.hwaddr,
+			     &e.ipmbaddr, &e.site, &e.sitetype ) != 5
+		     || k < 1 || k >= NSITES )
+			continue;
+		e.present = 1;
+		map[k] = e;
+	}
+	fclose( fp );
+	return 0;
+
+} // end of load_slotmap()
+
+/*
+ * The physical slot of the board at ipmbaddr from a fresh cached shelf
+ * map, or 0 if there isn't one.
+ */
+int
+lookup_slotmap ( uchar ipmbaddr )
+{
+	SlotEntry	map[ NSITES ];
+	int		k;
+
+	if ( load_slotmap( map ) < 0 )
+		return 0;
+	for ( k = 1; k < NSITES; k++ )
+	{
+		if ( map[k].present && map[k].ipmbaddr == ipmbaddr )
 		{
 			if ( Verbose )
-			{
-				printf("Failed to retrieve physical slot.\n");
-				printf("Using table for conversion.\n");
-			}
-			hwdata->slot = conv_slot[ logical_slot & 0x0F ];
+				printf("Slot %d from %s\n", map[k].site,
+				       SLOTMAP_CACHE);
+			return map[k].site;
 		}
+	}
+	return 0;
 
-		memset( rsp_data, 0, sizeof(rsp_data) );
-		rc = ipmicmd_mv( IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
-				 0x01, 0x06, 0, NULL, 0,
-				 rsp_data, sizeof(rsp_data), &rlen );
+} // end of lookup_slotmap()
 
-		if ( rc < 0 || rlen < 1 )
-		{
-			fprintf( stderr,
-				"%s: Error: in ipmicmd_mv get device Id, "
-				"rc=%d, rlen =%d\n",toolname,rc,rlen );
-			return -1;
-		}
-		if ( rsp_data[0] != 0 )
-		{
-			fprintf( stderr, 
-				"%s: Error: Get device Id error, completion "
-				"code 0x%2.2X\n", 
-				toolname, rsp_data[0] & 0xff );
-			return -1;
-		}
+/*
+ * Print the shelf map, scanning the shelf and refreshing the cache.
+ *
+ * A scan with sites that never answered is printed but not cached,
+ * since the boards behind them would be missing from the map for the
+ * whole SLOTMAP_TTL, and fails.
+ */
+int
+print_slotmap ( int window )
+{
+	SlotEntry	map[ NSITES ];
+	int		k, n = 0, missing;
 
-		if ( Verbose )
-		{
-			printf( "Device infos    ID  Rev Firmware  IPMI    PRODUCT\n" );
-			printf( "-------------------------------------------------\n" );
-			printf( "%s  %02X   %02X   %02X.%02X    %01X.%01X    %-30s\n",
-				"              ",
-				rsp_data[1], rsp_data[2] & 0xff, rsp_data[3],
-				rsp_data[4] & 0xff, rsp_data[5] & 0x0f,
-				(rsp_data[5] & 0xf0) >> 4,
-				productid );
-		}
+	if ( (missing = scan_shelf( map, window )) < 0 )
+		return -1;
+	if ( missing )
+		fprintf( stderr, "%s: shelf scan incomplete, %d sites"
+			 " unanswered; %s not updated\n", toolname, missing,
+			 SLOTMAP_CACHE );
+	else if ( save_slotmap( map ) < 0 && Verbose )
+		fprintf( stderr, "%s: cannot write %s\n", toolname,
+			 SLOTMAP_CACHE );
+
+	printf( "Logical  HWAddr  IPMB  Slot  SiteType\n" );
+	printf( "-------------------------------------\n" );
+	for ( k = 1; k < NSITES; k++ )
+	{
+		if ( !map[k].present )
+			continue;
+		printf( "  %2d      0x%02X   0x%02X   %2d     0x%02X\n", k,
+			map[k].hwaddr, map[k].ipmbaddr, map[k].site,
+			map[k].sitetype );
+		n++;
+	}
+	return n && !missing ? 0 : -1;
 
-		memset( rsp_data, 0, sizeof(rsp_data) );
+} // end of print_slotmap()
 
-		/*
-		 * Get receive message queue interrupt via the BMC global enable register.
-		 */
-		rc = ipmicmd_mv( IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
-				 0x2f, 0x06, 0, NULL, 0,
-				 rsp_data, sizeof(rsp_data), &rlen );
+/*
+ * Print the inventory in FRU device fruid.
+ */
+int
+print_fru ( int fruid, int flags )
+{
+	struct fru_info	fi;
+	char		date[32];
 
-		if ( rc < 0 || rlen < 1 )
-		{
-			fprintf( stderr,
-				"%s: Error: in ipmicmd_mv set BMC global "
-				"enable, rc=%d, rlen =%d\n",
-				toolname,rc,rlen );
-			return -1;
-		}
-		if ( rsp_data[0] != 0 )
-		{
-			fprintf( stderr,
-				"%s: Error: Set BMC global enable, completion"
-				" code 0x%2.2X\n",
-				toolname, rsp_data[0] & 0xff );
-			return -1;
-		}
+	if ( fru_read( fruid, &fi, flags ) < 0 )
+	{
+		fprintf( stderr, "%s: Error: cannot read FRU %d\n",
+			 toolname, fruid );
+		return -1;
+	}
 
-		if ( Verbose )
+	if ( fi.areas & FRU_BOARD )
+	{
+		printf( "BOARD_MFG=%s\n", fi.board_mfg );
+		printf( "BOARD_PRODUCT=%s\n", fi.board_product );
+		printf( "BOARD_SERIAL=%s\n", fi.board_serial );
+		printf( "BOARD_PART=%s\n", fi.board_part );
+		date[0] = 0;
+		if ( fi.board_mfg_time )
+			strftime( date, sizeof(date), "%Y-%m-%d %H:%M",
+				  gmtime( &fi.board_mfg_time ) );
+		printf( "BOARD_MFG_DATE=%s\n", date );
+	}
+	if ( fi.areas & FRU_PRODUCT )
+	{
+		printf( "PRODUCT_MFG=%s\n", fi.product_mfg );
+		printf( "PRODUCT_NAME=%s\n", fi.product_name );
+		printf( "PRODUCT_PART=%s\n", fi.product_part );
+		printf( "PRODUCT_VERSION=%s\n", fi.product_version );
+		printf( "PRODUCT_SERIAL=%s\n", fi.product_serial );
+		printf( "PRODUCT_ASSET=%s\n", fi.product_asset );
+	}
+	if ( fi.areas & FRU_CHASSIS )
+	{
+		printf( "CHASSIS_TYPE=%d\n", fi.chassis_type );
+		printf( "CHASSIS_PART=%s\n", fi.chassis_part );
+		printf( "CHASSIS_SERIAL=%s\n", fi.chassis_serial );
+	}
+	return 0;
+
+} // end of print_fru()
+
+/*
+ * BMC prefetch
+ *
+ * The logical Get Address Info and the Get Device ID don't depend on
+ * the product, so main sends both before detect_hardware runs
+ * dmidecode, and collects them afterwards; the BMC answers while
+ * dmidecode is still running. read_address takes the answers from
+ * here, and asks again itself for any that didn't come.
+ */
+#define PF_NCMDS	2
+
+static const IpmiCmdDesc *pf_cmds[ PF_NCMDS ] = {
+	&picmg_get_address_info,	// PICMG id only: this board's own
+	&ipmi_get_device_id,
+};
+
+typedef struct {
+	int	fd;
+	long	msgid[ PF_NCMDS ];
+	int	ok[ PF_NCMDS ];
+	int	rlen[ PF_NCMDS ];
+	uchar	rsp[ PF_NCMDS ][ 40 ];
+} BmcPrefetch;
+
+void
+prefetch_start ( BmcPrefetch *pf )
+{
+	uchar		data[1];
+	int		i;
+
+	memset( pf, 0, sizeof(*pf) );
+	for ( i = 0; i < PF_NCMDS; i++ )
+		pf->msgid[i] = -1;
+
+	if ( (pf->fd = ipmi_open()) < 0 )
+		return;
+	// not for dmidecode
+	fcntl( pf->fd, F_SETFD, FD_CLOEXEC );
+
+	data[0] = 0;
+	for ( i = 0; i < PF_NCMDS; i++ )
+		pf->msgid[i] = ipmicmd_send( pf->fd,
+			IPMI_SYSTEM_INTERFACE_ADDR_TYPE, pf_cmds[i]->cmd,
+			pf_cmds[i]->netfn, 0, data, pf_cmds[i]->minreq );
+
+} // end of prefetch_start()
+
+void
+prefetch_wait ( BmcPrefetch *pf )
+{
+	uchar		rsp_data[40];
+	long		rspid;
+	int		rc, rlen, i;
+	int		pending = 0, counter = 0;
+	TRACE_SCOPE(TP_PREFETCH);
+
+	if ( pf->fd < 0 )
+		return;
+
+	for ( i = 0; i < PF_NCMDS; i++ )
+		if ( pf->msgid[i] >= 0 )
+			pending++;
+
+	// same patience as ipmicmd_fd, 3 times 2 seconds of silence
+	while ( pending > 0 && counter < 3 )
+	{
+		rc = ipmicmd_recv( pf->fd, rsp_data, sizeof(rsp_data), &rlen,
+				   &rspid, 2000 );
+		if ( rc < 0 )
+			break;
+		if ( rc > 0 )
 		{
-			printf ("Receive message queue interrupt is 0x%x\n",
-				rsp_data[1] );
+			counter++;
+			continue;
 		}
 
-		/*
-		 * If not already set, set receive message queue interrupt via
-		 * the BMC global enable register.
-		 */
-		if( rsp_data[1] == 0 )
-		{
-			memset( rsp_data, 0, sizeof(rsp_data) );
-			memset( data, 0, sizeof(data) );
-			data[0] = 0x1;
+		for ( i = 0; i < PF_NCMDS && pf->msgid[i] != rspid; i++ )
+			;
+		if ( i == PF_NCMDS || pf->ok[i] )
+			continue;	// stale
+		memcpy( pf->rsp[i], rsp_data, sizeof(rsp_data) );
+		pf->rlen[i] = rlen;
+		pf->ok[i] = 1;
+		pending--;
+	}
 
-			if ( Verbose )
-			{
-				printf ("Setting receive message queue "
-					"interrupt to 0x%x\n", data[0] );
-			}
+	if ( pending > 0 && Verbose )
+		fprintf( stderr, "%s: %d prefetched commands unanswered, "
+			 "asking again\n", toolname, pending );
 
-			/*
-			 * Set receive message queue interrupt via the BMC
-			 * global enable register.
-			 */
-			rc = ipmicmd_mv( IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
-					 0x2e, 0x06, 0, data, 1,
-					 rsp_data, sizeof(rsp_data), &rlen );
+	close( pf->fd );
+	pf->fd = -1;
 
-			if ( rc < 0 || rlen < 1 )
-			{
-				fprintf( stderr,
-					"%s: Error: in ipmicmd_mv set BMC "
-					"global enable, rc=%d, rlen =%d\n",
-					toolname,rc,rlen );
-				return -1;
-			}
-			if ( rsp_data[0] != 0 )
-			{
-				fprintf( stderr,
-					"%s: Error: Set BMC global enable, "
-					"completion code 0x%2.2X\n",
-					toolname, rsp_data[0] & 0xff );
-				return -1;
-			}
-		}
+} // end of prefetch_wait()
+
+/*
+ * Copy the prefetched answer to desc sent with the request data
+ * pdata into presp. Returns 1 if there is one, else 0.
+ */
+int
+prefetch_take ( BmcPrefetch *pf, const IpmiCmdDesc *desc, int addr_type,
+		const uchar *pdata, int sdata, uchar *presp, int sresp,
+		int *rlen )
+{
+	int		i, k;
+
+	if ( pf == NULL || addr_type != IPMI_SYSTEM_INTERFACE_ADDR_TYPE
+	     || sdata != desc->minreq )
+		return 0;
+	// prefetch_start sends zeros
+	for ( k = 0; k < sdata; k++ )
+		if ( pdata[k] != 0 )
+			return 0;
 
-		memset( data, 0, sizeof(data) );
-		memset( rsp_data, 0, sizeof(rsp_data) );
+	for ( i = 0; i < PF_NCMDS; i++ )
+	{
+		if ( pf_cmds[i] != desc || !pf->ok[i] )
+			continue;
+		*rlen = pf->rlen[i] < sresp ? pf->rlen[i] : sresp;
+		memcpy( presp, pf->rsp[i], *rlen );
+		return 1;
+	}
+	return 0;
+
+} // end of prefetch_take()
+
+int
+plan_setipmbaddr ( int *v, const uchar *rsp, int rlen )
+{
+	(void)rsp;
+	(void)rlen;
+	if ( setipmbaddr( v[PV_IPMBADDR] ) < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: in setipmbaddr ipmbaddr=%d\n",
+			toolname, v[PV_IPMBADDR] );
+		return -1;
+	}
+	return 0;
+}
 
-		rc = ipmicmd_mv( IPMI_IPMB_ADDR_TYPE,
-				 0x02, 0x2c, 0, data, 1,
-				 rsp_data, sizeof(rsp_data), &rlen );
+/*
+ * Take the physical slot from the shelf map if a scan has cached one.
+ */
+int
+plan_slotmap ( int *v, const uchar *rsp, int rlen )
+{
+	(void)rsp;
+	(void)rlen;
+	v[PV_SLOT] = lookup_slotmap( v[PV_IPMBADDR] );
+	return 0;
+}
 
-		if ( rc < 0 || rlen < 3 )
+/*
+ * If slot was not retrieved, then use logical slot
+ */
+int
+plan_conv_slot ( int *v, const uchar *rsp, int rlen )
+{
+	(void)rsp;
+	(void)rlen;
+	if ( v[PV_SLOT] == 0 )
+	{
+		if ( Verbose )
 		{
-			fprintf( stderr,
-				"%s: Error: in ipmicmd_mv get chassis number"
-				" Id, rc=%d, rlen =%d\n",toolname,rc,rlen );
-			return -1;
+			printf("Failed to retrieve physical slot.\n");
+			printf("Using table for conversion.\n");
 		}
-		if ( rsp_data[0] != 0 )
+		v[PV_SLOT] = conv_slot[ v[PV_LOGICAL] & 0x0F ];
+	}
+	return 0;
+}
+
+int
+plan_print_devid ( int *v, const uchar *rsp, int rlen )
+{
+	const IpmiDeviceIdRsp	*devid = (const IpmiDeviceIdRsp *)rsp;
+
+	(void)v;
+	if ( Verbose && rlen >= (int)sizeof(IpmiDeviceIdRsp) )
+	{
+		printf( "Device infos    ID  Rev Firmware  IPMI    PRODUCT\n" );
+		printf( "-------------------------------------------------\n" );
+		printf( "%s  %02X   %02X   %02X.%02X    %01X.%01X    %-30s\n",
+			"              ",
+			devid->device_id, devid->device_rev,
+			devid->fw_major, devid->fw_minor,
+			devid->ipmi_version & 0x0f,
+			(devid->ipmi_version & 0xf0) >> 4,
+			productid );
+	}
+	return 0;
+}
+
+/*
+ * X86HOST: the blade's own address info gives its IPMB address, which
+ * must be set before the IPMB commands; the slot comes from the shelf
+ * map cache, else from the shelf, else from conv_slot. The receive
+ * message queue interrupt is turned on if it is off.
+ */
+enum { X_ADDRINFO, X_SETIPMB, X_SLOTMAP, X_SITE, X_CONVSLOT, X_DEVID,
+       X_GETENABLES, X_SETENABLES, X_SHELF, X_NSTEPS };
+
+static const PlanStep x86host_plan[ X_NSTEPS ] = {
+	[X_ADDRINFO] = {
+		.name = "Logical address query",
+		.desc = &picmg_get_address_info,
+		.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+		.sreq = 1,
+		.minrsp = offsetof(PicmgAddrInfoRsp, ipmbaddr) + 1,
+		.get = { { PV_LOGICAL, offsetof(PicmgAddrInfoRsp, hwaddr), 0x0f },
+			 { PV_IPMBADDR, offsetof(PicmgAddrInfoRsp, ipmbaddr), 0xff } },
+	},
+	[X_SETIPMB] = {
+		.name = "set IPMB address",
+		.deps = STEP(X_ADDRINFO),
+		.hook = plan_setipmbaddr,
+	},
+	[X_SLOTMAP] = {
+		.name = "slot map cache",
+		.deps = STEP(X_ADDRINFO),
+		.hook = plan_slotmap,
+	},
+	[X_SITE] = {
+		.name = "Physical address query",
+		.desc = &picmg_get_address_info,
+		.addr_type = IPMI_IPMB_ADDR_TYPE,
+		.req = { 0, 0, PICMG_KEY_IPMB0, 0 },
+		.sreq = sizeof(PicmgAddrInfoReq),
+		.reqvar = PV_IPMBADDR,
+		.reqpos = offsetof(PicmgAddrInfoReq, key),
+		.skipvar = PV_SLOT,
+		.deps = STEP(X_SETIPMB) | STEP(X_SLOTMAP),
+		.minrsp = offsetof(PicmgAddrInfoRsp, ipmbaddr) + 1,
+		.get = { { PV_SLOT, offsetof(PicmgAddrInfoRsp, site_number), 0x0f } },
+	},
+	[X_CONVSLOT] = {
+		.name = "slot conversion",
+		.deps = STEP(X_SITE),
+		.hook = plan_conv_slot,
+	},
+	[X_DEVID] = {
+		.name = "Get device Id",
+		.desc = &ipmi_get_device_id,
+		.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+		.minrsp = 1,
+		.hook = plan_print_devid,
+	},
+	[X_GETENABLES] = {
+		.name = "Receive message queue interrupt",
+		.desc = &ipmi_get_global_enables,
+		.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+		.minrsp = 1,
+		.get = { { PV_ENABLES, offsetof(IpmiGlobalEnablesRsp, enables), 0xff } },
+	},
+	[X_SETENABLES] = {
+		.name = "Setting receive message queue interrupt",
+		.desc = &ipmi_set_global_enables,
+		.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+		.req = { IPMI_ENABLE_RCV_MSG_INTR },
+		.sreq = sizeof(IpmiGlobalEnablesReq),
+		.skipvar = PV_ENABLES,
+		.deps = STEP(X_GETENABLES),
+	},
+	[X_SHELF] = {
+		.name = "Chassis number query",
+		.desc = &picmg_get_shelf_address_info,
+		.addr_type = IPMI_IPMB_ADDR_TYPE,
+		.sreq = sizeof(PicmgShelfAddrReq),
+		.deps = STEP(X_SETIPMB),
+		.minrsp = offsetof(PicmgShelfAddrRsp, typelen) + 1,
+		.get = { { PV_SUBRACK, offsetof(PicmgShelfAddrRsp, addr[0]), 0x0f },
+			 { PV_RACK, offsetof(PicmgShelfAddrRsp, addr[4]), 0x0f } },
+	},
+};
+
+static const ProductPlan products[] = {
+	{ "X86HOST", x86host_plan, X_NSTEPS },
+};
+
+/*
+ * Find the plan for a product and check it once: steps only depend
+ * on earlier ones, requests fit their commands and extraction rules
+ * stay inside the checked part of the response. read_address can then
+ * run it without checking any of that again.
+ */
+const ProductPlan *
+resolve_plan ( const char *id )
+{
+	const ProductPlan	*p = NULL;
+	const PlanStep		*s;
+	int			i, k;
+
+	for ( i = 0; i < (int)(sizeof(products)/sizeof(products[0])); i++ )
+	{
+		if ( !strncmp( id, products[i].productid,
+			       strlen(products[i].productid) ) )
 		{
-			fprintf( stderr,
-				"%s: Error: in get chassis number completion "
-				"code 0x%2.2X\n", toolname, rsp_data[0]&0xFF );
-			return -1;
+			p = &products[i];
+			break;
 		}
-			  
-		if ( Verbose )
+	}
+	if ( p == NULL )
+		return NULL;
+
+	if ( p->nsteps > PLAN_MAXSTEPS )
+		goto bad;
+	for ( i = 0; i < p->nsteps; i++ )
+	{
+		s = &p->steps[i];
+		if ( s->deps >> i )
+			goto bad;
+		if ( s->desc == NULL )
 		{
-			printf( "\nIPMI Reponse rc=%d rlen=%d rsp_data[3]=0x%x "
-				"rsp_data[7]=0x%x\n\n", 
-				rc, rlen,rsp_data[3],rsp_data[7]);
+			if ( s->hook == NULL )
+				goto bad;
+			continue;
 		}
+		if ( s->sreq < s->desc->minreq || s->sreq > s->desc->maxreq
+		     || (s->reqvar != PV_NONE && s->reqpos >= s->sreq)
+		     || s->minrsp < 0 || s->minrsp > s->desc->minrsp )
+			goto bad;
+		for ( k = 0; k < 2; k++ )
+			if ( s->get[k].var != PV_NONE
+			     && s->get[k].offset >= s->desc->minrsp )
+				goto bad;
+	}
+	return p;
+
+bad:
+	fprintf( stderr, "%s: Error: bad plan for '%s', step %d\n",
+		 toolname, p->productid, i );
+	return NULL;
+
+} // end of resolve_plan()
+
+/*
+ * Check a step's response, extract its variables and run its hook.
+ *
+ * A step with its own minrsp takes a reply shorter than the whole
+ * response struct, as older shelf managers send; a variable whose
+ * byte is missing is 0, which the later steps take as not known.
+ */
+int
+finish_step ( const PlanStep *s, int *v, const uchar *rsp, int rlen )
+{
+	int		k;
 
-		// Populate chassis and cabinet number
-		hwdata->subrack = rsp_data[3]&0xf;
-		hwdata->rack = rsp_data[7]&0xf;
+	if ( ipmicmd_check_min( s->desc, 0, rsp, rlen,
+				s->minrsp ? s->minrsp : s->desc->minrsp )
+	     == NULL )
+		return -1;
 
-		if ( Verbose )
-		{
-			printf ("Maps to:  Cabinet    Chassis    Slot\n");
-			printf ("-------------------------------------\n");
-			printf( "          %02d         %01d         %02d\n",
-				hwdata->rack,  hwdata->subrack, hwdata->slot );
+	if ( Verbose )
+	{
+		int i = 0;
+		printf("%s\n", s->name);
+		for (i = 0; i < rlen; i++) {
+			printf("rsp_data[%i]  %02X\n", i, rsp[i]);
 		}
-		break;
+	}
 
-	default:
+	for ( k = 0; k < 2; k++ )
+		if ( s->get[k].var != PV_NONE )
+			v[ s->get[k].var ] = s->get[k].offset < rlen
+					     ? rsp[ s->get[k].offset ]
+					       & s->get[k].mask
+					     : 0;
+	return s->hook ? s->hook( v, rsp, rlen ) : 0;
 
+} // end of finish_step()
+
+int
+read_address (HWlocation *hwdata, BmcPrefetch *pf)
+{
+	const PlanStep	*s;
+	uchar		rsp_data[40];
+	uchar		req[4];
+	long		msgid[ PLAN_MAXSTEPS ];
+	long		rspid;
+	int		v[ PV_N ];
+	unsigned	all, done = 0, started = 0;
+	int		fd, rc, rlen, i;
+	int		inflight = 0, silent = 0, progress;
+	TRACE_SCOPE(TP_READ_ADDRESS);
+
+	// Initialize
+	hwdata->rack = 0;
+	hwdata->subrack = 0;
+	hwdata->slot = 0;
+	memset( v, 0, sizeof(v) );
+
+	if ( plan == NULL )
+	{
 		printf("%s: Error: Unknown product '%s' !!\n", 
 			toolname,productid);
 		return -1;
 	}
+	all = plan->nsteps == PLAN_MAXSTEPS ? ~0u : STEP(plan->nsteps) - 1;
+
+	if ( (fd = ipmi_open()) < 0 )
+		return -1;
+
+	for ( ;; )
+	{
+		// start every step whose dependencies are done
+		progress = 0;
+		for ( i = 0; i < plan->nsteps; i++ )
+		{
+			s = &plan->steps[i];
+			if ( (started & STEP(i)) || (s->deps & ~done) )
+				continue;
+			started |= STEP(i);
+
+			if ( s->skipvar != PV_NONE && v[ s->skipvar ] )
+				rc = 0;
+			else if ( s->desc == NULL )
+				rc = s->hook( v, NULL, 0 );
+			else
+			{
+				memcpy( req, s->req, sizeof(req) );
+				if ( s->reqvar != PV_NONE )
+					req[ s->reqpos ] = v[ s->reqvar ];
+
+				if ( !prefetch_take( pf, s->desc, s->addr_type,
+						     req, s->sreq, rsp_data,
+						     sizeof(rsp_data), &rlen ) )
+				{
+					msgid[i] = ipmicmd_send( fd,
+						s->addr_type, s->desc->cmd,
+						s->desc->netfn, 0, req,
+						s->sreq );
+					if ( msgid[i] < 0 )
+						goto fail;
+					inflight++;
+					continue;
+				}
+				rc = finish_step( s, v, rsp_data, rlen );
+			}
+			if ( rc < 0 )
+				goto fail;
+			done |= STEP(i);
+			progress = 1;
+		}
+		if ( done == all )
+			break;
+		if ( progress )
+			continue;
+		if ( inflight == 0 )
+			goto fail;
+
+		// same patience as ipmicmd_fd, 3 times 2 seconds of silence
+		rc = ipmicmd_recv( fd, rsp_data, sizeof(rsp_data), &rlen,
+				   &rspid, 2000 );
+		if ( rc < 0 )
+			goto fail;
+		if ( rc > 0 )
+		{
+			if ( ++silent < 3 )
+				continue;
+			fprintf( stderr, "%s: Error: No response from IPMI\n",
+				toolname );
+			goto fail;
+		}
+		silent = 0;
+
+		for ( i = 0; i < plan->nsteps; i++ )
+			if ( (started & ~done & STEP(i)) && msgid[i] == rspid )
+				break;
+		if ( i == plan->nsteps )
+			continue;	// stale
+		inflight--;
+		if ( finish_step( &plan->steps[i], v, rsp_data, rlen ) < 0 )
+			goto fail;
+		done |= STEP(i);
+	}
+	close( fd );
+
+	hwdata->slot = v[PV_SLOT];
+	hwdata->subrack = v[PV_SUBRACK];
+	hwdata->rack = v[PV_RACK];
+
+	if ( Verbose )
+	{
+		printf ("Maps to:  Cabinet    Chassis    Slot\n");
+		printf ("-------------------------------------\n");
+		printf( "          %02d         %01d         %02d\n",
+			hwdata->rack,  hwdata->subrack, hwdata->slot );
+	}
 
 	if ((hwdata->rack < 0 ) || (hwdata->subrack < 0) || (hwdata->slot < 1 ))
 	{
@@ -704,13 +1057,24 @@ read_address (HWlocation *hwdata)
 
 	return 0;
 
+fail:
+	close( fd );
+	return -1;
+
 } // end of read_address()
 
 void
 usage()
 {
-	printf( "USAGE: getInfoIPMI -b|-c|-s [-v]\n\n" );
+	printf( "USAGE: getInfoIPMI -b|-c|-s [-v] [--timing]\n" );
+	printf( "       getInfoIPMI -m [-w window] [-v]\n" );
+	printf( "       getInfoIPMI -f fruid|-F fruid [-v]\n\n" );
 	printf( "        -v                      : verbose mode\n" );
+	printf( "        -m                      : scan the shelf and print the slot map\n" );
+	printf( "        -w window               : requests in flight for -m, default %d\n", SCAN_WINDOW );
+	printf( "        -f fruid                : print the inventory in a FRU device\n" );
+	printf( "        -F fruid                : same, reading it all again\n" );
+	printf( "        --timing                : time each phase\n" );
 	printf( "        -b                      : display cabinet\n" );
 	printf( "        -c                      : display chassis\n" );
 	printf( "        -s                      : display slot\n" );
@@ -722,10 +1086,15 @@ int
 main ( int argc, char **argv )
 {
 	HWlocation hwdata;
+	BmcPrefetch prefetch;
 	Verbose = 0; 
 	int opt_b = 0;	// display cabinet
 	int opt_c = 0;	// display chassis
 	int opt_s = 0; 	// display slot
+	int opt_m = 0;	// scan the shelf
+	int fruid = -1;	// print a FRU device
+	int fruflags = 0;
+	int window = SCAN_WINDOW;
 	int rc = 0;
 
 	strncpy(toolname,argv[0],sizeof(toolname)-1);
@@ -748,6 +1117,30 @@ main ( int argc, char **argv )
 		case 'v' :
 			Verbose = 1;
 			break;
+		case 'm' :
+			opt_m = 1;
+			break;
+		case 'F' :
+			fruflags = FRU_NOCACHE;
+			// fall through
+		case 'f' :
+			if ( argc < 2 || (fruid = atoi( argv[1] )) < 0
+			     || fruid > 0xfe )
+				usage();
+			argc--; argv++;
+			break;
+		case 'w' :
+			if ( argc < 2 || (window = atoi( argv[1] )) < 1 )
+				usage();
+			argc--; argv++;
+			break;
+		case '-' :
+			if ( !strcmp( argv[0], "--timing" ) )
+			{
+				TRACE_REPORT_AT_EXIT();
+				break;
+			}
+			// fall through
 		default  :
 			printf( "Unknown option %s\n", argv[0] );
 			usage();
@@ -755,21 +1148,34 @@ main ( int argc, char **argv )
 		argc--; argv++;
 	}
 
+	if ( opt_m )
+	{
+		if ( window > NSITES - 1 )
+			window = NSITES - 1;
+		exit( print_slotmap( window ) ? EXIT_FAIL : EXIT_SUCCESS );
+	}
+
+	if ( fruid >= 0 )
+		exit( print_fru( fruid, fruflags ) ? EXIT_FAIL : EXIT_SUCCESS );
+
 	if ((opt_s == 0) && (opt_c == 0) && (opt_b == 0))
 	{
 		usage();
 	}
 
-	// detect installed hardware
+	// start the first BMC queries, then detect installed hardware
+	// while the BMC answers them
+	prefetch_start( &prefetch );
 	if ( detect_hardware( argv[0] ) )
 	{
 		// hardware detection has failed
 		printf("%s: Error: in detect_hardware\n",toolname);
 		exit(EXIT_FAIL);
 	}
+	prefetch_wait( &prefetch );
 
 	// read hardware information
-	rc = read_address(&hwdata);
+	rc = read_address(&hwdata, &prefetch);
 	if ( rc != 0 )
 	{
 		// failed to read address
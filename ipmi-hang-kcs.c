@@ -1,29 +1,44 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/io.h>
 
-#define KCS_DATA_PORT 0xc80
+#include "kcsport.h"
+
+/*
+ * Run with a simulation spec as the only argument, e.g. "sim" or
+ * "sim,stuck=write,every=3,for=1500", to test without a real KCS
+ * interface. See kcsport.h.
+ *
+ *	$ gcc -o ipmi-hang-kcs ipmi-hang-kcs.c kcsport.c
+ */
 
 unsigned long range_us = 1000000;  	// 1 second
 unsigned long min_us = 1000000;  	// 1 second
 
-main()
+int main(int argc, char **argv)
 {
+	struct kcsport kp;
+	char *spec = argc > 1 ? argv[1] : NULL;
 	int kcs_byte;
+	int kcs_status;
 	int seqno = 0;
 	int sleeptime;
 
-	printf("\nipmi kcs hang test\n\n");
+	printf("\nipmi kcs hang test%s\n\n", spec ? " (simulated)" : "");
 
 	// we need privileges to read the i/o port
 	//
-	iopl(3);
+	if (kcs_open(&kp, KCS_DATA_PORT, spec) < 0) {
+		perror(spec ? "bad simulation spec" : "iopl");
+		return 1;
+	}
 
 	for (;;) {
 		++seqno;
-		kcs_byte = inb(KCS_DATA_PORT);
-		printf("%03d kcs_byte: %02x ", seqno, kcs_byte);
+		kcs_status = kcs_inb(&kp, KCS_STATUS(KCS_DATA_PORT));
+		kcs_byte = kcs_inb(&kp, KCS_DATA_PORT);
+		printf("%03d kcs_byte: %02x status: %02x ",
+		       seqno, kcs_byte, kcs_status);
 
 		// sleep between 1 and 2 seconds
 		//
@@ -32,4 +47,3 @@ main()
 		usleep(sleeptime);
 	}
 }
-
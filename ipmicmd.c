@@ -0,0 +1,474 @@
+/*
+ * ipmicmd.c - IPMI command layer shared by getInfoIPMI and the other
+ *	       tools that talk to the BMC through the ipmi_devintf driver.
+ *
+ * ipmicmd_mv opens the driver for each command, as getInfoIPMI has
+ * always done. Callers that send many commands, like the watchdog
+ * keepalive, open the driver once with ipmi_open and use ipmicmd_fd.
+ * Callers that want many commands in flight at once, like the shelf
+ * scan in getInfoIPMI, use ipmicmd_send and ipmicmd_recv and match the
+ * responses to their commands by msgid.
+ *
+ * Every open and ioctl on the driver goes through the macros of
+ * ipmifault.h, and with -DIPMI_FAULT ipmicmd_recv waits in
+ * ipmifault_wait rather than select, so such a build can delay, drop,
+ * cut short or fail the responses on a seeded schedule, or answer them
+ * from a simulated BMC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/ipmi.h>
+
+#include "ipmicmd.h"
+#include "ipmifault.h"
+#include "iptrace.h"
+
+// Global Variables
+int		Verbose;
+char		toolname[32];
+
+int
+setipmbaddr ( uchar ipmbaddr )
+{
+	int		rc;
+	int		fd;
+	struct ipmi_channel_lun_address_set	sChan;
+	TRACE_SCOPE(TP_SETIPMBADDR);
+
+	/*
+	 *  IPMI allows multiple IPMB channels on a single interface, and
+	 *  each channel might have a different IPMB address.  However, the
+	 *  driver has only one IPMB address that it uses for everything.
+	 *  This procedure adds new IOCTLS and a new internal interface for
+	 *  setting per-channel IPMB addresses and LUNs.
+	 */
+	// open IPMI driver
+	if ( (fd = IPMI_OPEN( IPMI_DRIVER, O_RDWR )) < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: No device %s or IPMI driver not loaded\n",
+			toolname,IPMI_DRIVER);
+		return -1;
+	}
+
+	// find what it was set to
+	sChan.channel = 0;
+	sChan.value   = 0;
+	rc = IPMI_IOCTL( fd, IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD, &sChan );
+	if ( rc < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD "
+			"ioctl_rc=%d errno=%d\n", toolname, rc, errno );
+		close( fd );
+		return -1;
+	}
+	if ( Verbose )
+	{
+		printf( "check default ADDRESS: channel = %d, addr = 0x%02X\n",
+			sChan.channel, sChan.value );
+	}
+
+	// set it to the new value
+	sChan.value = ipmbaddr;
+	rc = IPMI_IOCTL( fd, IPMICTL_SET_MY_CHANNEL_ADDRESS_CMD, &sChan );
+	if ( rc < 0 )
+	{
+		fprintf(stderr, "%s: Error: IPMICTL_SET_MY_CHANNEL_ADDRESS_CMD "
+			"ioctl_rc=%d errno=%d\n", toolname, rc, errno );
+		close( fd );
+		return -1;
+	}
+	if ( Verbose )
+	{
+		printf( "default ADDRESS changed channel = %d addr = 0x%02X\n",
+			sChan.channel, sChan.value );
+	}
+
+	// double check the setting
+	rc = IPMI_IOCTL( fd, IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD, &sChan );
+	if ( rc < 0 )
+	{
+		fprintf( stderr, "%s: Error: IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD"
+			" ioctl_rc=%d errno=%d\n", toolname, rc, errno );
+		close( fd );
+		return -1;
+	}
+	if ( Verbose )
+	{
+		printf( "new default ADDRESS: channel = %d, addr = 0x%02X\n",
+			sChan.channel, sChan.value );
+	}
+
+	if ( sChan.value != ipmbaddr )
+	{
+		fprintf( stderr, "%s: Error: Setting new address failed "
+			"value = 0x%02X addr = 0x%02X\n",
+			toolname, sChan.value, ipmbaddr );
+		close( fd );
+		return -1;
+	}
+
+	close( fd );
+	return 0;
+
+} // end of setipmbaddr()
+
+int
+ipmi_open ( void )
+{
+	int		ipmi_fd;
+
+	// open IPMI driver
+	if ( (ipmi_fd = IPMI_OPEN( IPMI_DRIVER, O_RDWR )) < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: No device %s or IPMI driver not loaded\n",
+			toolname, IPMI_DRIVER);
+		return -1;
+	}
+	return ipmi_fd;
+
+} // end of ipmi_open()
+
+static long	curr_seq = 0;
+
+long
+ipmicmd_send ( int ipmi_fd, int addr_type, uchar cmd, uchar netfn, uchar lun,
+	       uchar *pdata, uchar sdata )
+
+{
+	/*
+	 * 
+	 * It formats an IPMI command for the specified address type on
+	 * an already open IPMI driver and sends it to IPMI, without
+	 * waiting for the response. Returns the msgid the response will
+	 * carry, or -1.
+	 */
+
+	int		rv;
+
+	struct ipmi_req		req;
+	struct ipmi_ipmb_addr	ipmb_addr;
+	struct ipmi_system_interface_addr	bmc_addr;
+
+	/*
+	 *  Send the IPMI command 
+	 */
+	switch (addr_type) {
+	case IPMI_IPMB_ADDR_TYPE:
+		ipmb_addr.addr_type  = IPMI_IPMB_ADDR_TYPE;
+		ipmb_addr.slave_addr = IPMI_BMC_SLAVE_ADDR;
+		ipmb_addr.channel    = 0x00;
+		ipmb_addr.lun        = lun;
+		req.addr     = (unsigned char *) &ipmb_addr;
+		req.addr_len = sizeof(ipmb_addr);
+		break;
+
+	case IPMI_SYSTEM_INTERFACE_ADDR_TYPE:
+		bmc_addr.addr_type = IPMI_SYSTEM_INTERFACE_ADDR_TYPE;
+		bmc_addr.channel   = IPMI_BMC_CHANNEL;
+		bmc_addr.lun       = lun;	// BMC_LUN = 0
+		req.addr     = (unsigned char *) &bmc_addr;
+		req.addr_len = sizeof(bmc_addr);
+		break;
+
+	default:
+		fprintf( stderr, "%s: Error: Unknown addressing type %d\n",
+			toolname, addr_type );
+		return -1;
+	}
+
+	req.msg.cmd	 = cmd;
+	req.msg.netfn	 = netfn;
+	req.msgid	 = curr_seq++;
+	req.msg.data	 = pdata;
+	req.msg.data_len = sdata;
+	if ( (rv = IPMI_IOCTL( ipmi_fd, IPMICTL_SEND_COMMAND, &req )) < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: IPMICTL_SEND_COMMAND "
+			"ioctl_rc=%d errno=%d\n", toolname, rv, errno );
+		return -1;
+	}
+	return req.msgid;
+
+} // end of ipmicmd_send()
+
+int
+ipmicmd_recv ( int ipmi_fd, uchar *presp, int sresp, int *rlen, long *msgid,
+	       int timeout_ms )
+
+{
+	/*
+	 * 
+	 * It waits up to timeout_ms for the next response on the IPMI
+	 * driver, whichever command it answers, and puts it in presp
+	 * and its msgid in *msgid. Returns 0 with a response, 1 if none
+	 * came in time, or -1.
+	 */
+
+#ifndef IPMI_FAULT
+	fd_set		readfds;
+	struct timeval	tv;
+#endif
+	int		rv;
+
+	struct ipmi_recv	rsp;
+	struct ipmi_addr	addr;
+
+	*rlen = 0;
+
+#ifdef IPMI_FAULT
+	if ( ipmifault_wait( ipmi_fd, timeout_ms ) <= 0 )
+		return 1;
+#else
+	FD_ZERO( &readfds );
+	FD_SET( ipmi_fd, &readfds );
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	rv = select( ipmi_fd+1, &readfds, NULL, NULL, &tv );
+	if ( rv <= 0 || !FD_ISSET( ipmi_fd, &readfds ) )
+		return 1;
+#endif
+
+	/*
+	 *  Receive the IPMI response
+	 */
+	rsp.addr	 = (unsigned char *) &addr;
+	rsp.addr_len	 = sizeof(addr);
+	rsp.msg.data	 = presp;
+	rsp.msg.data_len = sresp;
+	if ( (rv = IPMI_IOCTL( ipmi_fd, IPMICTL_RECEIVE_MSG_TRUNC, &rsp )) < 0 )
+	{
+		fprintf( stderr,
+			"%s: Error: IPMICTL_RECEIVE_MSG_TRUNC "
+			"ioctl_rc=%d errno=%d\n", toolname, rv, errno );
+		return -1;
+	}
+
+	*msgid = rsp.msgid;
+	*rlen = rsp.msg.data_len;
+	return 0;
+
+} // end of ipmicmd_recv()
+
+int
+ipmicmd_fd ( int ipmi_fd, int addr_type, uchar cmd, uchar netfn, uchar lun,
+	     uchar *pdata, uchar sdata, uchar *presp, int sresp, int *rlen )
+
+{
+	/*
+	 * 
+	 * It formats an IPMI command for the specified address type on
+	 * an already open IPMI driver, and sends it to IPMI. It waits
+	 * for a response and then updates *presp with the results.
+	 *
+	 * A response left over from an earlier command that timed out
+	 * carries an older msgid, and is read and dropped so it can't
+	 * be taken for the answer to this one.
+	 */
+
+	long		msgid, rspid;
+	int		rv;
+
+	*rlen = 0;
+
+	if ( (msgid = ipmicmd_send( ipmi_fd, addr_type, cmd, netfn, lun,
+				    pdata, sdata )) < 0 )
+		return -1;
+
+	/*
+	 *  Wait for response
+	 */
+	int counter;
+	for ( counter = 0; counter < 3; )
+	{
+		rv = ipmicmd_recv( ipmi_fd, presp, sresp, rlen, &rspid, 2000 );
+		if ( rv < 0 )
+			return -1;
+		if ( rv > 0 )
+		{
+			counter++;
+			continue;
+		}
+
+		if ( rspid == msgid )
+			return 0;
+
+		*rlen = 0;
+		if ( Verbose )
+		{
+			fprintf( stderr, "%s: dropped stale response msgid %ld\n",
+				toolname, rspid );
+		}
+	}
+
+	if ( Verbose )
+	{
+		fprintf( stderr, "%s: Error: No response from IPMI\n",
+			toolname);
+	}
+	return -1;
+
+} // end of ipmicmd_fd()
+
+int
+ipmicmd_mv ( int addr_type, uchar cmd, uchar netfn, uchar lun,
+	     uchar *pdata, uchar sdata, uchar *presp, int sresp, int *rlen )
+
+{
+	/*
+	 * 
+	 * It opens the IPMI driver, sends one command with ipmicmd_fd
+	 * and closes the driver again.
+	 */
+
+	int		ipmi_fd;
+	int		rc;
+	TRACE_SCOPE(TP_IPMICMD);
+
+	*rlen = 0;
+
+	if ( (ipmi_fd = ipmi_open()) < 0 )
+		return -1;
+
+	rc = ipmicmd_fd( ipmi_fd, addr_type, cmd, netfn, lun,
+			 pdata, sdata, presp, sresp, rlen );
+
+	close( ipmi_fd );
+	return rc;
+
+} // end of ipmicmd_mv()
+
+/*
+ * Command descriptors, see ipmicmd.h
+ */
+const IpmiCmdDesc ipmi_get_device_id = {
+	"get device Id", 0x06, 0x01,
+	0, 0, sizeof(IpmiDeviceIdRsp) };
+const IpmiCmdDesc ipmi_get_global_enables = {
+	"get BMC global enable", 0x06, 0x2f,
+	0, 0, sizeof(IpmiGlobalEnablesRsp) };
+const IpmiCmdDesc ipmi_set_global_enables = {
+	"set BMC global enable", 0x06, 0x2e,
+	sizeof(IpmiGlobalEnablesReq), sizeof(IpmiGlobalEnablesReq),
+	sizeof(IpmiCcRsp) };
+const IpmiCmdDesc picmg_get_address_info = {
+	"get address info", 0x2c, 0x01,
+	1, sizeof(PicmgAddrInfoReq), sizeof(PicmgAddrInfoRsp) };
+const IpmiCmdDesc picmg_get_shelf_address_info = {
+	"get chassis number", 0x2c, 0x02,
+	sizeof(PicmgShelfAddrReq), sizeof(PicmgShelfAddrReq),
+	sizeof(PicmgShelfAddrRsp) };
+const IpmiCmdDesc ipmi_get_fru_area_info = {
+	"get FRU inventory area info", 0x0a, 0x10,
+	sizeof(IpmiFruAreaInfoReq), sizeof(IpmiFruAreaInfoReq),
+	sizeof(IpmiFruAreaInfoRsp) };
+const IpmiCmdDesc ipmi_read_fru_data = {
+	"read FRU data", 0x0a, 0x11,
+	sizeof(IpmiReadFruReq), sizeof(IpmiReadFruReq),
+	sizeof(IpmiReadFruRsp) };
+const IpmiCmdDesc dcmi_get_power_reading = {
+	"get power reading", 0x2c, 0x02,
+	sizeof(DcmiPowerReadingReq), sizeof(DcmiPowerReadingReq),
+	sizeof(DcmiPowerReadingRsp) };
+
+const void *
+ipmicmd_view ( const IpmiCmdDesc *desc, const uchar *presp, int rlen )
+{
+	/*
+	 * 
+	 * It returns presp as the response struct of desc if the
+	 * command succeeded and the response holds all of it, else NULL.
+	 */
+
+	if ( rlen < 1 || presp[0] != 0 || rlen < desc->minrsp )
+		return NULL;
+	return presp;
+
+} // end of ipmicmd_view()
+
+const void *
+ipmicmd_check ( const IpmiCmdDesc *desc, int rc, const uchar *presp,
+		int rlen )
+{
+	/*
+	 * 
+	 * ipmicmd_view for a command that returned rc, saying what was
+	 * wrong if there is no view.
+	 */
+
+	return ipmicmd_check_min( desc, rc, presp, rlen, desc->minrsp );
+
+} // end of ipmicmd_check()
+
+const void *
+ipmicmd_check_min ( const IpmiCmdDesc *desc, int rc, const uchar *presp,
+		    int rlen, int minrsp )
+{
+	/*
+	 * 
+	 * ipmicmd_check for a caller that needs only the first minrsp
+	 * bytes of the response and copes with the rest being missing.
+	 */
+
+	if ( rc < 0 || rlen < 1 )
+	{
+		fprintf( stderr, "%s: Error: in ipmicmd %s, rc=%d, rlen=%d\n",
+			toolname, desc->name, rc, rlen );
+		return NULL;
+	}
+	if ( presp[0] != 0 )
+	{
+		fprintf( stderr, "%s: Error: in %s, completion code 0x%2.2X\n",
+			toolname, desc->name, presp[0] );
+		return NULL;
+	}
+	if ( rlen < minrsp )
+	{
+		fprintf( stderr, "%s: Error: in %s, response %d bytes, "
+			"expected %d\n", toolname, desc->name, rlen,
+			minrsp );
+		return NULL;
+	}
+	return presp;
+
+} // end of ipmicmd_check_min()
+
+const void *
+ipmicmd_call ( const IpmiCmdDesc *desc, int addr_type, const void *pdata,
+	       int sdata, uchar *presp, int sresp, int *rlen )
+{
+	/*
+	 * 
+	 * It sends the command desc describes with ipmicmd_mv and
+	 * returns the view of its response from ipmicmd_check.
+	 */
+
+	int		rc;
+
+	*rlen = 0;
+
+	if ( sdata < desc->minreq || sdata > desc->maxreq
+	     || sresp < desc->minrsp )
+	{
+		fprintf( stderr, "%s: Error: bad request for %s\n",
+			toolname, desc->name );
+		return NULL;
+	}
+
+	rc = ipmicmd_mv( addr_type, desc->cmd, desc->netfn, 0,
+			 (uchar *)pdata, sdata, presp, sresp, rlen );
+	return ipmicmd_check( desc, rc, presp, *rlen );
+
+} // end of ipmicmd_call()
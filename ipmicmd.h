@@ -0,0 +1,200 @@
+/*
+ * ipmicmd.h - IPMI command layer shared by getInfoIPMI and the other
+ *	       tools that talk to the BMC through the ipmi_devintf driver.
+ */
+
+#ifndef IPMICMD_H
+#define IPMICMD_H
+
+#include <linux/ipmi.h>
+
+#define uchar		unsigned char
+#define IPMI_DRIVER	"/dev/ipmi0"
+
+// Global Variables
+extern int	Verbose;
+extern char	toolname[32];
+
+int ipmi_open ( void );
+long ipmicmd_send ( int ipmi_fd, int addr_type, uchar cmd, uchar netfn,
+		    uchar lun, uchar *pdata, uchar sdata );
+int ipmicmd_recv ( int ipmi_fd, uchar *presp, int sresp, int *rlen,
+		   long *msgid, int timeout_ms );
+int ipmicmd_fd ( int ipmi_fd, int addr_type, uchar cmd, uchar netfn,
+		 uchar lun, uchar *pdata, uchar sdata, uchar *presp,
+		 int sresp, int *rlen );
+int ipmicmd_mv ( int addr_type, uchar cmd, uchar netfn, uchar lun,
+		 uchar *pdata, uchar sdata, uchar *presp, int sresp,
+		 int *rlen );
+int setipmbaddr ( uchar ipmbaddr );
+
+/*
+ * Command descriptors
+ *
+ * An IpmiCmdDesc names a command and the request and response lengths
+ * it needs, the response length being that of the packed struct that
+ * lays the response out, completion code included. ipmicmd_call sends
+ * the command and returns the response buffer itself as a view of
+ * that struct, or NULL, after printing why, if the command failed, the
+ * completion code was not 0 or the response was too short to hold the
+ * struct. So a caller can use every field of the view without checking
+ * anything.
+ *
+ *	const IpmiDeviceIdRsp	*id;
+ *
+ *	id = ipmicmd_call( &ipmi_get_device_id, IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+ *			   NULL, 0, rsp_data, sizeof(rsp_data), &rlen );
+ *	if ( id == NULL )
+ *		return -1;
+ */
+typedef struct {
+	const char	*name;		// for the error messages
+	uchar		netfn;
+	uchar		cmd;
+	uchar		minreq;		// request data bytes
+	uchar		maxreq;
+	uchar		minrsp;		// response bytes, cc included
+} IpmiCmdDesc;
+
+typedef struct {
+	uchar	cc;
+} __attribute__((packed)) IpmiCcRsp;
+
+/* App: Get Device ID */
+typedef struct {
+	uchar	cc;
+	uchar	device_id;
+	uchar	device_rev;	// 3:0 revision
+	uchar	fw_major;	// 6:0
+	uchar	fw_minor;	// BCD
+	uchar	ipmi_version;	// BCD, minor in 7:4
+} __attribute__((packed)) IpmiDeviceIdRsp;
+
+/* App: Get/Set BMC Global Enables */
+typedef struct {
+	uchar	enables;
+} __attribute__((packed)) IpmiGlobalEnablesReq;
+
+typedef struct {
+	uchar	cc;
+	uchar	enables;
+} __attribute__((packed)) IpmiGlobalEnablesRsp;
+
+#define IPMI_ENABLE_RCV_MSG_INTR	0x01
+
+/* PICMG: Get Address Info */
+typedef struct {
+	uchar	picmg_id;
+	uchar	fru_id;
+	uchar	key_type;	// PICMG_KEY_*
+	uchar	key;
+} __attribute__((packed)) PicmgAddrInfoReq;
+
+#define PICMG_KEY_HWADDR	0
+#define PICMG_KEY_IPMB0		1
+
+typedef struct {
+	uchar	cc;
+	uchar	picmg_id;
+	uchar	hwaddr;
+	uchar	ipmbaddr;
+	uchar	reserved;	// 0xff
+	uchar	fru_id;
+	uchar	site_number;	// 3:0 physical slot
+	uchar	site_type;
+} __attribute__((packed)) PicmgAddrInfoRsp;
+
+/* PICMG: Get Shelf Address Info */
+typedef struct {
+	uchar	picmg_id;
+} __attribute__((packed)) PicmgShelfAddrReq;
+
+typedef struct {
+	uchar	cc;
+	uchar	picmg_id;
+	uchar	typelen;	// shelf address type/length byte
+	uchar	addr[5];	// 0: 3:0 chassis, 4: 3:0 cabinet
+} __attribute__((packed)) PicmgShelfAddrRsp;
+
+/* Storage: Get FRU Inventory Area Info */
+typedef struct {
+	uchar	fru_id;
+} __attribute__((packed)) IpmiFruAreaInfoReq;
+
+typedef struct {
+	uchar	cc;
+	uchar	size_lsb;
+	uchar	size_msb;
+	uchar	access;		// bit 0: accessed by words
+} __attribute__((packed)) IpmiFruAreaInfoRsp;
+
+/* Storage: Read FRU Data, count bytes (or words) follow the header */
+typedef struct {
+	uchar	fru_id;
+	uchar	off_lsb;
+	uchar	off_msb;
+	uchar	count;
+} __attribute__((packed)) IpmiReadFruReq;
+
+typedef struct {
+	uchar	cc;
+	uchar	count;
+	uchar	data[];
+} __attribute__((packed)) IpmiReadFruRsp;
+
+/* DCMI: Get Power Reading */
+typedef struct {
+	uchar	group_id;	// DCMI_GROUP_ID
+	uchar	mode;		// DCMI_POWER_SYSTEM
+	uchar	mode_attr;
+	uchar	reserved;
+} __attribute__((packed)) DcmiPowerReadingReq;
+
+#define DCMI_GROUP_ID		0xdc
+#define DCMI_POWER_SYSTEM	0x01	// system power statistics
+#define DCMI_POWER_ACTIVE	0x40	// state: measurement active
+
+typedef struct {
+	uchar	cc;
+	uchar	group_id;
+	uchar	current[2];	// watts, little endian
+	uchar	minimum[2];
+	uchar	maximum[2];
+	uchar	average[2];
+	uchar	timestamp[4];	// BMC time, seconds
+	uchar	period[4];	// statistics period, ms
+	uchar	state;
+} __attribute__((packed)) DcmiPowerReadingRsp;
+
+#define IPMI_LE16( p )	( (p)[0] | (p)[1] << 8 )
+#define IPMI_LE32( p )	( (p)[0] | (p)[1] << 8 | (p)[2] << 16 \
+			  | (unsigned)(p)[3] << 24 )
+
+_Static_assert( sizeof(IpmiDeviceIdRsp) == 6, "Get Device ID layout" );
+_Static_assert( sizeof(DcmiPowerReadingRsp) == 19, "Get Power Reading layout" );
+_Static_assert( sizeof(IpmiFruAreaInfoRsp) == 4, "Get FRU Inventory Area Info layout" );
+_Static_assert( sizeof(IpmiReadFruRsp) == 2, "Read FRU Data layout" );
+_Static_assert( sizeof(PicmgAddrInfoReq) == 4, "Get Address Info layout" );
+_Static_assert( sizeof(PicmgAddrInfoRsp) == 8, "Get Address Info layout" );
+_Static_assert( sizeof(PicmgShelfAddrRsp) == 8, "Get Shelf Address Info layout" );
+
+extern const IpmiCmdDesc	ipmi_get_device_id;
+extern const IpmiCmdDesc	ipmi_get_global_enables;
+extern const IpmiCmdDesc	ipmi_set_global_enables;
+extern const IpmiCmdDesc	picmg_get_address_info;
+extern const IpmiCmdDesc	picmg_get_shelf_address_info;
+extern const IpmiCmdDesc	ipmi_get_fru_area_info;
+extern const IpmiCmdDesc	ipmi_read_fru_data;
+extern const IpmiCmdDesc	dcmi_get_power_reading;
+
+const void *ipmicmd_view ( const IpmiCmdDesc *desc, const uchar *presp,
+			   int rlen );
+const void *ipmicmd_check ( const IpmiCmdDesc *desc, int rc,
+			    const uchar *presp, int rlen );
+const void *ipmicmd_check_min ( const IpmiCmdDesc *desc, int rc,
+				const uchar *presp, int rlen, int minrsp );
+const void *ipmicmd_call ( const IpmiCmdDesc *desc, int addr_type,
+			   const void *pdata, int sdata, uchar *presp,
+			   int sresp, int *rlen );
+
+#endif // IPMICMD_H
@@ -0,0 +1,548 @@
+/*
+ * ipmifault.c - fault and latency injection, see ipmifault.h
+ *
+ * Everything here is under IPMI_FAULT; without it this file is empty.
+ *
+ * Responses are not handed to the caller as the driver delivers them
+ * but queued here, each with the time it may be delivered, so a delay
+ * holds one response without holding up the others behind it, as a
+ * slow IPMB target does. ipmifault_wait is what moves responses from
+ * the driver, or from the simulated BMC, into the queue.
+ */
+
+#include "ipmifault.h"
+
+#ifdef IPMI_FAULT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <linux/ipmi.h>
+
+#include "ipmicmd.h"
+
+#define FAULT_FDS	64	/* descriptors tracked, higher ones pass */
+#define FAULT_QUEUE	32	/* responses held per descriptor */
+#define FAULT_PENDING	64	/* faults drawn for commands in flight */
+
+struct fault_draw {
+	long		msgid;
+	int		drop;
+	int		delay_ms;
+	unsigned	trunc;		/* 0, or where to cut */
+	int		cc;		/* 0, or the completion code */
+};
+
+struct fault_rsp {
+	long		msgid;
+	int64_t		ready_ms;
+	int		recv_type;
+	struct ipmi_addr addr;
+	int		addr_len;
+	uchar		netfn;
+	uchar		cmd;
+	int		len;
+	uchar		data[IPMI_MAX_MSG_LENGTH];
+};
+
+struct fault_fd {
+	int		open;
+	int		nq;
+	struct fault_rsp q[FAULT_QUEUE];
+	struct fault_draw pend[FAULT_PENDING];	/* by msgid */
+};
+
+static struct {
+	int		inited;
+	uint64_t	seed, rng;
+	int		delay_p, delay_min, delay_max;
+	int		drop_p, trunc_p, cc, cc_p, busy;
+	int		sim, lat, slot, report;
+
+	uchar		enables;	/* simulated BMC state */
+	uchar		ipmbaddr;
+
+	uint64_t	commands, delayed, dropped, truncated, cced;
+} F;
+
+static struct fault_fd fds[ FAULT_FDS ];
+
+/* physical slot of each logical slot of the shelf, as conv_slot */
+static const uchar shelf_site[ 15 ] = { 0, 7, 8, 6, 9, 5, 10, 4,
+					11, 3, 12, 2, 13, 1, 14 };
+
+static int64_t
+now_ms ( void )
+{
+	struct timespec	ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* xorshift64* */
+static uint64_t
+rnd ( void )
+{
+	F.rng ^= F.rng >> 12;
+	F.rng ^= F.rng << 25;
+	F.rng ^= F.rng >> 27;
+	return F.rng * 0x2545F4914F6CDD1DULL;
+}
+
+static void
+fault_report ( void )
+{
+	fprintf( stderr, "ipmifault: seed %llu: %llu commands, %llu delayed, "
+		 "%llu dropped, %llu truncated, %llu completion codes\n",
+		 (unsigned long long)F.seed, (unsigned long long)F.commands,
+		 (unsigned long long)F.delayed, (unsigned long long)F.dropped,
+		 (unsigned long long)F.truncated, (unsigned long long)F.cced );
+}
+
+static void
+fault_init ( void )
+{
+	char		*spec, *tok, *save, *val;
+
+	if ( F.inited )
+		return;
+	F.inited = 1;
+	F.seed = 1;
+	F.lat = 1;
+	F.slot = 5;
+	F.enables = 0;		// so getInfoIPMI sets them
+	F.ipmbaddr = IPMI_BMC_SLAVE_ADDR;
+
+	if ( getenv( "IPMI_FAULT" ) == NULL
+	     || (spec = strdup( getenv( "IPMI_FAULT" ) )) == NULL )
+		goto seed;
+
+	for ( tok = strtok_r( spec, ",", &save ); tok;
+	      tok = strtok_r( NULL, ",", &save ) )
+	{
+		if ( (val = strchr( tok, '=' )) != NULL )
+			*val++ = '\0';
+
+		if ( !strcmp( tok, "sim" ) )
+			F.sim = 1;
+		else if ( !strcmp( tok, "report" ) )
+			F.report = 1;
+		else if ( val == NULL )
+			goto bad;
+		else if ( !strcmp( tok, "seed" ) )
+			F.seed = strtoull( val, NULL, 0 );
+		else if ( !strcmp( tok, "drop" ) )
+			F.drop_p = atoi( val );
+		else if ( !strcmp( tok, "trunc" ) )
+			F.trunc_p = atoi( val );
+		else if ( !strcmp( tok, "busy" ) )
+			F.busy = atoi( val );
+		else if ( !strcmp( tok, "lat" ) )
+			F.lat = atoi( val );
+		else if ( !strcmp( tok, "slot" ) )
+			F.slot = atoi( val );
+		else if ( !strcmp( tok, "cc" ) )
+		{
+			if ( sscanf( val, "%x:%d", &F.cc, &F.cc_p ) != 2 )
+				goto bad;
+		}
+		else if ( !strcmp( tok, "delay" ) )
+		{
+			int n = sscanf( val, "%d:%d-%d", &F.delay_p,
+					&F.delay_min, &F.delay_max );
+			if ( n < 2 )
+				goto bad;
+			if ( n == 2 || F.delay_max < F.delay_min )
+				F.delay_max = F.delay_min;
+		}
+		else
+			goto bad;
+		continue;
+bad:
+		fprintf( stderr, "%s: IPMI_FAULT: ignoring '%s'\n",
+			 toolname, tok );
+	}
+	free( spec );
+
+	if ( F.slot < 1 || F.slot > 14 )
+		F.slot = 5;
+seed:
+	// xorshift must not start at 0
+	F.rng = F.seed * 0x9E3779B97F4A7C15ULL | 1;
+	if ( F.report )
+		atexit( fault_report );
+
+} // end of fault_init()
+
+/*
+ * Draw the faults of the next command: always four draws, so what one
+ * command gets doesn't depend on what the schedule asked of earlier
+ * ones.
+ */
+static void
+fault_draw ( struct fault_draw *d, long msgid )
+{
+	uint64_t	u;
+
+	memset( d, 0, sizeof(*d) );
+	d->msgid = msgid;
+
+	d->drop = (int)(rnd() % 100) < F.drop_p;
+
+	u = rnd();
+	if ( (int)(u % 100) < F.delay_p )
+		d->delay_ms = F.delay_min
+			+ (u >> 32) % (F.delay_max - F.delay_min + 1);
+
+	u = rnd();
+	if ( (int)(u % 100) < F.trunc_p )
+		d->trunc = (unsigned)(u >> 32) | 1;
+
+	if ( (int)(rnd() % 100) < F.cc_p )
+		d->cc = F.cc;
+	if ( F.commands < (uint64_t)F.busy )
+		d->cc = 0xC0;
+	F.commands++;
+}
+
+/*
+ * Apply drawn faults to a response and queue it. A completion code
+ * replaces the response, a cut keeps the completion code and part of
+ * the data.
+ */
+static void
+fault_queue ( struct fault_fd *f, const struct fault_draw *d,
+	      struct fault_rsp *r, int lat_ms )
+{
+	if ( d->drop )
+	{
+		F.dropped++;
+		return;
+	}
+	if ( f->nq == FAULT_QUEUE )
+		return;		// as the driver does when its queue is full
+
+	if ( d->cc )
+	{
+		r->data[0] = d->cc;
+		r->len = 1;
+		F.cced++;
+	}
+	else if ( d->trunc && r->len > 1 )
+	{
+		r->len = 1 + d->trunc % (r->len - 1);
+		F.truncated++;
+	}
+	if ( d->delay_ms )
+		F.delayed++;
+
+	r->ready_ms = now_ms() + lat_ms + d->delay_ms;
+	f->q[ f->nq++ ] = *r;
+}
+
+/*
+ * The simulated BMC: an ATCA blade at logical slot F.slot of a 14 slot
+ * shelf with every slot filled, chassis 2 of cabinet 3.
+ */
+static void
+sim_bmc ( const struct ipmi_req *req, struct fault_rsp *r )
+{
+	const uchar	*d = req->msg.data;
+	int		n = req->msg.data_len;
+	int		hw;
+	uchar		*p = r->data;
+
+	static const uchar devid[] = { 0x00, 0x20, 0x81, 0x02, 0x10, 0x51,
+				       0x02, 0xbf, 0x57, 0x01, 0x00, 0x00,
+				       0x00 };
+
+	p[0] = 0xC1;	// invalid command
+	r->len = 1;
+
+	switch ( req->msg.netfn << 8 | req->msg.cmd ) {
+	case 0x0601:	// Get Device ID
+		memcpy( p, devid, sizeof(devid) );
+		r->len = sizeof(devid);
+		break;
+
+	case 0x062f:	// Get BMC Global Enables
+		p[0] = 0;
+		p[1] = F.enables;
+		r->len = 2;
+		break;
+
+	case 0x062e:	// Set BMC Global Enables
+		p[0] = n < 1 ? 0xC7 : 0;
+		if ( n >= 1 )
+			F.enables = d[0];
+		break;
+
+	case 0x2c01:	// PICMG Get Address Info
+		if ( n < 3 )
+			hw = 0x40 | F.slot;
+		else if ( d[2] == PICMG_KEY_HWADDR && n >= 4 )
+			hw = d[3];
+		else if ( d[2] == PICMG_KEY_IPMB0 && n >= 4 )
+			hw = d[3] >> 1;
+		else
+		{
+			p[0] = 0xCC;
+			break;
+		}
+		if ( (hw & 0xf0) != 0x40 || (hw & 0x0f) == 0
+		     || (hw & 0x0f) > 14 )
+		{
+			p[0] = 0xCB;	// nothing there
+			break;
+		}
+		p[0] = 0;
+		p[1] = 0;
+		p[2] = hw;
+		p[3] = hw << 1;
+		p[4] = 0xff;
+		p[5] = 0;
+		p[6] = shelf_site[ hw & 0x0f ];
+		p[7] = 0;	// front board
+		r->len = 8;
+		break;
+
+	case 0x2c02:	// PICMG Get Shelf Address Info
+		p[0] = 0;
+		p[1] = 0;
+		p[2] = 0xc5;
+		p[3] = 2;
+		p[4] = p[5] = p[6] = 0;
+		p[7] = 3;
+		r->len = 8;
+		break;
+	}
+}
+
+int
+ipmifault_sim ( void )
+{
+	fault_init();
+	return F.sim;
+}
+
+int
+ipmifault_open ( const char *path, int flags )
+{
+	int		fd;
+
+	fault_init();
+
+	// the simulated BMC still needs a descriptor to close
+	fd = open( F.sim ? "/dev/null" : path, flags );
+	if ( fd >= 0 && fd < FAULT_FDS )
+	{
+		memset( &fds[fd], 0, sizeof(fds[fd]) );
+		fds[fd].open = 1;
+	}
+	return fd;
+}
+
+/*
+ * Move what the driver has for fd into the queue, with the faults
+ * drawn when its command was sent.
+ */
+static int
+fault_pull ( int fd )
+{
+	struct fault_fd		*f = &fds[fd];
+	struct fault_rsp	r;
+	struct fault_draw	none, *d;
+	struct ipmi_recv	rsp;
+
+	memset( &r, 0, sizeof(r) );
+	rsp.addr	 = (unsigned char *) &r.addr;
+	rsp.addr_len	 = sizeof(r.addr);
+	rsp.msg.data	 = r.data;
+	rsp.msg.data_len = sizeof(r.data);
+	if ( ioctl( fd, IPMICTL_RECEIVE_MSG_TRUNC, &rsp ) < 0 )
+		return -1;
+
+	r.msgid = rsp.msgid;
+	r.recv_type = rsp.recv_type;
+	r.addr_len = rsp.addr_len;
+	r.netfn = rsp.msg.netfn;
+	r.cmd = rsp.msg.cmd;
+	r.len = rsp.msg.data_len;
+
+	d = &f->pend[ (unsigned long)r.msgid % FAULT_PENDING ];
+	if ( rsp.recv_type != IPMI_RESPONSE_RECV_TYPE || d->msgid != r.msgid )
+	{
+		memset( &none, 0, sizeof(none) );
+		d = &none;
+	}
+	fault_queue( f, d, &r, 0 );
+	d->msgid = -1;
+	return 0;
+}
+
+int
+ipmifault_wait ( int fd, int timeout_ms )
+{
+	struct fault_fd	*f;
+	int64_t		deadline, t, next;
+	fd_set		readfds;
+	struct timeval	tv;
+	int		i, rv;
+
+	deadline = now_ms() + timeout_ms;
+
+	for ( ;; )
+	{
+		if ( fd < 0 || fd >= FAULT_FDS || !fds[fd].open )
+			next = INT64_MAX;
+		else
+		{
+			f = &fds[fd];
+			next = INT64_MAX;
+			for ( i = 0; i < f->nq; i++ )
+				if ( f->q[i].ready_ms < next )
+					next = f->q[i].ready_ms;
+		}
+
+		t = now_ms();
+		if ( next <= t )
+			return 1;
+		if ( t >= deadline )
+			return 0;
+		if ( next > deadline )
+			next = deadline;
+
+		if ( F.sim )
+		{
+			struct timespec ts = { (next - t) / 1000,
+					       (next - t) % 1000 * 1000000 };
+			nanosleep( &ts, NULL );
+			continue;
+		}
+
+		FD_ZERO( &readfds );
+		FD_SET( fd, &readfds );
+		tv.tv_sec = (next - t) / 1000;
+		tv.tv_usec = (next - t) % 1000 * 1000;
+		rv = select( fd+1, &readfds, NULL, NULL, &tv );
+		if ( rv < 0 )
+			return -1;
+		if ( rv == 0 )
+			continue;
+		if ( fd >= FAULT_FDS || !fds[fd].open )
+			return 1;	// not ours, as select says
+		if ( fault_pull( fd ) < 0 )
+			return -1;
+	}
+}
+
+int
+ipmifault_ioctl ( int fd, unsigned long req, void *arg )
+{
+	struct fault_fd		*f;
+	struct fault_draw	d;
+	struct fault_rsp	r;
+	int			i, best, n, rv;
+
+	if ( fd < 0 || fd >= FAULT_FDS || !fds[fd].open )
+		return ioctl( fd, req, arg );
+	f = &fds[fd];
+
+	switch ( req ) {
+	case IPMICTL_SEND_COMMAND:
+	{
+		struct ipmi_req	*rq = arg;
+
+		fault_draw( &d, rq->msgid );
+		if ( !F.sim )
+		{
+			if ( (rv = ioctl( fd, req, arg )) == 0 )
+				f->pend[ (unsigned long)rq->msgid
+					 % FAULT_PENDING ] = d;
+			return rv;
+		}
+
+		memset( &r, 0, sizeof(r) );
+		r.msgid = rq->msgid;
+		r.recv_type = IPMI_RESPONSE_RECV_TYPE;
+		r.addr_len = rq->addr_len < (int)sizeof(r.addr)
+			     ? rq->addr_len : (int)sizeof(r.addr);
+		memcpy( &r.addr, rq->addr, r.addr_len );
+		r.netfn = rq->msg.netfn | 1;
+		r.cmd = rq->msg.cmd;
+		sim_bmc( rq, &r );
+		fault_queue( f, &d, &r, F.lat );
+		return 0;
+	}
+
+	case IPMICTL_RECEIVE_MSG_TRUNC:
+	case IPMICTL_RECEIVE_MSG:
+	{
+		struct ipmi_recv *rs = arg;
+		int64_t	t = now_ms();
+
+		for ( best = -1, i = 0; i < f->nq; i++ )
+			if ( f->q[i].ready_ms <= t && (best < 0
+			     || f->q[i].ready_ms < f->q[best].ready_ms) )
+				best = i;
+		if ( best < 0 )
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+
+		r = f->q[best];
+		memmove( &f->q[best], &f->q[best+1],
+			 (f->nq - best - 1) * sizeof(f->q[0]) );
+		f->nq--;
+
+		rs->recv_type = r.recv_type;
+		rs->msgid = r.msgid;
+		if ( rs->addr_len > (unsigned)r.addr_len )
+			rs->addr_len = r.addr_len;
+		memcpy( rs->addr, &r.addr, rs->addr_len );
+		rs->msg.netfn = r.netfn;
+		rs->msg.cmd = r.cmd;
+		n = r.len < rs->msg.data_len ? r.len : rs->msg.data_len;
+		memcpy( rs->msg.data, r.data, n );
+		rs->msg.data_len = n;
+		if ( n < r.len )
+		{
+			errno = EMSGSIZE;
+			return -1;
+		}
+		return 0;
+	}
+
+	case IPMICTL_SET_MY_CHANNEL_ADDRESS_CMD:
+		if ( F.sim )
+		{
+			F.ipmbaddr = ((struct ipmi_channel_lun_address_set *)
+				      arg)->value;
+			return 0;
+		}
+		break;
+
+	case IPMICTL_GET_MY_CHANNEL_ADDRESS_CMD:
+		if ( F.sim )
+		{
+			((struct ipmi_channel_lun_address_set *)arg)->value =
+				F.ipmbaddr;
+			return 0;
+		}
+		break;
+	}
+
+	return F.sim ? 0 : ioctl( fd, req, arg );
+
+} // end of ipmifault_ioctl()
+
+#endif /* IPMI_FAULT */
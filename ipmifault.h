@@ -0,0 +1,59 @@
+/*
+ * ipmifault.h - deterministic fault and latency injection between the
+ *		 IPMI command layer and the ipmi_devintf driver.
+ *
+ * Built with -DIPMI_FAULT, ipmicmd.c opens the driver, issues its
+ * ioctls and waits for responses through this layer, which applies a
+ * schedule read from the IPMI_FAULT environment variable, a comma
+ * separated list of
+ *
+ *	seed=N		seed of the schedule, default 1
+ *	delay=P:MS[-MS]	hold P% of the responses MS ms, or a uniformly
+ *			drawn time in the range
+ *	drop=P		never deliver P% of the responses
+ *	trunc=P		cut P% of the responses short
+ *	cc=XX:P		answer P% of the commands with completion code
+ *			XX (hex) and no data
+ *	busy=N		answer the first N commands 0xC0, node busy, as
+ *			a BMC still starting up does
+ *	sim		answer from a simulated BMC instead of the
+ *			driver: an ATCA blade in a 14 slot dual star
+ *			shelf, enough for getInfoIPMI
+ *	lat=MS		the simulated BMC's own response time, default 1
+ *	slot=N		its logical slot, default 5
+ *	report		print the faults injected on stderr at exit
+ *
+ * Every command draws its faults from a xorshift generator seeded with
+ * seed, the same number of draws whatever the schedule, so a seed
+ * replays the same faults on the same sequence of commands.
+ *
+ * IPMI_SIM() is true when the simulated BMC answers, for state kept
+ * outside the driver that must not mix with a real shelf's.
+ *
+ * Without IPMI_FAULT the macros are the plain system calls and
+ * ipmifault.c is empty.
+ */
+
+#ifndef IPMIFAULT_H
+#define IPMIFAULT_H
+
+#ifdef IPMI_FAULT
+
+int ipmifault_open ( const char *path, int flags );
+int ipmifault_ioctl ( int fd, unsigned long req, void *arg );
+int ipmifault_wait ( int fd, int timeout_ms );
+int ipmifault_sim ( void );
+
+#define IPMI_OPEN( path, flags )	ipmifault_open( path, flags )
+#define IPMI_IOCTL( fd, req, arg )	ipmifault_ioctl( fd, req, arg )
+#define IPMI_SIM()			ipmifault_sim()
+
+#else /* !IPMI_FAULT */
+
+#define IPMI_OPEN( path, flags )	open( path, flags )
+#define IPMI_IOCTL( fd, req, arg )	ioctl( fd, req, arg )
+#define IPMI_SIM()			0
+
+#endif /* IPMI_FAULT */
+
+#endif /* IPMIFAULT_H */
@@ -0,0 +1,410 @@
+/*
+ * ipmifru.c - board, product and chassis inventory from a FRU device,
+ *	       see ipmifru.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/ipmi.h>
+
+#include "ipmicmd.h"
+#include "ipmifru.h"
+
+#define CC_BAD_LENGTH		0xc7	/* request data length invalid */
+#define CC_CANT_RETURN		0xca	/* fewer bytes, please */
+#define FRU_MAXCHUNK		224	/* first Read FRU Data count tried */
+#define FRU_HEADER		8
+#define FRU_END_OF_FIELDS	0xc1
+#define FRU_TIME_BASE		820454400	/* 1996-01-01 00:00 UTC */
+
+#define CACHE_MAGIC		"FRU1"
+
+struct fru_cache {
+	char		magic[4];
+	uint16_t	size;
+	uint8_t		access;
+	uint8_t		chunk;
+};
+
+/* common header bytes holding each area's offset in 8-byte units */
+static const struct {
+	int		hdr;
+	int		area;
+} areas[] = {
+	{ 2, FRU_CHASSIS },
+	{ 3, FRU_BOARD },
+	{ 4, FRU_PRODUCT },
+};
+
+#define NAREAS	(int)(sizeof(areas) / sizeof(areas[0]))
+
+static int checksum(const uint8_t *p, int n)
+{
+	uint8_t sum = 0;
+
+	while (n--)
+		sum += *p++;
+	return sum;
+}
+
+/*
+ * Read bytes off to off + cnt of the device into img at the same
+ * offsets, *chunk bytes at a time, halving *chunk whenever the BMC
+ * says it is too many. A device accessed by words is read whole words
+ * around the range. Returns 0, or -1.
+ */
+static int read_span(int fruid, int words, uint8_t *img, int size,
+		     int off, int cnt, int *chunk)
+{
+	uchar rsp[sizeof(IpmiReadFruRsp) + FRU_MAXCHUNK];
+	IpmiReadFruReq req;
+	const IpmiReadFruRsp *v;
+	int end = off + cnt;
+	int rc, rlen, n, got;
+
+	if (words) {
+		off &= ~1;
+		end = (end + 1) & ~1;
+	}
+	if (off < 0 || end > size)
+		return -1;
+
+	while (off < end) {
+		n = end - off < *chunk ? end - off : *chunk;
+		if (words)
+			n &= ~1;
+
+		req.fru_id = fruid;
+		req.off_lsb = (off >> words) & 0xff;
+		req.off_msb = (off >> words) >> 8;
+		req.count = n >> words;
+		rc = ipmicmd_mv(IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+				ipmi_read_fru_data.cmd, ipmi_read_fru_data.netfn,
+				0, (uchar *)&req, sizeof(req), rsp, sizeof(rsp),
+				&rlen);
+		if (rc == 0 && rlen >= 1 && *chunk >= 4 &&
+		    (rsp[0] == CC_BAD_LENGTH || rsp[0] == CC_CANT_RETURN)) {
+			*chunk /= 2;
+			if (Verbose)
+				printf("FRU %d: chunk down to %d\n", fruid,
+				       *chunk);
+			continue;
+		}
+		v = ipmicmd_check(&ipmi_read_fru_data, rc, rsp, rlen);
+		if (v == NULL)
+			return -1;
+
+		got = v->count << words;
+		if (got > rlen - (int)sizeof(*v))
+			got = rlen - (int)sizeof(*v);
+		if (got > n)
+			got = n;
+		if (got <= 0)
+			return -1;
+		memcpy(img + off, v->data, got);
+		off += got;
+	}
+	return 0;
+}
+
+static int load_cache(int fruid, struct fru_cache *c, uint8_t **img)
+{
+	char path[64];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), FRU_CACHE, fruid);
+	if ((fp = fopen(path, "r")) == NULL)
+		return -1;
+	if (fread(c, sizeof(*c), 1, fp) != 1
+	    || memcmp(c->magic, CACHE_MAGIC, sizeof(c->magic))
+	    || (*img = malloc(c->size)) == NULL) {
+		fclose(fp);
+		return -1;
+	}
+	if (fread(*img, 1, c->size, fp) != c->size) {
+		free(*img);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int save_cache(int fruid, const struct fru_cache *c,
+		      const uint8_t *img)
+{
+	char path[64], tmp[68];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), FRU_CACHE, fruid);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if ((fp = fopen(tmp, "w")) == NULL)
+		return -1;
+	if (fwrite(c, sizeof(*c), 1, fp) != 1
+	    || fwrite(img, 1, c->size, fp) != c->size) {
+		fclose(fp);
+		unlink(tmp);
+		return -1;
+	}
+	if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read each area's length byte, and then the rest of it, into img,
+ * whose common header has been read. Returns 0, or -1.
+ */
+static int read_areas(int fruid, int words, uint8_t *img, int size,
+		      int *chunk)
+{
+	int i, off, len;
+
+	for (i = 0; i < NAREAS; i++) {
+		if ((off = img[areas[i].hdr] * 8) == 0)
+			continue;
+		if (read_span(fruid, words, img, size, off, 2, chunk) < 0)
+			return -1;
+		len = img[off + 1] * 8;
+		if (len < 2 || off + len > size)
+			continue;	// fru_decode skips it
+		if (read_span(fruid, words, img, size, off + 2, len - 2,
+			      chunk) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Does the device still hold what was cached? The common header and
+ * each area's length and checksum bytes have to match; the checksum
+ * covers the rest of the area.
+ */
+static int cache_matches(int fruid, int words, const uint8_t *cimg,
+			 uint8_t *img, int size, int *chunk)
+{
+	int i, off, len;
+
+	if (memcmp(img, cimg, FRU_HEADER))
+		return 0;
+	for (i = 0; i < NAREAS; i++) {
+		if ((off = img[areas[i].hdr] * 8) == 0)
+			continue;
+		if (read_span(fruid, words, img, size, off, 2, chunk) < 0
+		    || img[off + 1] != cimg[off + 1])
+			return 0;
+		len = img[off + 1] * 8;
+		if (len < 2 || off + len > size)
+			continue;
+		if (read_span(fruid, words, img, size, off + len - 1, 1,
+			      chunk) < 0
+		    || img[off + len - 1] != cimg[off + len - 1])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Read FRU device fruid into fi, from the cache if it still matches
+ * the device unless flags has FRU_NOCACHE. Returns 0, or -1.
+ */
+int fru_read(int fruid, struct fru_info *fi, int flags)
+{
+	uchar rsp[8];
+	IpmiFruAreaInfoReq req;
+	const IpmiFruAreaInfoRsp *info;
+	struct fru_cache c, cached;
+	uint8_t *img = NULL, *cimg = NULL;
+	int size, words, chunk = FRU_MAXCHUNK;
+	int rlen, rc = -1;
+
+	req.fru_id = fruid;
+	info = ipmicmd_call(&ipmi_get_fru_area_info,
+			    IPMI_SYSTEM_INTERFACE_ADDR_TYPE, &req, sizeof(req),
+			    rsp, sizeof(rsp), &rlen);
+	if (info == NULL)
+		return -1;
+	size = info->size_lsb | info->size_msb << 8;
+	words = info->access & 1;
+	if (size < FRU_HEADER) {
+		fprintf(stderr, "%s: Error: FRU %d is %d bytes\n", toolname,
+			fruid, size);
+		return -1;
+	}
+
+	if (load_cache(fruid, &cached, &cimg) == 0) {
+		if (cached.size == size && cached.access == words
+		    && cached.chunk >= 2 && cached.chunk <= FRU_MAXCHUNK)
+			chunk = cached.chunk;
+		else {
+			free(cimg);
+			cimg = NULL;
+		}
+	}
+
+	if ((img = calloc(size, 1)) == NULL)
+		goto out;
+	if (read_span(fruid, words, img, size, 0, FRU_HEADER, &chunk) < 0)
+		goto out;
+	if (checksum(img, FRU_HEADER) != 0) {
+		fprintf(stderr, "%s: Error: FRU %d common header checksum\n",
+			toolname, fruid);
+		goto out;
+	}
+
+	if (cimg && !(flags & FRU_NOCACHE)
+	    && cache_matches(fruid, words, cimg, img, size, &chunk)) {
+		rc = fru_decode(cimg, size, fi);
+		fi->cached = 1;
+		if (Verbose)
+			printf("FRU %d unchanged, decoded from the cache\n",
+			       fruid);
+		goto out;
+	}
+
+	if (read_areas(fruid, words, img, size, &chunk) < 0)
+		goto out;
+	rc = fru_decode(img, size, fi);
+
+	memcpy(c.magic, CACHE_MAGIC, sizeof(c.magic));
+	c.size = size;
+	c.access = words;
+	c.chunk = chunk;
+	if (rc == 0 && save_cache(fruid, &c, img) < 0 && Verbose)
+		fprintf(stderr, "%s: cannot write the FRU %d cache\n",
+			toolname, fruid);
+out:
+	free(img);
+	free(cimg);
+	return rc;
+}
+
+/*
+ * Decode the type/length byte at a[*pos] and the field after it into
+ * out. Returns 0, 1 at the end of the fields, or -1 if the field runs
+ * past the area.
+ */
+static int field(const uint8_t *a, int len, int *pos, char *out)
+{
+	static const char bcdplus[] = "0123456789 -.???";
+	int tl, n, i, k = 0;
+	const uint8_t *d;
+
+	out[0] = 0;
+	if (*pos >= len)
+		return -1;
+	tl = a[*pos];
+	if (tl == FRU_END_OF_FIELDS)
+		return 1;
+	n = tl & 0x3f;
+	d = a + *pos + 1;
+	if (*pos + 1 + n > len)
+		return -1;
+	*pos += 1 + n;
+
+	switch (tl >> 6) {
+	case 0:		/* binary */
+		for (i = 0; i < n && k + 3 < FRU_FIELD; i++)
+			k += sprintf(out + k, "%02x", d[i]);
+		break;
+	case 1:		/* BCD plus */
+		for (i = 0; i < n && k + 2 < FRU_FIELD; i++) {
+			out[k++] = bcdplus[d[i] >> 4];
+			out[k++] = bcdplus[d[i] & 0x0f];
+		}
+		break;
+	case 2:		/* 6-bit ASCII, packed from the low bits up */
+		for (i = 0; i < n * 8 / 6 && k + 1 < FRU_FIELD; i++) {
+			int bit = i * 6, b = bit / 8, s = bit % 8;
+			int v = d[b] >> s;
+
+			if (s > 2 && b + 1 < n)
+				v |= d[b + 1] << (8 - s);
+			out[k++] = (v & 0x3f) + 0x20;
+		}
+		break;
+	case 3:		/* 8-bit ASCII + Latin 1 */
+		for (i = 0; i < n && k + 1 < FRU_FIELD; i++)
+			out[k++] = d[i] >= 0x20 && d[i] != 0x7f ? d[i] : '.';
+		break;
+	}
+	while (k > 0 && out[k - 1] == ' ')
+		k--;
+	out[k] = 0;
+	return 0;
+}
+
+/* Fill the n fields in out from the area, stopping at the end marker. */
+static void fields(const uint8_t *a, int len, int pos, char **out, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (field(a, len, &pos, out[i]) != 0)
+			break;
+}
+
+/*
+ * Decode the chassis, board and product info areas of a FRU image.
+ * Areas that run past the image or fail their checksum are skipped.
+ * Returns 0, or -1 if the common header is bad.
+ */
+int fru_decode(const uint8_t *img, int size, struct fru_info *fi)
+{
+	int i, off, len;
+
+	memset(fi, 0, sizeof(*fi));
+	if (size < FRU_HEADER || checksum(img, FRU_HEADER) != 0
+	    || (img[0] & 0x0f) != 1)
+		return -1;
+
+	for (i = 0; i < NAREAS; i++) {
+		const uint8_t *a;
+
+		if ((off = img[areas[i].hdr] * 8) == 0 || off + 2 > size)
+			continue;
+		a = img + off;
+		len = a[1] * 8;
+		if (len < 3 || off + len > size || checksum(a, len) != 0) {
+			if (Verbose)
+				printf("FRU area at %d is bad, skipped\n", off);
+			continue;
+		}
+
+		switch (areas[i].area) {
+		case FRU_CHASSIS: {
+			char *f[] = { fi->chassis_part, fi->chassis_serial };
+
+			fi->chassis_type = a[2];
+			fields(a, len, 3, f, 2);
+			break;
+		}
+		case FRU_BOARD: {
+			char *f[] = { fi->board_mfg, fi->board_product,
+				      fi->board_serial, fi->board_part };
+			long mins;
+
+			if (len < 6)
+				continue;
+			mins = a[3] | a[4] << 8 | (long)a[5] << 16;
+			fi->board_mfg_time = mins ? FRU_TIME_BASE + mins * 60 : 0;
+			fields(a, len, 6, f, 4);
+			break;
+		}
+		case FRU_PRODUCT: {
+			char *f[] = { fi->product_mfg, fi->product_name,
+				      fi->product_part, fi->product_version,
+				      fi->product_serial, fi->product_asset };
+
+			fields(a, len, 3, f, 6);
+			break;
+		}
+		}
+		fi->areas |= areas[i].area;
+	}
+	return 0;
+}
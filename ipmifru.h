@@ -0,0 +1,56 @@
+/*
+ * ipmifru.h - board, product and chassis inventory from a FRU device
+ *
+ * fru_read reads a FRU device's common header and its chassis, board
+ * and product info areas with Read FRU Data over ipmicmd_mv, as big a
+ * chunk at a time as the BMC takes, and decodes them with fru_decode.
+ *
+ * What it read is kept in FRU_CACHE (one file per FRU device) with the
+ * chunk size that worked. The next fru_read reads only the common
+ * header and each area's length and checksum bytes, and if they match
+ * the cached copy, decodes that instead of reading the areas again.
+ */
+
+#ifndef IPMIFRU_H
+#define IPMIFRU_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define FRU_CACHE	"/run/ipmifru.%d"
+#define FRU_FIELD	96	/* 63 bytes of 6-bit ASCII unpack to 84 */
+
+/* fru_info areas */
+#define FRU_CHASSIS	0x01
+#define FRU_BOARD	0x02
+#define FRU_PRODUCT	0x04
+
+/* fru_read flags */
+#define FRU_NOCACHE	0x01	/* read the device even if the cache matches */
+
+struct fru_info {
+	int		areas;		/* FRU_* areas decoded */
+	int		cached;		/* decoded from the cache */
+
+	int		chassis_type;
+	char		chassis_part[FRU_FIELD];
+	char		chassis_serial[FRU_FIELD];
+
+	time_t		board_mfg_time;	/* 0 if unspecified */
+	char		board_mfg[FRU_FIELD];
+	char		board_product[FRU_FIELD];
+	char		board_serial[FRU_FIELD];
+	char		board_part[FRU_FIELD];
+
+	char		product_mfg[FRU_FIELD];
+	char		product_name[FRU_FIELD];
+	char		product_part[FRU_FIELD];
+	char		product_version[FRU_FIELD];
+	char		product_serial[FRU_FIELD];
+	char		product_asset[FRU_FIELD];
+};
+
+int fru_read(int fruid, struct fru_info *fi, int flags);
+int fru_decode(const uint8_t *img, int size, struct fru_info *fi);
+
+#endif /* IPMIFRU_H */
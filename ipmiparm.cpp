@@ -21,9 +21,12 @@
 **
 **  Very simple compile
 **
-**      $ make ipmiparm
+**      $ qmake && make
 **  or
-**      $ g++ -o ipmiparm ipmiparm.cpp
+**      $ g++ -o ipmiparm ipmiparm.cpp placement.cpp ipmistats.cpp ringfile.cpp \
+**            snapfile.cpp modreload.cpp parmfmt.cpp metricfile.cpp iptrace.c
+**
+**  Add -DIPMI_TRACE for the phase timing printed by --timing.
 **
 ******************************************************************************/
 
@@ -35,6 +38,23 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cerrno>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <signal.h>
+#include <time.h>
+#include <map>
+#include <sys/stat.h>
+
+#include "placement.h"
+#include "ipmistats.h"
+#include "ringfile.h"
+#include "snapfile.h"
+#include "modreload.h"
+#include "parmfmt.h"
+#include "metricfile.h"
+#include "iptrace.h"
 
 using namespace std;
 
@@ -44,7 +64,8 @@ using namespace std;
 class kmodparm {
 public:
 
-    kmodparm() {value = 0; m_isbitmask = false; isstring = false; }
+    kmodparm() {value = 0; m_isbitmask = false; isstring = false;
+                writable = true;}
 
     int togglebit(int bit, int& mask);
 
@@ -53,6 +74,7 @@ public:
     int    value;
     string strval;
     bool   isstring;
+    bool   writable;    // false for load-time parameters, mode 0444
 
 private:
     bool   m_isbitmask;
@@ -95,47 +117,70 @@ public:
     void   getkmodmenu(int pos);
     char   getchar();
     int    toxint(char c);
-    string tobin(int hex, int bits);
+    const char *tobin(int num, int bits);
     void   editparm(kmodparm& parm);
     void   editparmbitmask(kmodparm& parm);
     bool   toggleradix() {hexdec = !hexdec; return hexdec;}
     string getradixstr() {return hexdec ? "hex" : "dec";}
     string getstr(string prompt, string curval);
     int    getint(string prompt, int curval = 0);
-    bool   isint(string& s);
-    bool   str2int(string& str, int& num);
-    int    str2int(string& str);
-    int    tokenize(stringstream& ss, vector<string>& tokens);
+    int    radix() {return hexdec ? 16 : 10;}
+    bool   isint(string_view s);
+    bool   str2int(string_view str, int& num);
+    int    str2int(string_view str);
+    int    tokenize(string_view s, string_view *tokens, int max);
+    int    writeparm(kmodparm& parm);
+    kmodparm* findparm(string_view kmodname, string_view parmname);
+    void   showplacemenu();
+    void   getplacemenu();
+    void   editthread(kthread& kt);
+    void   editirq(ipmiirq& iq);
+    int    save(string path);
+    int    load(string path);
+    void   showstats();
+    void   livestats(double secs);
+    void   dumpstats(double secs);
+    void   refresh();
+    void   recfields(vector<string>& fields);
+    void   recvalues(vector<int64_t>& vals);
+    int    record(string path, double secs, size_t size);
+    static int exportcsv(string path, int64_t from, int64_t to);
+    int    snapshot(string path);
+    void   putmetrics(metricfile& mf);
+    int    exportmetrics(string path, double secs);
+    int    reload(const modopts& opts, bool ask);
 
 private:
     string topdir;
     bool hexdec;            // hex radix when true, dec when false
     bool binary;            // binary input enabled for bitmasks when true
     vector<kmod> kmods;
+    placement place;        // kipmid threads and ipmi irqs
+    ipmistats stats;        // driver counters
+
+    string sysroot;         // topdir with $HOME expanded
+    string shellout;        // reused by shell
+    textfile tf;            // reused by refresh
+    char   binbuf[FMT_INTLEN];  // tobin's result
 
     void init(bool test = false);
     void init_kmod(string kmod);
+    const string& sysdir() {return sysroot;}
 };
 
 /**************************************************************
- * parmapp::tokenize - tokenizes a string stream and creates a
- *                     vector of strings.
- * ss       - stringstream to tokenize
- * tokens   - a vector of strings
+ * parmapp::tokenize - split a string into white space separated
+ *                     tokens.
+ * s        - string to tokenize
+ * tokens   - views of the tokens in s
+ * max      - room in tokens
  *
- * Returns the number of tokens
+ * Returns the number of tokens, which may be more than max
  *
  */
-int parmapp::tokenize (stringstream& ss, vector<string>& tokens)
+int parmapp::tokenize (string_view s, string_view *tokens, int max)
 {
-    int i;
-    string str;
-
-    for (i = 0; ss.eof() == false; ++i) {
-        ss >> str;
-        tokens.push_back(str);
-    }
-    return i;
+    return splitws(s, tokens, max);
 }
 
 
@@ -176,6 +221,7 @@ void parmapp::init_kmod(string kmodstr)
     string dir = topdir + "module/" + kmodstr + "/parameters/";
     int j = kmods.size();
     int k = 0;
+    TRACE_SCOPE(TP_INIT_KMOD);
 
     cmd << "ls 2>/dev/null " << dir;
     if (shell(cmd, s1))
@@ -195,6 +241,11 @@ void parmapp::init_kmod(string kmodstr)
         km.parms[k].kmodname = kmodstr;
         km.parms[k].parmname = str;
 
+        struct stat st;
+        if (stat((sysdir() + "module/" + kmodstr + "/parameters/"
+                  + str).c_str(), &st) == 0)
+            km.parms[k].writable = (st.st_mode & 0222) != 0;
+
         s2.clear();
         s2.str("");
         cmd.str("");
@@ -204,7 +255,9 @@ void parmapp::init_kmod(string kmodstr)
 
         if ((s2 >> km.parms[k].value).fail()) {
             s2.clear();
-            s2 >> km.parms[k].strval;
+            string val;
+            getline(s2 >> ws, val);
+            km.parms[k].strval.assign(trim(val));
             km.parms[k].isstring = true;
         } else
             km.parms[k].isstring = false;
@@ -220,11 +273,17 @@ void parmapp::init_kmod(string kmodstr)
 void parmapp::init(bool test)
 {
     topdir = test ? "$HOME/" : "/sys/";
+    sysroot = topdir;
+    if (sysroot.compare(0, 5, "$HOME") == 0 && getenv("HOME"))
+        sysroot.replace(0, 5, getenv("HOME"));
+    shellout.reserve(BUFSIZ);
     hexdec = true;
     binary = false;
     init_kmod("ipmi_si");
     init_kmod("ipmi_msghandler");
     init_kmod("ipmi_watchdog");
+    place.discover();
+    stats.discover();
 }
 
 /**************************************************************
@@ -236,32 +295,48 @@ void parmapp::init(bool test)
  * BUFSIZ  - defined by the compiler. In g++ running on Linux
  *           64-bit kernel, it's 8192.
  *
- * Returns the status of the OS call.
+ * The output is read into shellout, which keeps its capacity from
+ * one call to the next. The last line is the status echoed by the
+ * shell; the lines before it are the command's output.
+ *
+ * Returns the status of the OS call, or -1 if the shell could not
+ * be run or didn't report a status.
  *
  */
 int parmapp::shell(stringstream& command, stringstream& outstr)
 {
     int retval;
-    int retidx;
-    int i;
-    vector<string> tokens;
+    size_t n;
     char buff[BUFSIZ];
+    TRACE_SCOPE(TP_SHELL);
 
     command << "\necho $?\n";
     command.flush();
 
     FILE *fp = popen(command.str().c_str(), "r");
+    TRACE_FORK();
+
+    if (fp == NULL)
+        return -1;
 
-    for (i = 0; fgets(buff, BUFSIZ, fp ) != NULL; ++i)
-        tokens.push_back(buff);
+    shellout.clear();
+    while ((n = fread(buff, 1, sizeof(buff), fp)) > 0)
+        shellout.append(buff, n);
 
     pclose(fp);
 
-    retidx = i - 1;
-    retval = str2int(tokens[retidx]);
+    string_view out(shellout);
+    if (!out.empty() && out.back() == '\n')
+        out.remove_suffix(1);
+
+    size_t nl = out.rfind('\n');
+    string_view status = nl == string_view::npos ? out : out.substr(nl + 1);
 
-    for (i = 0; i < retidx; ++i)
-        outstr << tokens[i];
+    if (parseint(status, 10, retval) != PARSE_OK)
+        return -1;
+
+    if (nl != string_view::npos)
+        outstr.write(out.data(), nl + 1);
 
     return retval;
 }
@@ -283,16 +358,16 @@ char parmapp::getchar()
     return *ans.str().c_str();
 }
 
-string parmapp::tobin(int num, int bits)
+/**************************************************************
+ * parmapp::tobin - the low bits of num as a string of 0s and 1s
+ *
+ * Returns binbuf, good until the next call.
+ */
+const char *parmapp::tobin(int num, int bits)
 {
-    string temp;
-    int bit;
-    temp.resize(bits);
-    for (int i = 0; i < bits; ++i) {
-        bit = 1 << (bits - 1 - i);
-        temp[i] = bit & num ? '1' : '0';
-    }
-    return temp;
+    if (fmtbin(binbuf, sizeof(binbuf), (unsigned)num, bits) == 0)
+        binbuf[0] = '\0';
+    return binbuf;
 }
 
 /**************************************************************
@@ -315,69 +390,48 @@ int parmapp::toxint(char c)
 
 /**************************************************************
  * parmapp::isint - test the string to see whether it's an int
+ *                  in the current radix, and fits in one
  */
-bool parmapp::isint(string& s)
+bool parmapp::isint(string_view s)
 {
-    bool isnumber = true;
-
-    for(string::const_iterator k = s.begin(); k != s.end(); ++k) {
-        if (hexdec)
-            isnumber = isnumber && isxdigit(*k);
-        else
-            isnumber = isnumber && isdigit(*k);
-    }
+    int num;
 
-    return isnumber;
+    return parseint(s, radix(), num) == PARSE_OK;
 }
 
 /**************************************************************
  * parmapp::str2int - safely convert a string to an int
  *
- * This version of the function first determines whether the str
- * actually contains a number, depending on the radix. For exapmle,
- * with the parmapp class hexdec set for hexadecimal, foo is not
- * considered a number while f00 is.
+ * The str must be a number in the current radix, e.g. with the
+ * parmapp class hexdec set for hexadecimal, foo is not considered
+ * a number while f00 and 0xf00 are, and it must fit in an int.
  *
  * str  - string to convert
  * num  - integer value of the converted number
  *
- * Returns true if the str is indeed a number, else false and
- * the value of num is undefined.
+ * Returns true if the str is indeed a number, else false and num
+ * is left alone.
  */
-bool parmapp::str2int(string& str, int& num)
+bool parmapp::str2int(string_view str, int& num)
 {
-    if (!isint(str))
-        return false;
-
-    num = str2int(str);
-    return true;
+    return parseint(str, radix(), num) == PARSE_OK;
 }
 
 /**************************************************************
- * parmapp::str2int - safely convert a string to an int
+ * parmapp::str2int - convert a string to an int
  *
- * This version of the function simply performs the conversion
- * without worrying whether the str contains a real number. This
- * version of the function is only used when you KNOW that the
- * str has a real number in it. For example, with parmapp::hexdec
- * set to true (hexadecimal mode), then foo will be evaluated as
- * 15.
+ * For when the str is known to hold a number in the current radix.
  *
  * str  - string to convert
  *
  * Returns the converted integer. Returns 0 if the integer could
  * not be converted.
  */
-int parmapp::str2int(string& str)
+int parmapp::str2int(string_view str)
 {
-    int num;
-    stringstream ss(str);
-
-    if (hexdec)
-        ss >> hex >> num;
-    else
-        ss >> num;
+    int num = 0;
 
+    parseint(str, radix(), num);
     return num;
 }
 
@@ -430,47 +484,107 @@ string parmapp::getstr(string prompt, string curval)
 }
 
 /**************************************************************
- * parmapp::editparm - get a new value for the kmod parameter
+ * parmapp::writeparm - write the value of a kmod parameter back
+ *                      to its file in sysfs.
  *
+ * Returns the status of the shell command.
  */
-void parmapp::editparm(kmodparm& parm)
+int parmapp::writeparm(kmodparm& parm)
 {
     string parmfile;
     stringstream cmd;
     stringstream ss;
-    string linestr = "-----------------------------------------\n";
-    string prompt = "  New value: ";
+    TRACE_SCOPE(TP_SYSFS_WRITE);
 
     parmfile = topdir + "module/" + parm.kmodname
                       + "/parameters/" + parm.parmname;
 
-    printf("  %s - Current Value: ", parm.parmname.c_str());
-    ss.clear();
-    ss.str("");
-    cmd.str("");
+    // Single quotes keep a string value, spaces and all, in one
+    // piece; a quote within it is closed, escaped and reopened.
+    //
     cmd << "echo ";
+    if (parm.isstring) {
+        cmd << "'";
+        for (uint i = 0; i < parm.strval.size(); ++i)
+            if (parm.strval[i] == '\'')
+                cmd << "'\\''";
+            else
+                cmd << parm.strval[i];
+        cmd << "'";
+    } else
+        cmd << parm.value;
+    cmd << " > " << parmfile << "\n";
+    cmd.flush();
+    return shell(cmd, ss);
+}
+
+/**************************************************************
+ * parmapp::findparm - look up a parameter by kmod and name
+ *
+ * Returns a pointer to the parameter, or NULL if there isn't one.
+ */
+kmodparm* parmapp::findparm(string_view kmodname, string_view parmname)
+{
+    for (uint j = 0; j < kmods.size(); ++j) {
+        if (kmods[j].kmodname != kmodname)
+            continue;
+        for (uint k = 0; k < kmods[j].parms.size(); ++k)
+            if (kmods[j].parms[k].parmname == parmname)
+                return &kmods[j].parms[k];
+    }
+    return NULL;
+}
+
+/**************************************************************
+ * parmapp::editparm - get a new value for the kmod parameter
+ *
+ * A read-only parameter can only be given a new value by
+ * reloading its kmod, so for those the new value is offered to
+ * reload rather than written.
+ */
+void parmapp::editparm(kmodparm& parm)
+{
+    string linestr = "-----------------------------------------\n";
+    string prompt = "  New value: ";
+    kmodparm old = parm;
+
+    printf("  %s - Current Value: ", parm.parmname.c_str());
 
     if(parm.isstring) {
         printf("%s\n", parm.strval.c_str());
         cout << linestr;
         parm.strval = getstr(prompt, parm.strval);
-        if (str2int(parm.strval, parm.value)) {
-            parm.isstring = false;
-            cmd << parm.value;
-        } else {
-            parm.isstring = true;
-            cmd << parm.strval;
-        }
+        parm.isstring = !str2int(parm.strval, parm.value);
     } else {
         printf("%3d  :  0x%02x\n", parm.value, parm.value);
         cout << linestr;
         parm.value = getint(prompt, parm.value);
-        cmd << parm.value;
     }
 
-    cmd << " > " << parmfile << "\n";
-    cmd.flush();
-    shell(cmd, ss);
+    if (parm.writable) {
+        if (writeparm(parm))
+            cout << "  Cannot write " << parm.parmname << endl;
+        return;
+    }
+
+    if (parm.isstring == old.isstring && parm.value == old.value
+        && parm.strval == old.strval)
+        return;
+
+    modopts opts;
+    stringstream ss;
+    ss << parm.parmname << "=";
+    if (parm.isstring)
+        ss << parm.strval;
+    else
+        ss << parm.value;
+    opts[parm.kmodname].push_back(ss.str());
+
+    cout << endl << "  " << parm.parmname << " is read-only; it is only set when "
+         << parm.kmodname << " is loaded." << endl << endl;
+
+    parm = old;
+    reload(opts, true);
 }
 
 
@@ -485,14 +599,11 @@ void parmapp::editparm(kmodparm& parm)
 void parmapp::editparmbitmask(kmodparm& parm)
 {
     char ch;
-    string parmfile;
-    stringstream cmd;
-    stringstream ss;
 
     while (true) {
         printf("  %-15s: %3d  :  0x%02x  :  %s\n",
                parm.parmname.c_str(), parm.value, parm.value,
-               tobin(parm.value, 8).c_str());
+               tobin(parm.value, 8));
         cout << "  --------------------------------------------\n";
         cout << "  Number from 0 to 7 to toggles the corresponding bit.\n";
         cout << "  v  prompts to change the value directly\n";
@@ -514,12 +625,7 @@ void parmapp::editparmbitmask(kmodparm& parm)
         case '6' :
         case '7' : parm.togglebit(toxint(ch), parm.value); break;
         }
-        cmd.str("");
-        ss.str("");
-        parmfile = topdir + "module/" + parm.kmodname
-                 + "/parameters/" + parm.parmname;
-        cmd << "echo " << parm.value << " > " << parmfile << "\n";
-        shell(cmd, ss);
+        writeparm(parm);
     }
 }
 
@@ -531,7 +637,7 @@ void parmapp::editparmbitmask(kmodparm& parm)
  */
 void parmapp::showkmodmenu(int pos)
 {
-    vector<kmodparm> parms = kmods[pos].parms;
+    const vector<kmodparm>& parms = kmods[pos].parms;
 
     cout << " " << kmods[pos].kmodname << " parameters\n"
          <<    " --------------------------------------\n";
@@ -540,9 +646,10 @@ void parmapp::showkmodmenu(int pos)
         printf("  %0x  %-19s: ", i, parms[i].parmname.c_str());
 
         if(parms[i].isstring)
-            printf("str %s\n", parms[i].strval.c_str());
+            printf("str %s", parms[i].strval.c_str());
         else
-            printf("int %3d  :  0x%02x\n", parms[i].value, parms[i].value);
+            printf("int %3d  :  0x%02x", parms[i].value, parms[i].value);
+        printf("%s\n", parms[i].writable ? "" : "  (load time)");
      }
 
     cout << "\n  r  switch radix. Current input radix: "
@@ -576,7 +683,8 @@ void parmapp::getkmodmenu(int pos)
         // simple value. We determine it's a debug parameter by looking for
         // "debug" in the parameter's name string.
         //
-        if (km.parms[i].parmname.find("debug") == string::npos)
+        if (km.parms[i].parmname.find("debug") == string::npos
+            || !km.parms[i].writable)
             editparm(km.parms[i]);
         else
             editparmbitmask(km.parms[i]);
@@ -585,6 +693,769 @@ void parmapp::getkmodmenu(int pos)
     }
 }
 
+/**************************************************************
+ * parmapp::showplacemenu - menu of kipmid threads and ipmi irqs
+ *
+ */
+void parmapp::showplacemenu()
+{
+    uint i;
+
+    cout << " kipmid and IPMI IRQ placement\n"
+         << " --------------------------------------\n";
+
+    for (i = 0; i < place.threads.size(); ++i) {
+        kthread& kt = place.threads[i];
+        printf("  %0x  %-10s pid %-7d cpus %-12s sched %s %d\n", i,
+               kt.comm.c_str(), kt.pid, kt.cpus.c_str(),
+               placement::policystr(kt.policy).c_str(), kt.prio);
+    }
+
+    for (uint j = 0; j < place.irqs.size(); ++j, ++i) {
+        ipmiirq& iq = place.irqs[j];
+        printf("  %0x  irq %-6d %-12s cpus %s\n", i,
+               iq.irq, iq.name.c_str(), iq.cpus.c_str());
+    }
+
+    if (i == 0)
+        cout << "  no kipmid threads or ipmi irqs found\n";
+
+    cout << "\n  r  rescan\n";
+    cout << "  q  quit\n\n";
+    cout << "  Select a thread or irq to place: ";
+    cout.flush();
+}
+
+void parmapp::getplacemenu()
+{
+    char ch;
+
+    while (true) {
+        cout << endl;
+        showplacemenu();
+        ch = getchar();
+        cout << endl;
+
+        switch (ch) {
+        case 'q': cout << endl; return;
+        case 'r': place.discover(); continue;
+        }
+
+        int i = toxint(ch);
+        if (i == -1)
+            continue;
+
+        if ((uint)i < place.threads.size())
+            editthread(place.threads[i]);
+        else if ((uint)i < place.threads.size() + place.irqs.size())
+            editirq(place.irqs[i - place.threads.size()]);
+    }
+}
+
+/**************************************************************
+ * parmapp::editthread - get a new affinity and scheduling class
+ *                       for a kipmid thread
+ *
+ * The priority is always taken in decimal, regardless of radix,
+ * since that is how chrt and ps present it.
+ */
+void parmapp::editthread(kthread& kt)
+{
+    string cpus;
+    string pol;
+    int prio = 0;
+
+    cout << "  " << kt.comm << " - Current cpus: " << kt.cpus
+         << "  sched: " << placement::policystr(kt.policy)
+         << " " << kt.prio << endl;
+    cout << "-----------------------------------------\n";
+
+    cpus = getstr("  New cpu list: ", kt.cpus);
+    if (cpus != kt.cpus && place.setaffinity(kt, cpus) < 0)
+        cout << "  Cannot set affinity: " << strerror(errno) << endl;
+
+    pol = getstr("  New policy (other fifo rr batch idle): ",
+                 placement::policystr(kt.policy));
+
+    if (pol == "fifo" || pol == "rr") {
+        stringstream ss;
+        ss << kt.prio;
+        string str = getstr("  New rt priority (1-99): ", ss.str());
+        prio = atoi(str.c_str());
+    }
+
+    if ((placement::strpolicy(pol) != kt.policy || prio != kt.prio)
+        && place.setsched(kt, placement::strpolicy(pol), prio) < 0)
+        cout << "  Cannot set scheduling class: " << strerror(errno) << endl;
+}
+
+/**************************************************************
+ * parmapp::editirq - get a new affinity for an ipmi irq
+ *
+ */
+void parmapp::editirq(ipmiirq& iq)
+{
+    string cpus;
+
+    cout << "  irq " << iq.irq << " " << iq.name
+         << " - Current cpus: " << iq.cpus << endl;
+    cout << "-----------------------------------------\n";
+
+    cpus = getstr("  New cpu list: ", iq.cpus);
+    if (cpus != iq.cpus && place.setirqaffinity(iq, cpus) < 0)
+        cout << "  Cannot set irq affinity: " << strerror(errno) << endl;
+}
+
+/**************************************************************
+ * parmapp::save - save parameter values and placement to a file
+ *
+ * One setting per line:
+ *
+ *   parm <kmod> <parm> <value>
+ *   kthread <comm> <cpus> <policy> <prio>
+ *   irq <name> <cpus>
+ *
+ * A string value is the rest of its line, so it may hold spaces.
+ * Threads and irqs are keyed by name rather than pid or irq number,
+ * since those can change from one boot to the next.
+ *
+ * Returns 0 on success, else -1.
+ */
+int parmapp::save(string path)
+{
+    ofstream fout(path.c_str());
+
+    if (!fout)
+        return -1;
+
+    fout << "# ipmiparm saved settings\n";
+
+    for (uint j = 0; j < kmods.size(); ++j) {
+        kmod& km = kmods[j];
+        for (uint k = 0; k < km.parms.size(); ++k) {
+            fout << "parm " << km.kmodname << " " << km.parms[k].parmname
+                 << " ";
+            if (km.parms[k].isstring)
+                fout << km.parms[k].strval << "\n";
+            else
+                fout << km.parms[k].value << "\n";
+        }
+    }
+
+    for (uint i = 0; i < place.threads.size(); ++i) {
+        kthread& kt = place.threads[i];
+        fout << "kthread " << kt.comm << " " << kt.cpus << " "
+             << placement::policystr(kt.policy) << " " << kt.prio << "\n";
+    }
+
+    for (uint i = 0; i < place.irqs.size(); ++i)
+        fout << "irq " << place.irqs[i].name << " "
+             << place.irqs[i].cpus << "\n";
+
+    fout.close();
+    return fout.fail() ? -1 : 0;
+}
+
+/**************************************************************
+ * parmapp::load - apply the settings from a file written by save
+ *
+ * Only settings that differ from the current ones are written, so
+ * loading a file on a system already configured does nothing.
+ *
+ * Returns the number of settings that could not be applied, or -1
+ * if the file could not be opened.
+ */
+int parmapp::load(string path)
+{
+    ifstream fin(path.c_str());
+    string line;
+    int errs = 0;
+
+    if (!fin)
+        return -1;
+
+    while (getline(fin, line)) {
+        string_view tok[5];
+        size_t ntok = tokenize(line, tok, 5);
+        string_view key = ntok ? tok[0] : string_view();
+        string_view name = ntok > 1 ? tok[1] : string_view();
+
+        if (ntok == 0 || key[0] == '#')
+            continue;
+
+        if (key == "parm") {
+            string_view kmodname = name;
+            name = ntok > 2 ? tok[2] : string_view();
+            string_view val;
+            if (ntok > 3)
+                val = trim(string_view(line).substr(tok[3].data()
+                                                    - line.data()));
+            kmodparm *parm = findparm(kmodname, name);
+            if (parm == NULL) {
+                ++errs;
+                continue;
+            }
+
+            int num;
+            bool isnum = parseint(val, 10, num) == PARSE_OK;
+            if (isnum ? !parm->isstring && parm->value == num
+                      : parm->isstring && parm->strval == val)
+                continue;
+
+            // A load-time parameter can't be written; say how to
+            // get it applied rather than pretend.
+            //
+            if (!parm->writable) {
+                cerr << "ipmiparm: " << kmodname << "." << name
+                     << " is set at load time; apply it with -M "
+                     << kmodname << "." << name << "=" << val << " -y\n";
+                ++errs;
+                continue;
+            }
+
+            if (isnum) {
+                parm->value = num;
+                parm->isstring = false;
+            } else {
+                parm->strval.assign(val);
+                parm->isstring = true;
+            }
+            if (writeparm(*parm))
+                ++errs;
+
+        } else if (key == "kthread") {
+            string val(ntok > 2 ? tok[2] : string_view());
+            string pol(ntok > 3 ? tok[3] : string_view());
+            int prio = 0;
+            if (ntok > 4)
+                parseint(tok[4], 10, prio);
+            for (uint i = 0; i < place.threads.size(); ++i) {
+                kthread& kt = place.threads[i];
+                if (kt.comm != name)
+                    continue;
+                if (val != kt.cpus && place.setaffinity(kt, val) < 0)
+                    ++errs;
+                if ((placement::strpolicy(pol) != kt.policy || prio != kt.prio)
+                    && place.setsched(kt, placement::strpolicy(pol), prio) < 0)
+                    ++errs;
+            }
+
+        } else if (key == "irq") {
+            string val(ntok > 2 ? tok[2] : string_view());
+            for (uint i = 0; i < place.irqs.size(); ++i) {
+                ipmiirq& iq = place.irqs[i];
+                if (iq.name == name && val != iq.cpus
+                    && place.setirqaffinity(iq, val) < 0)
+                    ++errs;
+            }
+        }
+    }
+    return errs;
+}
+
+/**************************************************************
+ * parmapp::showstats - print the parameters and the driver counters
+ *                      with their deltas and per-second rates from
+ *                      the last sample.
+ *
+ */
+void parmapp::showstats()
+{
+    uint col = 0;
+
+    for (uint j = 0; j < kmods.size(); ++j) {
+        kmod& km = kmods[j];
+        cout << " " << km.kmodname << " parameters\n";
+        for (uint k = 0; k < km.parms.size(); ++k, ++col) {
+            if (km.parms[k].isstring)
+                printf("  %-24s %-10s", km.parms[k].parmname.c_str(),
+                       km.parms[k].strval.c_str());
+            else
+                printf("  %-24s %-10d", km.parms[k].parmname.c_str(),
+                       km.parms[k].value);
+            if (col % 2)
+                cout << "\n";
+        }
+        if (col % 2)
+            cout << "\n";
+        col = 0;
+    }
+
+    printf("\n  %-18s %-26s %14s %10s %12s\n",
+           "source", "counter", "value", "delta", "rate/s");
+    cout << "  -------------------------------------------"
+            "-------------------------------------------\n";
+
+    if (stats.stats.empty())
+        cout << "  no ipmi driver counters found\n";
+
+    for (uint i = 0; i < stats.stats.size(); ++i) {
+        ipmistat& st = stats.stats[i];
+        printf("  %-18s %-26s %14llu %10llu %12.1f\n",
+               st.source.c_str(), st.name.c_str(),
+               st.value, st.delta, st.rate);
+    }
+    cout.flush();
+}
+
+/**************************************************************
+ * parmapp::dumpstats - one-shot dump of the driver counters
+ *
+ * Takes two samples secs apart, so the deltas and rates cover
+ * that interval.
+ */
+void parmapp::dumpstats(double secs)
+{
+    stats.sample();
+    usleep((useconds_t)(secs * 1000000));
+    stats.sample();
+    printf("\n  interval %.3f s\n\n", stats.interval);
+    showstats();
+}
+
+/**************************************************************
+ * parmapp::livestats - redraw the parameters and counters every
+ *                      secs seconds until the user presses q.
+ *
+ * + and - halve and double the sample rate. The terminal is put
+ * in non-canonical mode so a key press interrupts the wait right
+ * away instead of waiting for RETURN.
+ */
+void parmapp::livestats(double secs)
+{
+    struct termios saved;
+    struct termios raw;
+    bool tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+
+    if (tty) {
+        raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    stats.sample();
+
+    while (true) {
+        fd_set fds;
+        struct timeval tv;
+        char ch = 0;
+
+        tv.tv_sec = (time_t)secs;
+        tv.tv_usec = (suseconds_t)((secs - tv.tv_sec) * 1000000);
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+
+        if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0
+            && read(STDIN_FILENO, &ch, 1) != 1)
+            break;
+
+        if (ch == 'q')
+            break;
+        if (ch == '+' && secs > 0.1)
+            secs /= 2;
+        if (ch == '-' && secs < 60)
+            secs *= 2;
+        if (ch)
+            continue;
+
+        stats.sample();
+        cout << "\033[H\033[2J";
+        printf(" ipmi driver statistics every %.2f s"
+               "   (+ faster, - slower, q quit)\n\n", secs);
+        showstats();
+    }
+
+    if (tty)
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    cout << endl;
+}
+
+/**************************************************************
+ * parmapp::refresh - reread the values of the kmod parameters
+ *
+ * Unlike init_kmod, this reads the parameter files directly rather
+ * than through the shell, into a reused buffer, so it is cheap
+ * enough to call on every sample of the recorder and allocates
+ * nothing once the string values have settled.
+ */
+void parmapp::refresh()
+{
+    string_view text;
+    string_view val;
+
+    for (uint j = 0; j < kmods.size(); ++j) {
+        kmod& km = kmods[j];
+        for (uint k = 0; k < km.parms.size(); ++k) {
+            kmodparm& parm = km.parms[k];
+            if (!tf.setpath({sysroot, "module/", parm.kmodname,
+                             "/parameters/", parm.parmname})
+                || !tf.read(text))
+                continue;
+            if (parm.isstring) {
+                val = trim(nextline(text));
+                if (parm.strval != val)
+                    parm.strval.assign(val);
+            } else {
+                parseint(text, 10, parm.value);
+            }
+        }
+    }
+}
+
+/**************************************************************
+ * parmapp::recfields - names of the fields the recorder stores
+ *
+ * Every numeric kmod parameter, every driver counter and the cpu
+ * time of each kipmid thread. String parameters are left out;
+ * they are load-time settings like the interface type.
+ */
+void parmapp::recfields(vector<string>& fields)
+{
+    fields.clear();
+
+    for (uint j = 0; j < kmods.size(); ++j)
+        for (uint k = 0; k < kmods[j].parms.size(); ++k)
+            if (!kmods[j].parms[k].isstring)
+                fields.push_back(kmods[j].kmodname + "."
+                                 + kmods[j].parms[k].parmname);
+
+    for (uint i = 0; i < stats.stats.size(); ++i) {
+        string src = stats.stats[i].source;
+        for (uint c = 0; c < src.size(); ++c)
+            if (src[c] == ' ' || src[c] == ',')
+                src[c] = '_';
+        fields.push_back(src + "." + stats.stats[i].name);
+    }
+
+    for (uint i = 0; i < place.threads.size(); ++i)
+        fields.push_back(place.threads[i].comm + ".cpu_ticks");
+}
+
+/**************************************************************
+ * parmapp::recvalues - current values, in recfields order
+ *
+ */
+void parmapp::recvalues(vector<int64_t>& vals)
+{
+    uint n = 0;
+
+    for (uint j = 0; j < kmods.size(); ++j)
+        for (uint k = 0; k < kmods[j].parms.size(); ++k)
+            if (!kmods[j].parms[k].isstring)
+                vals[n++] = kmods[j].parms[k].value;
+
+    for (uint i = 0; i < stats.stats.size(); ++i)
+        vals[n++] = stats.stats[i].value;
+
+    for (uint i = 0; i < place.threads.size(); ++i)
+        vals[n++] = place.threads[i].ticks;
+}
+
+static volatile sig_atomic_t stoprecord = 0;
+
+static void onstop(int)
+{
+    stoprecord = 1;
+}
+
+/**************************************************************
+ * parmapp::record - snapshot the parameters, counters and kipmid
+ *                   cpu time into a ring file every secs seconds
+ *                   until SIGINT or SIGTERM.
+ *
+ * size is the ring size for a new file, or 0 for whatever an
+ * existing file has. The set of fields is fixed when recording
+ * starts. The loop does
+ * no allocation beyond the short-lived file streams and sleeps on
+ * absolute deadlines, so the samples don't drift.
+ *
+ * Returns 0 on a clean stop, else -1.
+ */
+int parmapp::record(string path, double secs, size_t size)
+{
+    ringfile rf;
+    vector<string> fields;
+    vector<int64_t> vals;
+    struct timespec next;
+    struct timespec now;
+
+    recfields(fields);
+    vals.resize(fields.size());
+
+    if (rf.create(path, fields, size) < 0) {
+        if (errno == EINVAL)
+            cerr << "ipmiparm: " << path << " exists and is not a ring"
+                 << " file; not overwriting it" << endl;
+        else if (errno == EEXIST && rf.ringsize())
+            cerr << "ipmiparm: " << path << " has a ring of "
+                 << rf.ringsize() / 1024 << " kbytes, not " << size / 1024
+                 << "; record into it with -n " << rf.ringsize() / 1024
+                 << " or without -n, or remove it first" << endl;
+        else
+            cerr << "ipmiparm: cannot create " << path << ": "
+                 << strerror(errno) << endl;
+        return -1;
+    }
+
+    signal(SIGINT, onstop);
+    signal(SIGTERM, onstop);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stoprecord) {
+        refresh();
+        stats.sample();
+        place.readticks();
+        recvalues(vals);
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        if (rf.append((int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000,
+                      vals) < 0) {
+            cerr << "ipmiparm: record does not fit in " << path << endl;
+            return -1;
+        }
+
+        next.tv_sec += (time_t)secs;
+        next.tv_nsec += (long)((secs - (time_t)secs) * 1e9);
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)
+               == EINTR && !stoprecord)
+            ;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * parmapp::exportcsv - print the recorded samples in a time range
+ *                      as CSV on stdout.
+ *
+ * from and to are in milliseconds since the epoch, 0 for no limit.
+ *
+ * Returns the number of rows, or -1 if the file can't be read.
+ */
+int parmapp::exportcsv(string path, int64_t from, int64_t to)
+{
+    ringfile rf;
+
+    if (rf.openread(path) < 0) {
+        cerr << "ipmiparm: cannot read " << path << ": "
+             << strerror(errno) << endl;
+        return -1;
+    }
+    return rf.exportcsv(cout, from, to);
+}
+
+/**************************************************************
+ * parmapp::putmetrics - the parameters, driver counters and kipmid
+ *                       cpu time as Prometheus metric families
+ *
+ * Numeric parameters are gauges, and string parameters a gauge of
+ * 1 carrying the value as a label, in the usual _info style. The
+ * driver counters only ever grow, so they are counters, and the
+ * cpu time is in seconds.
+ */
+void parmapp::putmetrics(metricfile& mf)
+{
+    static double hz = sysconf(_SC_CLK_TCK) > 0 ? sysconf(_SC_CLK_TCK) : 100;
+
+    mf.family("ipmi_kmod_parameter", "gauge",
+              "Numeric parameter of an ipmi kernel module.");
+    for (uint j = 0; j < kmods.size(); ++j)
+        for (uint k = 0; k < kmods[j].parms.size(); ++k) {
+            kmodparm& parm = kmods[j].parms[k];
+            if (parm.isstring)
+                continue;
+            mf.sample("ipmi_kmod_parameter");
+            mf.label("kmod", parm.kmodname);
+            mf.label("parameter", parm.parmname);
+            mf.value((long long)parm.value);
+        }
+
+    mf.family("ipmi_kmod_parameter_string_info", "gauge",
+              "String parameter of an ipmi kernel module, as a label.");
+    for (uint j = 0; j < kmods.size(); ++j)
+        for (uint k = 0; k < kmods[j].parms.size(); ++k) {
+            kmodparm& parm = kmods[j].parms[k];
+            if (!parm.isstring)
+                continue;
+            mf.sample("ipmi_kmod_parameter_string_info");
+            mf.label("kmod", parm.kmodname);
+            mf.label("parameter", parm.parmname);
+            mf.label("value", parm.strval);
+            mf.value(1LL);
+        }
+
+    mf.family("ipmi_driver_events_total", "counter",
+              "Event counter of the ipmi driver.");
+    for (uint i = 0; i < stats.stats.size(); ++i) {
+        mf.sample("ipmi_driver_events_total");
+        mf.label("source", stats.stats[i].source);
+        mf.label("counter", stats.stats[i].name);
+        mf.value((long long)stats.stats[i].value);
+    }
+
+    mf.family("ipmi_kipmid_cpu_seconds_total", "counter",
+              "CPU time used by a kipmid thread, in seconds.");
+    for (uint i = 0; i < place.threads.size(); ++i) {
+        mf.sample("ipmi_kipmid_cpu_seconds_total");
+        mf.label("thread", place.threads[i].comm);
+        mf.value(place.threads[i].ticks / hz);
+    }
+}
+
+/**************************************************************
+ * parmapp::exportmetrics - rewrite a Prometheus textfile for
+ *                          node_exporter every secs seconds until
+ *                          SIGINT or SIGTERM.
+ *
+ * Like the recorder, the loop rereads everything directly, with
+ * no shell, and sleeps on absolute deadlines. The text is built in
+ * the metricfile's reused buffer and renamed into place. A failed
+ * write is reported once and retried on the next interval.
+ *
+ * Returns 0 on a clean stop, else -1.
+ */
+int parmapp::exportmetrics(string path, double secs)
+{
+    metricfile mf;
+    struct timespec next;
+    bool failing = false;
+
+    if (mf.open(path) < 0) {
+        cerr << "ipmiparm: cannot write " << path << ": "
+             << strerror(errno) << endl;
+        return -1;
+    }
+
+    signal(SIGINT, onstop);
+    signal(SIGTERM, onstop);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stoprecord) {
+        refresh();
+        stats.sample();
+        place.readticks();
+
+        mf.begin();
+        putmetrics(mf);
+        if (mf.commit() < 0) {
+            if (!failing)
+                cerr << "ipmiparm: cannot write " << path << ": "
+                     << strerror(errno) << endl;
+            failing = true;
+        } else
+            failing = false;
+
+        next.tv_sec += (time_t)secs;
+        next.tv_nsec += (long)((secs - (time_t)secs) * 1e9);
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)
+               == EINTR && !stoprecord)
+            ;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * parmapp::snapshot - write every kmod parameter, with this host's
+ *                     identity, to a binary snapshot
+ *
+ * Snapshots from a fleet are compared offline by parmdrift.
+ *
+ * Returns 0 on success, else -1.
+ */
+int parmapp::snapshot(string path)
+{
+    vector<snapparm> parms;
+
+    for (uint j = 0; j < kmods.size(); ++j) {
+        kmod& km = kmods[j];
+        for (uint k = 0; k < km.parms.size(); ++k) {
+            snapparm sp;
+            sp.name = km.kmodname + "." + km.parms[k].parmname;
+            sp.isstring = km.parms[k].isstring;
+            sp.value = km.parms[k].value;
+            sp.strval = km.parms[k].strval;
+            parms.push_back(sp);
+        }
+    }
+
+    if (snapfile::create(path, parms) < 0) {
+        cerr << "ipmiparm: cannot write " << path << ": "
+             << strerror(errno) << endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * parmapp::reload - reload kmods to give them new load-time
+ *                   parameters
+ *
+ * opts maps a kmod to its new options, "parm=value" each. The plan
+ * is printed and, with ask, run only if the user says so. The
+ * reload resets the runtime parameters of every kmod it touches,
+ * so those are written back afterwards, and the kipmid threads
+ * and counters, which are new, are looked up again.
+ *
+ * Returns 0 if the kmods were reloaded, 1 if the user declined,
+ * else -1.
+ */
+int parmapp::reload(const modopts& opts, bool ask)
+{
+    modreload mr;
+    vector<kmodparm> keep;
+    int rc;
+
+    rc = mr.plan(opts);
+    mr.showplan(cout);
+    if (rc < 0)
+        return -1;
+
+    if (ask) {
+        string ans = getstr("\n  Reload now? [y/N]: ", "n");
+        if (ans != "y" && ans != "Y")
+            return 1;
+    }
+    cout << endl;
+
+    for (uint i = 0; i < mr.unload.size(); ++i)
+        for (uint j = 0; j < kmods.size(); ++j)
+            if (kmods[j].kmodname == mr.unload[i].kmod)
+                for (uint k = 0; k < kmods[j].parms.size(); ++k)
+                    if (kmods[j].parms[k].writable)
+                        keep.push_back(kmods[j].parms[k]);
+
+    rc = mr.run();
+    mr.report(cout);
+
+    refresh();
+    for (uint i = 0; i < keep.size(); ++i) {
+        kmodparm *parm = findparm(keep[i].kmodname, keep[i].parmname);
+        if (parm == NULL || (parm->isstring ? parm->strval == keep[i].strval
+                                            : parm->value == keep[i].value))
+            continue;
+        parm->value = keep[i].value;
+        parm->strval = keep[i].strval;
+        if (writeparm(*parm))
+            cout << "  Cannot restore " << parm->kmodname << "."
+                 << parm->parmname << endl;
+    }
+    place.discover();
+    stats.discover();
+
+    return rc;
+}
+
 /**************************************************************
  * parmapp::showmenu - top level menu
  *
@@ -599,7 +1470,11 @@ void parmapp::showmenu()
     for (uint i = 0; i < kmods.size(); ++i)
         printf("  %d  %s\n", i, kmods[i].kmodname.c_str());
 
-    cout << "\n  r  switch radix. Current input radix: "
+    cout << "\n  c  live driver statistics\n";
+    cout << "  p  kipmid and IPMI IRQ placement\n";
+    cout << "  s  save settings to a file\n";
+    cout << "  l  load settings from a file\n";
+    cout << "  r  switch radix. Current input radix: "
          << getradixstr() << endl;
     cout << "  q  quit\n\n";
     cout << "  Select a kmod to access its parameters: ";
@@ -613,6 +1488,9 @@ void parmapp::showmenu()
 void parmapp::getmenu()
 {
     char ch;
+    string str;
+    double secs;
+    string path = "/etc/ipmiparm.conf";
 
     while (true) {
         showmenu();
@@ -621,6 +1499,29 @@ void parmapp::getmenu()
         switch (ch) {
         case 'q': cout << endl; return;
         case 'r': toggleradix(); break;
+        case 'c':
+            cout << endl;
+            str = getstr("  Sample interval in seconds [1]: ", "1");
+            secs = atof(str.c_str());
+            livestats(secs > 0.0 ? secs : 1.0);
+            continue;
+        case 'p':
+            cout << endl << endl;
+            getplacemenu();
+            continue;
+        case 's':
+            cout << endl;
+            path = getstr("  Save to [" + path + "]: ", path);
+            if (save(path))
+                cout << "  Cannot write " << path << endl;
+            continue;
+        case 'l':
+            cout << endl;
+            path = getstr("  Load from [" + path + "]: ", path);
+            if (load(path))
+                cout << "  Some settings in " << path
+                     << " could not be applied" << endl;
+            continue;
         }
 
         int i = toxint(ch);
@@ -637,10 +1538,155 @@ void parmapp::getmenu()
 /**************************************************************
 ** main - the main program
 ***************************************************************/
-//int main(int argc, char** argv)
-int main()
+// the characters of a kmod name, for -M
+//
+static const char kmodchars[] = "abcdefghijklmnopqrstuvwxyz"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-";
+
+void usage()
+{
+    cout << "usage: ipmiparm [--timing] [-l file] [-c|-w] [-i secs]\n"
+         << "       ipmiparm -R file [-i secs] [-n kbytes]\n"
+         << "       ipmiparm -X file [-f from] [-t to]\n"
+         << "       ipmiparm -S file\n"
+         << "       ipmiparm -O file [-i secs]\n"
+         << "       ipmiparm -M kmod.parm=value [-M ...] [-y]\n\n"
+         << "  -l file  apply settings saved from the menu and exit\n"
+         << "  -c       dump the driver counters once and exit\n"
+         << "  -w       watch the driver counters live\n"
+         << "  -i secs  sample interval for -c, -w, -R and -O, default 1\n"
+         << "  -R file  record parameters, counters and kipmid cpu time\n"
+         << "           into a ring file until stopped\n"
+         << "  -n kb    ring size of the recording, default 1024 for a\n"
+         << "           new one; must match an existing one's\n"
+         << "  -X file  export a recording as CSV\n"
+         << "  -f from  first time to export, in seconds since the epoch\n"
+         << "  -t to    last time to export, in seconds since the epoch\n"
+         << "  -S file  write a binary snapshot of the parameters for\n"
+         << "           parmdrift and exit\n"
+         << "  -O file  rewrite file every interval with the parameters,\n"
+         << "           counters and kipmid cpu time in Prometheus text\n"
+         << "           format, for the node_exporter textfile collector,\n"
+         << "           until stopped\n"
+         << "  -M kmod.parm=value\n"
+         << "           reload kmod, and the kmods holding it, with a new\n"
+         << "           load-time parameter; prints the plan and asks\n"
+         << "  -y       reload without asking\n"
+         << "  --timing print where the time went, by phase, at exit\n";
+    exit(2);
+}
+
+int main(int argc, char** argv)
 {
     string version = "v1.0";
+    string loadfile;
+    string recfile;
+    string str;
+    char mode = 0;
+    double secs = 1.0;
+    long kbytes = 0;        // 0: existing ring's size, else the default
+    int64_t from = 0;
+    int64_t to = 0;
+    modopts reloadopts;
+    bool yes = false;
+    size_t dot;
+    int opt;
+    int i, j;
+
+    // --timing has no short form, so take it out before getopt.
+    //
+    for (i = j = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--timing") == 0)
+            TRACE_REPORT_AT_EXIT();
+        else
+            argv[j++] = argv[i];
+    }
+    argc = j;
+
+    while ((opt = getopt(argc, argv, "l:cwi:R:X:S:O:n:f:t:M:y")) != -1) {
+        switch (opt) {
+        case 'l': loadfile = optarg; break;
+        case 'c':
+        case 'w': mode = opt; break;
+        case 'i': secs = atof(optarg); break;
+        case 'R':
+        case 'X':
+        case 'S':
+        case 'O': mode = opt; recfile = optarg; break;
+        case 'n':
+            if ((kbytes = atol(optarg)) <= 0)
+                usage();
+            break;
+        case 'f': from = (int64_t)(atof(optarg) * 1000); break;
+        case 't': to = (int64_t)(atof(optarg) * 1000); break;
+        case 'M':
+            // The kmod name goes to modprobe and into /sys/module
+            // paths, so only a real module name is taken.
+            //
+            str = optarg;
+            dot = str.find('.');
+            if (dot == 0 || dot == string::npos
+                || str.find_first_not_of(kmodchars) != dot
+                || str.find('=', dot) == string::npos
+                || str.find('=', dot) == dot + 1)
+                usage();
+            reloadopts[str.substr(0, dot)].push_back(str.substr(dot + 1));
+            break;
+        case 'y': yes = true; break;
+        default : usage();
+        }
+    }
+
+    if (secs <= 0.0)
+        usage();
+
+    if (mode == 'X') {
+        return parmapp::exportcsv(recfile, from, to) < 0 ? 1 : 0;
+    }
+
+    if (mode == 'R') {
+        parmapp pa;
+        return pa.record(recfile, secs, kbytes * 1024) < 0 ? 1 : 0;
+    }
+
+    if (mode == 'O') {
+        parmapp pa;
+        return pa.exportmetrics(recfile, secs) < 0 ? 1 : 0;
+    }
+
+    if (!reloadopts.empty()) {
+        parmapp pa;
+        return pa.reload(reloadopts, !yes) != 0 ? 1 : 0;
+    }
+
+    if (mode == 'S') {
+        parmapp pa;
+        return pa.snapshot(recfile) < 0 ? 1 : 0;
+    }
+
+    // ipmiparm -l <file> applies saved settings without the menus,
+    // e.g. from a boot script.
+    //
+    if (!loadfile.empty()) {
+        parmapp pa;
+        int errs = pa.load(loadfile);
+        if (errs)
+            cerr << "ipmiparm: " << (errs < 0 ? "cannot read " : "errors applying ")
+                 << loadfile << endl;
+        return errs ? 1 : 0;
+    }
+
+    if (mode == 'c') {
+        parmapp pa;
+        pa.dumpstats(secs);
+        return 0;
+    }
+
+    if (mode == 'w') {
+        parmapp pa;
+        pa.livestats(secs);
+        return 0;
+    }
 
     cout << "\nipmiparm " << version << " ipmi kmod parameter manager\n";
 
@@ -648,4 +1694,3 @@ int main()
     pa.getmenu();
     return 0;
 }
-
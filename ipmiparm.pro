@@ -2,9 +2,32 @@ TEMPLATE = app
 CONFIG += console
 CONFIG -= app_bundle
 CONFIG -= qt
+CONFIG += c++17
 
 SOURCES += \
-    ipmiparm.cpp
+    ipmiparm.cpp \
+    placement.cpp \
+    ipmistats.cpp \
+    ringfile.cpp \
+    snapfile.cpp \
+    modreload.cpp \
+    parmfmt.cpp \
+    metricfile.cpp \
+    iptrace.c
+
+HEADERS += \
+    placement.h \
+    ipmistats.h \
+    ringfile.h \
+    snapfile.h \
+    modreload.h \
+    parmfmt.h \
+    metricfile.h \
+    iptrace.h
+
+# per-phase timing for --timing
+#
+#DEFINES += IPMI_TRACE
 
 INCLUDEPATH += $$PWD/
 DEPENDPATH += $$PWD/
@@ -0,0 +1,149 @@
+/*
+ * ipmipub.h - BMC data published in shared memory by ipmipubd
+ *
+ * ipmipubd owns the IPMI session on a host. It refreshes the board's
+ * location, the BMC's Get Device ID answer and a set of sensors on a
+ * schedule, and publishes them in the POSIX shared memory segment
+ * IPMIPUB_NAME, so any number of local agents can read them without
+ * touching the BMC.
+ *
+ * The segment is guarded by a sequence lock. The writer makes seq odd,
+ * copies in the new data and makes it even again; a reader copies the
+ * data out between two reads of seq and keeps the copy if seq was even
+ * and unchanged. Once the segment is mapped, ipmipub_read takes a
+ * snapshot with no system calls and no locks, and the writer never
+ * waits for readers. A reader only retries if an update landed during
+ * its copy, which at one update every few seconds is rare, and gives
+ * up after IPMIPUB_RETRIES.
+ *
+ *	struct ipmipub *pub = ipmipub_open();
+ *	struct ipmipub_data d;
+ *
+ *	if (pub && ipmipub_read(pub, &d) == 0)
+ *		printf("slot %d\n", d.slot);
+ */
+
+#ifndef IPMIPUB_H
+#define IPMIPUB_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define IPMIPUB_NAME		"/ipmipub"
+#define IPMIPUB_MAGIC		0x314255504d495049ull	/* "IPMIPUB1" */
+#define IPMIPUB_VERSION		1
+#define IPMIPUB_MAXSENSORS	64
+#define IPMIPUB_RETRIES		1000
+
+struct ipmipub_sensor {
+	char		id[17];
+	uint8_t		number;
+	uint8_t		units;		/* base unit code, see sdr_unit */
+	uint8_t		status;		/* SDR_* threshold bits */
+	uint8_t		flags;		/* SDR_UNAVAILABLE, SDR_NOT_READ */
+	float		value;
+};
+
+struct ipmipub_data {
+	uint64_t	generation;	/* bumped on every update */
+	int64_t		location_ns;	/* CLOCK_REALTIME of each refresh, */
+	int64_t		devid_ns;	/*   0 if never done */
+	int64_t		sensors_ns;
+
+	int32_t		location_ok;
+	int32_t		rack;
+	int32_t		subrack;
+	int32_t		slot;
+
+	int32_t		devid_len;
+	uint8_t		devid[20];	/* Get Device ID response, less the cc */
+
+	int32_t		nsensors;
+	struct ipmipub_sensor sensors[IPMIPUB_MAXSENSORS];
+};
+
+struct ipmipub {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	size;		/* sizeof(struct ipmipub) */
+	int32_t		pid;		/* of the writer */
+	uint32_t	seq;		/* odd while an update is in progress */
+	char		pad[40];	/* keep seq off the data's cache lines */
+	struct ipmipub_data d;
+};
+
+static inline void ipmipub_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/*
+ * Map the segment read-only. Returns NULL if ipmipubd isn't running,
+ * or is a different version.
+ */
+static inline struct ipmipub *ipmipub_open(void)
+{
+	struct ipmipub *p;
+	int fd = shm_open(IPMIPUB_NAME, O_RDONLY, 0);
+
+	if (fd < 0)
+		return NULL;
+	p = (struct ipmipub *)mmap(NULL, sizeof(*p), PROT_READ, MAP_SHARED,
+				   fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	if (p->magic != IPMIPUB_MAGIC || p->version != IPMIPUB_VERSION
+	    || p->size != sizeof(*p)) {
+		munmap(p, sizeof(*p));
+		return NULL;
+	}
+	return p;
+}
+
+/*
+ * Copy a consistent snapshot of the published data into *out.
+ * Returns 0, or -1 if the writer kept updating for IPMIPUB_RETRIES
+ * tries in a row.
+ */
+static inline int ipmipub_read(const struct ipmipub *p,
+			       struct ipmipub_data *out)
+{
+	uint32_t s1, s2;
+	int tries;
+
+	for (tries = 0; tries < IPMIPUB_RETRIES; tries++) {
+		s1 = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+		if (s1 & 1) {
+			ipmipub_relax();
+			continue;
+		}
+		memcpy(out, (const void *)&p->d, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&p->seq, __ATOMIC_RELAXED);
+		if (s1 == s2)
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * Writer side, for ipmipubd.
+ */
+static inline void ipmipub_write(struct ipmipub *p,
+				 const struct ipmipub_data *in)
+{
+	uint32_t s = p->seq;
+
+	__atomic_store_n(&p->seq, s + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy((void *)&p->d, in, sizeof(*in));
+	__atomic_store_n(&p->seq, s + 2, __ATOMIC_RELEASE);
+}
+
+#endif /* IPMIPUB_H */
@@ -0,0 +1,342 @@
+/*
+ * ipmipubd - publish BMC data in shared memory for local readers
+ *
+ * Owns the host's IPMI session so the agents on it don't each query
+ * the BMC. Every -l seconds it refreshes the board location by running
+ * getInfoIPMI, every -d seconds the BMC's Get Device ID answer, and
+ * every -S seconds the sensors given with -s (all of them, up to 64,
+ * if none are). Each refresh is published in the ipmipub segment; see
+ * ipmipub.h for how readers take snapshots.
+ *
+ * ipmipubd -r prints the current snapshot, for scripts.
+ *
+ *	$ gcc -O2 -o ipmipubd ipmipubd.c ipmisdr.c sdrconv.c ipmicmd.c \
+ *		iptrace.c -lm -lrt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ipmicmd.h"
+#include "ipmisdr.h"
+#include "ipmipub.h"
+
+#define IPMI_NETFN_APP		0x06
+#define IPMI_GET_DEVICE_ID	0x01
+
+static volatile sig_atomic_t stop;
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int64_t mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t real_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct ipmipub *create(void)
+{
+	struct ipmipub *p;
+	int fd = shm_open(IPMIPUB_NAME, O_CREAT | O_RDWR, 0644);
+
+	if (fd < 0)
+		return NULL;
+	if (ftruncate(fd, sizeof(*p)) < 0) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, sizeof(*p), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	// readers check the magic, so set it last
+	//
+	__atomic_store_n(&p->magic, 0, __ATOMIC_RELAXED);
+	memset(&p->d, 0, sizeof(p->d));
+	p->version = IPMIPUB_VERSION;
+	p->size = sizeof(*p);
+	p->pid = getpid();
+	p->seq &= ~1u;
+	__atomic_store_n(&p->magic, IPMIPUB_MAGIC, __ATOMIC_RELEASE);
+	return p;
+}
+
+/*
+ * Run getInfoIPMI for the cabinet, chassis and slot.
+ */
+static int refresh_location(const char *getinfo, struct ipmipub_data *d)
+{
+	char cmd[300], line[100];
+	int rack = -1, subrack = -1, slot = -1;
+	FILE *fp;
+
+	snprintf(cmd, sizeof(cmd), "%s -b -c -s 2>/dev/null", getinfo);
+	if ((fp = popen(cmd, "r")) == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		sscanf(line, "CABINETID=%d", &rack);
+		sscanf(line, "CHASSISID=%d", &subrack);
+		sscanf(line, "SLOTID=%d", &slot);
+	}
+	if (pclose(fp) != 0 || rack < 0 || subrack < 0 || slot < 0)
+		return -1;
+
+	d->rack = rack;
+	d->subrack = subrack;
+	d->slot = slot;
+	d->location_ok = 1;
+	d->location_ns = real_ns();
+	return 0;
+}
+
+static int refresh_devid(int fd, struct ipmipub_data *d)
+{
+	uchar rsp[40];
+	int rlen;
+
+	if (ipmicmd_fd(fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE, IPMI_GET_DEVICE_ID,
+		       IPMI_NETFN_APP, 0, NULL, 0, rsp, sizeof(rsp), &rlen) < 0
+	    || rlen < 2 || rsp[0] != 0)
+		return -1;
+
+	d->devid_len = rlen - 1 < (int)sizeof(d->devid)
+		     ? rlen - 1 : (int)sizeof(d->devid);
+	memcpy(d->devid, rsp + 1, d->devid_len);
+	d->devid_ns = real_ns();
+	return 0;
+}
+
+static int refresh_sensors(int fd, struct sdr_repo *r, struct ipmipub_data *d)
+{
+	uint8_t raw[IPMIPUB_MAXSENSORS], flags[IPMIPUB_MAXSENSORS];
+	uint8_t status[IPMIPUB_MAXSENSORS];
+	float y[IPMIPUB_MAXSENSORS];
+	int i;
+
+	sdr_read_sensors(fd, r, raw, flags);
+	sdr_convert(&r->soa, raw, y, status);
+
+	d->nsensors = r->n;
+	for (i = 0; i < r->n; i++) {
+		struct ipmipub_sensor *s = &d->sensors[i];
+
+		memcpy(s->id, r->sensors[i].id, sizeof(s->id));
+		s->number = r->sensors[i].number;
+		s->units = r->sensors[i].units;
+		s->status = status[i];
+		s->flags = flags[i];
+		s->value = y[i];
+	}
+	d->sensors_ns = real_ns();
+	return 0;
+}
+
+/*
+ * Keep only the sensors listed in sel, a comma separated list of
+ * sensor numbers, or the first IPMIPUB_MAXSENSORS if sel is NULL.
+ */
+static int select_sensors(const struct sdr_repo *all, const char *sel,
+			  struct sdr_repo *r)
+{
+	uint8_t want[256];
+	const char *p;
+	int i;
+
+	memset(want, sel == NULL, sizeof(want));
+	for (p = sel; p && *p; ) {
+		char *end;
+		long n = strtol(p, &end, 0);
+
+		if (end == p || n < 0 || n > 255)
+			return -1;
+		want[n] = 1;
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	if (sdr_repo_init(r) < 0)
+		return -1;
+	for (i = 0; i < all->n && r->n < IPMIPUB_MAXSENSORS; i++)
+		if (want[all->sensors[i].number]
+		    && sdr_repo_take(r, all, i) < 0)
+			return -1;
+	return r->n;
+}
+
+static int readmode(void)
+{
+	struct ipmipub *p = ipmipub_open();
+	struct ipmipub_data d;
+	int64_t now = real_ns();
+	int i;
+
+	if (p == NULL) {
+		fprintf(stderr, "ipmipubd: no %s segment; is ipmipubd running?\n",
+			IPMIPUB_NAME);
+		return 1;
+	}
+	if (ipmipub_read(p, &d) < 0) {
+		fprintf(stderr, "ipmipubd: segment busy\n");
+		return 1;
+	}
+
+	printf("generation %llu, writer pid %d\n",
+	       (unsigned long long)d.generation, p->pid);
+	if (d.location_ok)
+		printf("CABINETID=%d\nCHASSISID=%d\nSLOTID=%d\n"
+		       "location age %.1f s\n", d.rack, d.subrack, d.slot,
+		       (now - d.location_ns) / 1e9);
+	if (d.devid_len >= 5)
+		printf("device id 0x%02x rev 0x%02x firmware %d.%02x ipmi %d.%d"
+		       ", age %.1f s\n", d.devid[0], d.devid[1] & 0x0f,
+		       d.devid[2] & 0x7f, d.devid[3], d.devid[4] & 0x0f,
+		       d.devid[4] >> 4, (now - d.devid_ns) / 1e9);
+	if (d.nsensors)
+		printf("%d sensors, age %.1f s\n", d.nsensors,
+		       (now - d.sensors_ns) / 1e9);
+	for (i = 0; i < d.nsensors; i++) {
+		struct ipmipub_sensor *s = &d.sensors[i];
+
+		printf("%3d  %-16s ", s->number, s->id);
+		if (s->flags || s->status & SDR_INVALID)
+			printf("%12s\n", "-");
+		else
+			printf("%12.3f  %-14s  0x%02x\n", s->value,
+			       sdr_unit(s->units), s->status);
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: ipmipubd [-l secs] [-d secs] [-S secs] [-s sensors]"
+		" [-g getInfoIPMI] [-v]\n"
+		"       ipmipubd -r\n\n"
+		"  -l secs     location refresh, default 300\n"
+		"  -d secs     device id refresh, default 300\n"
+		"  -S secs     sensor refresh, default 10\n"
+		"  -s list     sensor numbers to publish, e.g. 0x30,0x31;"
+		" default all\n"
+		"  -g path     getInfoIPMI to run for the location\n"
+		"  -r          print the published snapshot and exit\n"
+		"  -v          verbose\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *getinfo = "getInfoIPMI";
+	const char *sel = NULL;
+	int lsecs = 300, dsecs = 300, ssecs = 10;
+	struct sdr_repo all, repo;
+	struct ipmipub_data d;
+	struct ipmipub *pub;
+	int64_t lnext, dnext, snext, next;
+	int fd, opt;
+
+	strncpy(toolname, "ipmipubd", sizeof(toolname) - 1);
+
+	while ((opt = getopt(argc, argv, "l:d:S:s:g:rv")) != -1) {
+		switch (opt) {
+		case 'l': lsecs = atoi(optarg); break;
+		case 'd': dsecs = atoi(optarg); break;
+		case 'S': ssecs = atoi(optarg); break;
+		case 's': sel = optarg; break;
+		case 'g': getinfo = optarg; break;
+		case 'r': return readmode();
+		case 'v': Verbose = 1; break;
+		default: usage();
+		}
+	}
+	if (lsecs <= 0 || dsecs <= 0 || ssecs <= 0)
+		usage();
+
+	if ((fd = ipmi_open()) < 0)
+		return 1;
+
+	repo.n = 0;
+	if (sdr_repo_init(&all) < 0 || sdr_read_repo(fd, &all) < 0
+	    || select_sensors(&all, sel, &repo) < 0) {
+		fprintf(stderr, "ipmipubd: cannot read the sensors; publishing"
+			" without them\n");
+		repo.n = 0;
+	}
+
+	if ((pub = create()) == NULL) {
+		perror("ipmipubd: " IPMIPUB_NAME);
+		return 1;
+	}
+
+	signal(SIGINT, onstop);
+	signal(SIGTERM, onstop);
+
+	memset(&d, 0, sizeof(d));
+	lnext = dnext = snext = mono_ns();
+
+	while (!stop) {
+		int64_t now = mono_ns();
+		int changed = 0;
+
+		if (now >= lnext) {
+			if (refresh_location(getinfo, &d) < 0 && Verbose)
+				fprintf(stderr, "ipmipubd: %s failed\n", getinfo);
+			lnext = now + lsecs * 1000000000LL;
+			changed = 1;
+		}
+		if (now >= dnext) {
+			if (refresh_devid(fd, &d) < 0 && Verbose)
+				fprintf(stderr, "ipmipubd: Get Device ID failed\n");
+			dnext = now + dsecs * 1000000000LL;
+			changed = 1;
+		}
+		if (repo.n && now >= snext) {
+			refresh_sensors(fd, &repo, &d);
+			snext = now + ssecs * 1000000000LL;
+			changed = 1;
+		}
+
+		if (changed) {
+			d.generation++;
+			ipmipub_write(pub, &d);
+		}
+
+		next = lnext < dnext ? lnext : dnext;
+		if (repo.n && snext < next)
+			next = snext;
+		{
+			struct timespec ts = {
+				.tv_sec = next / 1000000000,
+				.tv_nsec = next % 1000000000,
+			};
+
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+	}
+
+	shm_unlink(IPMIPUB_NAME);
+	close(fd);
+	return 0;
+}
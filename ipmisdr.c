@@ -0,0 +1,293 @@
+/*
+ * ipmisdr.c - threshold sensors from the BMC's SDR repository, see
+ *	       ipmisdr.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ipmicmd.h"
+#include "ipmisdr.h"
+
+#define CC_RES_CANCELLED	0xc5	/* reservation lost, reserve again */
+#define CC_CANT_RETURN		0xca	/* fewer bytes, please */
+#define SDR_CHUNK		16	/* Get SDR bytes per request */
+#define SDR_LAST		0xffff
+
+int sdr_repo_init(struct sdr_repo *r)
+{
+	r->n = 0;
+	r->sensors = NULL;
+	return sdr_soa_init(&r->soa, 64);
+}
+
+void sdr_repo_free(struct sdr_repo *r)
+{
+	free(r->sensors);
+	r->sensors = NULL;
+	r->n = 0;
+	sdr_soa_free(&r->soa);
+}
+
+static int sext(int v, int bits)
+{
+	int m = 1 << (bits - 1);
+
+	return (v ^ m) - m;
+}
+
+/*
+ * Add the sensor in one SDR record, as read from the repository or a
+ * saved copy. Records other than full sensor records are skipped.
+ *
+ * Returns 1 if a sensor was added, 0 if skipped, -1 on error.
+ */
+int sdr_parse_record(struct sdr_repo *r, const uint8_t *rec, int len)
+{
+	struct sdr_sensor *sn;
+	uint8_t raw[SDR_NTHRESH];
+	unsigned readable = 0;
+	int idlen, i;
+
+	if (len < 48 || rec[3] != SDR_FULL_SENSOR)
+		return 0;
+
+	if (r->n % 64 == 0) {
+		sn = realloc(r->sensors, (r->n + 64) * sizeof(*sn));
+		if (sn == NULL)
+			return -1;
+		r->sensors = sn;
+	}
+
+	// only threshold sensors have thresholds to read
+	//
+	if (rec[13] == 0x01)
+		readable = rec[18] & 0x3f;
+
+	raw[SDR_T_LNC] = rec[41];
+	raw[SDR_T_LCR] = rec[40];
+	raw[SDR_T_LNR] = rec[39];
+	raw[SDR_T_UNC] = rec[38];
+	raw[SDR_T_UCR] = rec[37];
+	raw[SDR_T_UNR] = rec[36];
+
+	if (sdr_soa_add(&r->soa,
+			sext(rec[24] | (rec[25] >> 6) << 8, 10),
+			sext(rec[26] | (rec[27] >> 6) << 8, 10),
+			sext(rec[29] & 0x0f, 4), sext(rec[29] >> 4, 4),
+			rec[20] >> 6, rec[23] & 0x7f, raw, readable) < 0)
+		return -1;
+
+	sn = &r->sensors[r->n++];
+	memset(sn, 0, sizeof(*sn));
+	sn->recid  = rec[0] | rec[1] << 8;
+	sn->owner  = rec[5];
+	sn->lun    = rec[6] & 0x03;
+	sn->number = rec[7];
+	sn->type   = rec[12];
+	sn->evtype = rec[13];
+	sn->units  = rec[21];
+
+	idlen = rec[47] & 0x1f;
+	if (idlen > len - 48)
+		idlen = len - 48;
+	if (idlen > (int)sizeof(sn->id) - 1)
+		idlen = sizeof(sn->id) - 1;
+	for (i = 0; i < idlen; i++)
+		sn->id[i] = isprint(rec[48 + i]) ? rec[48 + i] : '.';
+
+	return 1;
+}
+
+/*
+ * Append sensor i of src to r. Returns 0, or -1 if out of memory.
+ */
+int sdr_repo_take(struct sdr_repo *r, const struct sdr_repo *src, int i)
+{
+	struct sdr_sensor *sn;
+
+	if (r->n % 64 == 0) {
+		sn = realloc(r->sensors, (r->n + 64) * sizeof(*sn));
+		if (sn == NULL)
+			return -1;
+		r->sensors = sn;
+	}
+	if (sdr_soa_take(&r->soa, &src->soa, i) < 0)
+		return -1;
+	r->sensors[r->n++] = src->sensors[i];
+	return 0;
+}
+
+static int reserve(int fd, uint16_t *resid)
+{
+	uchar rsp[8];
+	int rlen;
+
+	if (ipmicmd_fd(fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE, IPMI_RESERVE_SDR,
+		       IPMI_NETFN_STORAGE, 0, NULL, 0, rsp, sizeof(rsp),
+		       &rlen) < 0 || rlen < 3 || rsp[0] != 0)
+		return -1;
+	*resid = rsp[1] | rsp[2] << 8;
+	return 0;
+}
+
+/*
+ * Read cnt bytes at off in record id into buf with Get SDR, reserving
+ * again if the reservation was lost. Sets *next to the following
+ * record's id. Returns the bytes read, or -1.
+ */
+static int get_sdr(int fd, uint16_t *resid, uint16_t id, int off, int cnt,
+		   uint8_t *buf, uint16_t *next, int *chunk)
+{
+	uchar req[6];
+	uchar rsp[3 + 64];
+	int rlen, tries;
+
+	for (tries = 0; tries < 4; tries++) {
+		int n = cnt < *chunk ? cnt : *chunk;
+
+		req[0] = *resid & 0xff;
+		req[1] = *resid >> 8;
+		req[2] = id & 0xff;
+		req[3] = id >> 8;
+		req[4] = off;
+		req[5] = n;
+		if (ipmicmd_fd(fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE, IPMI_GET_SDR,
+			       IPMI_NETFN_STORAGE, 0, req, sizeof(req), rsp,
+			       sizeof(rsp), &rlen) < 0 || rlen < 1)
+			return -1;
+
+		if (rsp[0] == CC_RES_CANCELLED) {
+			if (reserve(fd, resid) < 0)
+				return -1;
+			continue;
+		}
+		if (rsp[0] == CC_CANT_RETURN && *chunk > SDR_HEADER) {
+			/* never below the record header read in one go */
+			*chunk /= 2;
+			if (*chunk < SDR_HEADER)
+				*chunk = SDR_HEADER;
+			continue;
+		}
+		if (rsp[0] != 0 || rlen < 3)
+			return -1;
+
+		*next = rsp[1] | rsp[2] << 8;
+		if (rlen - 3 < n)
+			n = rlen - 3;
+		memcpy(buf, rsp + 3, n);
+		return n;
+	}
+	return -1;
+}
+
+/*
+ * Read every full sensor record in the repository into r.
+ *
+ * Returns the number of sensors, or -1.
+ */
+int sdr_read_repo(int fd, struct sdr_repo *r)
+{
+	uint8_t rec[SDR_HEADER + 255];
+	uint16_t resid, id = 0, next;
+	int chunk = SDR_CHUNK;
+	int len, off, n;
+
+	if (reserve(fd, &resid) < 0) {
+		fprintf(stderr, "%s: Error: Reserve SDR Repository failed\n",
+			toolname);
+		return -1;
+	}
+
+	while (id != SDR_LAST) {
+		if (get_sdr(fd, &resid, id, 0, SDR_HEADER, rec, &next,
+			    &chunk) != SDR_HEADER)
+			goto fail;
+
+		len = SDR_HEADER + rec[4];
+		for (off = SDR_HEADER; off < len; off += n) {
+			n = get_sdr(fd, &resid, id, off, len - off, rec + off,
+				    &next, &chunk);
+			if (n <= 0)
+				goto fail;
+		}
+
+		if (sdr_parse_record(r, rec, len) < 0)
+			return -1;
+
+		if (next == id)
+			break;
+		id = next;
+	}
+	return r->n;
+
+fail:
+	fprintf(stderr, "%s: Error: Get SDR failed at record 0x%04x\n",
+		toolname, id);
+	return -1;
+}
+
+/*
+ * Get Sensor Reading for every sensor in r, into raw[i], with
+ * flags[i] zero if the reading is good. Sensors owned by a controller
+ * other than the BMC would need bridging, and are marked not read.
+ *
+ * Returns the number of good readings.
+ */
+int sdr_read_sensors(int fd, const struct sdr_repo *r,
+		     uint8_t *raw, uint8_t *flags)
+{
+	uchar req[1], rsp[8];
+	int i, rlen, good = 0;
+
+	for (i = 0; i < r->n; i++) {
+		const struct sdr_sensor *sn = &r->sensors[i];
+
+		raw[i] = 0;
+		flags[i] = SDR_NOT_READ;
+		if (sn->owner != IPMI_BMC_SLAVE_ADDR)
+			continue;
+
+		req[0] = sn->number;
+		if (ipmicmd_fd(fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+			       IPMI_GET_SENSOR_READING, IPMI_NETFN_SENSOR,
+			       sn->lun, req, 1, rsp, sizeof(rsp), &rlen) < 0
+		    || rlen < 3 || rsp[0] != 0)
+			continue;
+
+		raw[i] = rsp[1];
+		if ((rsp[2] & 0x20) || !(rsp[2] & 0x40)) {
+			flags[i] = SDR_UNAVAILABLE;
+			continue;
+		}
+		flags[i] = 0;
+		good++;
+	}
+	return good;
+}
+
+/*
+ * The name of a sensor units 2 base unit code, for the common ones.
+ */
+const char *sdr_unit(int code)
+{
+	switch (code) {
+	case 0:  return "";
+	case 1:  return "degrees C";
+	case 2:  return "degrees F";
+	case 3:  return "degrees K";
+	case 4:  return "Volts";
+	case 5:  return "Amps";
+	case 6:  return "Watts";
+	case 7:  return "Joules";
+	case 17: return "CFM";
+	case 18: return "RPM";
+	case 19: return "Hz";
+	case 20: return "microseconds";
+	case 21: return "milliseconds";
+	case 22: return "seconds";
+	default: return "units";
+	}
+}
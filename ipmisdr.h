@@ -0,0 +1,56 @@
+/*
+ * ipmisdr.h - threshold sensors from the BMC's SDR repository
+ *
+ * sdr_read_repo walks the repository with Reserve SDR Repository and
+ * Get SDR over an open /dev/ipmi0, and keeps each full sensor record's
+ * identity here and its conversion factors in an sdr_soa, so a pass
+ * of Get Sensor Reading can be converted with one sdr_convert call.
+ */
+
+#ifndef IPMISDR_H
+#define IPMISDR_H
+
+#include <stdint.h>
+
+#include "sdrconv.h"
+
+#define IPMI_NETFN_SENSOR	0x04
+#define IPMI_NETFN_STORAGE	0x0a
+#define IPMI_GET_SENSOR_READING	0x2d
+#define IPMI_RESERVE_SDR	0x22
+#define IPMI_GET_SDR		0x23
+
+#define SDR_FULL_SENSOR		0x01
+#define SDR_HEADER		5	/* id, version, type, length */
+
+/* sdr_read_sensors flags */
+#define SDR_UNAVAILABLE		0x01	/* reading unavailable or not scanning */
+#define SDR_NOT_READ		0x02	/* command failed, or not on this BMC */
+
+struct sdr_sensor {
+	uint16_t	recid;
+	uint8_t		owner;		/* owner slave address */
+	uint8_t		lun;
+	uint8_t		number;
+	uint8_t		type;		/* sensor type */
+	uint8_t		evtype;		/* event/reading type code */
+	uint8_t		units;		/* base unit code */
+	char		id[17];
+};
+
+struct sdr_repo {
+	int		n;
+	struct sdr_sensor *sensors;	/* sensors[i] goes with soa entry i */
+	struct sdr_soa	soa;
+};
+
+int sdr_repo_init(struct sdr_repo *r);
+void sdr_repo_free(struct sdr_repo *r);
+int sdr_parse_record(struct sdr_repo *r, const uint8_t *rec, int len);
+int sdr_repo_take(struct sdr_repo *r, const struct sdr_repo *src, int i);
+int sdr_read_repo(int ipmi_fd, struct sdr_repo *r);
+int sdr_read_sensors(int ipmi_fd, const struct sdr_repo *r,
+		     uint8_t *raw, uint8_t *flags);
+const char *sdr_unit(int code);
+
+#endif /* IPMISDR_H */
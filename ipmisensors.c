@@ -0,0 +1,225 @@
+/*
+ * ipmisensors - read the BMC's sensors and check them against their
+ *		 thresholds
+ *
+ * Reads the SDR repository once, then reads every sensor on the BMC
+ * with Get Sensor Reading, -n times every -i seconds, and converts
+ * each pass with one sdr_convert call. -q prints only the sensors
+ * past a threshold.
+ *
+ * -w polls on the sensched scheduler instead: every sensor at -i
+ * seconds, or at its own interval given with -I, within a budget of
+ * -b requests in flight and -r requests a second, and then reports
+ * how fresh each sensor's reading was kept against its interval.
+ *
+ *	$ gcc -O2 -o ipmisensors ipmisensors.c ipmisdr.c sdrconv.c \
+ *		sensched.c ipmicmd.c iptrace.c -lm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "ipmicmd.h"
+#include "ipmisdr.h"
+#include "sensched.h"
+
+static volatile sig_atomic_t stop;
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static const char *statusstr(uint8_t st, uint8_t flags)
+{
+	if (flags & SDR_NOT_READ)
+		return "not read";
+	if (flags & SDR_UNAVAILABLE)
+		return "unavailable";
+	if (st & SDR_INVALID)
+		return "no reading";
+	if (st & SDR_LNR)
+		return "lower non-recoverable";
+	if (st & SDR_UNR)
+		return "upper non-recoverable";
+	if (st & SDR_LCR)
+		return "lower critical";
+	if (st & SDR_UCR)
+		return "upper critical";
+	if (st & SDR_LNC)
+		return "lower non-critical";
+	if (st & SDR_UNC)
+		return "upper non-critical";
+	return "ok";
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: ipmisensors [-n passes] [-i secs] [-q] [-v]\n"
+		"       ipmisensors -w secs [-i secs] [-I list] [-b n] [-r n] [-v]"
+		"\n\n"
+		"  -n passes  read the sensors this many times, default 1\n"
+		"  -i secs    time between passes, default 5\n"
+		"  -q         print only sensors past a threshold\n"
+		"  -w secs    poll on the scheduler this long, 0 until SIGINT\n"
+		"  -I list    intervals of single sensors, e.g. 0x30:1,0x41:60\n"
+		"  -b n       requests in flight at most, default 4\n"
+		"  -r n       requests a second at most, default 20; 0 no limit\n"
+		"  -v         verbose\n");
+	exit(2);
+}
+
+static void print_reading(struct sensched *ss, int i, void *arg)
+{
+	const struct sdr_sensor *sn = &ss->repo->sensors[i];
+	const struct ss_sensor *s = &ss->s[i];
+
+	(void)arg;
+	if (s->flags)
+		printf("%ld  %3d  %-16s %12s\n", (long)time(NULL), sn->number,
+		       sn->id, "-");
+	else
+		printf("%ld  %3d  %-16s %12.3f  %s\n", (long)time(NULL),
+		       sn->number, sn->id,
+		       sdr_convert1(&ss->repo->soa, i, s->raw),
+		       sdr_unit(sn->units));
+}
+
+/*
+ * Poll on the scheduler: every sensor at secs, but those named in
+ * list, "number:secs,...", at their own.
+ */
+static int watch(int fd, const struct sdr_repo *r, double secs,
+		 const char *list, const struct ss_budget *b, double run)
+{
+	struct sensched ss;
+	uint32_t *ival = malloc((r->n + 1) * sizeof(*ival));
+	const char *p;
+	int i, rc;
+
+	if (ival == NULL)
+		return -1;
+	for (i = 0; i < r->n; i++)
+		ival[i] = secs * 1000;
+	for (p = list; p && *p; ) {
+		char *end;
+		long num = strtol(p, &end, 0);
+		double t;
+
+		if (end == p || *end != ':')
+			usage();
+		t = strtod(end + 1, &end);
+		for (i = 0; i < r->n; i++)
+			if (r->sensors[i].number == num)
+				ival[i] = t * 1000;
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	rc = ss_init(&ss, r, ival, b);
+	free(ival);
+	if (rc < 0)
+		return -1;
+
+	signal(SIGINT, onstop);
+	signal(SIGTERM, onstop);
+	rc = ss_run(&ss, fd, (int64_t)(run * 1000),
+		    Verbose ? print_reading : NULL, NULL, &stop);
+	ss_report(&ss, stdout);
+	ss_free(&ss);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sdr_repo repo;
+	uint8_t *raw, *flags, *status;
+	float *y;
+	struct ss_budget budget = { 4, 20, 4 };
+	const char *list = NULL;
+	int passes = 1, quiet = 0;
+	double secs = 5.0, run = -1;
+	int fd, opt, pass, i;
+
+	strncpy(toolname, "ipmisensors", sizeof(toolname) - 1);
+
+	while ((opt = getopt(argc, argv, "n:i:qw:I:b:r:v")) != -1) {
+		switch (opt) {
+		case 'n': passes = atoi(optarg); break;
+		case 'i': secs = atof(optarg); break;
+		case 'q': quiet = 1; break;
+		case 'w': run = atof(optarg); break;
+		case 'I': list = optarg; break;
+		case 'b': budget.inflight = atoi(optarg); break;
+		case 'r': budget.rate = atof(optarg); break;
+		case 'v': Verbose = 1; break;
+		default: usage();
+		}
+	}
+	if (passes <= 0 || secs < 0 || budget.inflight < 1 || budget.rate < 0)
+		usage();
+	budget.burst = budget.inflight;
+
+	if ((fd = ipmi_open()) < 0)
+		return 1;
+
+	if (sdr_repo_init(&repo) < 0 || sdr_read_repo(fd, &repo) < 0)
+		return 1;
+	if (Verbose)
+		fprintf(stderr, "%d sensors, %s kernel\n", repo.n, sdr_kernel());
+
+	if (run >= 0) {
+		i = watch(fd, &repo, secs, list, &budget, run);
+		close(fd);
+		sdr_repo_free(&repo);
+		return i < 0;
+	}
+
+	raw = malloc(repo.n + 1);
+	flags = malloc(repo.n + 1);
+	status = malloc(repo.n + 1);
+	y = malloc((repo.n + 1) * sizeof(float));
+	if (!raw || !flags || !status || !y) {
+		perror("ipmisensors");
+		return 1;
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		if (pass) {
+			struct timespec ts;
+
+			ts.tv_sec = (time_t)secs;
+			ts.tv_nsec = (long)((secs - ts.tv_sec) * 1e9);
+			nanosleep(&ts, NULL);
+		}
+
+		sdr_read_sensors(fd, &repo, raw, flags);
+		sdr_convert(&repo.soa, raw, y, status);
+
+		if (passes > 1)
+			printf("\npass %d, %ld\n", pass + 1, (long)time(NULL));
+
+		for (i = 0; i < repo.n; i++) {
+			struct sdr_sensor *sn = &repo.sensors[i];
+
+			if (quiet && (flags[i] || status[i] == 0
+				      || status[i] & SDR_INVALID))
+				continue;
+			printf("%3d  %-16s ", sn->number, sn->id);
+			if (flags[i] || status[i] & SDR_INVALID)
+				printf("%12s  %-14s", "-", "");
+			else
+				printf("%12.3f  %-14s", y[i], sdr_unit(sn->units));
+			printf("  %s\n", statusstr(status[i], flags[i]));
+		}
+	}
+
+	close(fd);
+	sdr_repo_free(&repo);
+	return 0;
+}
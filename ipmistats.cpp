@@ -0,0 +1,228 @@
+/******************************************************************************
+**
+**  ipmistats.cpp - ipmi_si and ipmi_msghandler driver counters for ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  ipmi_si publishes its counters as attributes of the system interface
+**  device, found through the ipmi_si driver directories in sysfs. Kernels
+**  built with CONFIG_IPMI_PROCFS also have /proc/ipmi/<n>/si_stats and,
+**  for ipmi_msghandler, /proc/ipmi/<n>/stats. All of them are read here.
+**
+******************************************************************************/
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "ipmistats.h"
+
+using namespace std;
+
+// Counter attributes of the ipmi_si system interface device
+//
+static const char *si_attrs[] = {
+    "short_timeouts", "long_timeouts", "idles", "interrupts",
+    "attentions", "flag_fetches", "hosed_count", "complete_transactions",
+    "events", "watchdog_pretimeouts", "incoming_messages", NULL
+};
+
+static const char *si_drivers[] = {
+    "/sys/bus/platform/drivers/ipmi_si/",
+    "/sys/bus/pci/drivers/ipmi_si/",
+    NULL
+};
+
+/**************************************************************
+ * ipmistats::discover - find every counter the drivers publish
+ *
+ * Returns the number of counters found.
+ */
+int ipmistats::discover()
+{
+    DIR *dp;
+    struct dirent *de;
+
+    stats.clear();
+    files.clear();
+    primed = false;
+
+    for (int d = 0; si_drivers[d]; ++d) {
+        if ((dp = opendir(si_drivers[d])) == NULL)
+            continue;
+        while ((de = readdir(dp)) != NULL) {
+            string dir = string(si_drivers[d]) + de->d_name + "/";
+            if (access((dir + si_attrs[0]).c_str(), R_OK) == 0)
+                addsysfs(de->d_name, dir);
+        }
+        closedir(dp);
+    }
+
+    if ((dp = opendir("/proc/ipmi")) != NULL) {
+        while ((de = readdir(dp)) != NULL) {
+            if (de->d_name[0] == '.')
+                continue;
+            string dir = string("/proc/ipmi/") + de->d_name + "/";
+            addproc(string("ipmi") + de->d_name + " si", dir + "si_stats");
+            addproc(string("ipmi") + de->d_name + " msghandler", dir + "stats");
+        }
+        closedir(dp);
+    }
+
+    return stats.size();
+}
+
+/**************************************************************
+ * ipmistats::addsysfs - add the counter attributes of an ipmi_si
+ *                       device directory
+ *
+ */
+void ipmistats::addsysfs(string source, string dir)
+{
+    for (int a = 0; si_attrs[a]; ++a) {
+        statfile sf;
+        sf.path = dir + si_attrs[a];
+        if (access(sf.path.c_str(), R_OK))
+            continue;
+
+        ipmistat st;
+        st.source = source;
+        st.name = si_attrs[a];
+        st.file = files.size();
+
+        sf.first = stats.size();
+        sf.count = 1;
+        files.push_back(sf);
+        stats.push_back(st);
+    }
+}
+
+/**************************************************************
+ * ipmistats::addproc - add the counters in a procfs stats file
+ *
+ */
+void ipmistats::addproc(string source, string path)
+{
+    ifstream fin(path.c_str());
+    string line;
+    statfile sf;
+
+    if (!fin)
+        return;
+
+    sf.path = path;
+    sf.islist = true;
+    sf.first = stats.size();
+
+    while (getline(fin, line)) {
+        size_t colon = line.find(':');
+        if (colon == string::npos)
+            continue;
+
+        ipmistat st;
+        st.source = source;
+        st.name = line.substr(0, colon);
+        st.file = files.size();
+        stats.push_back(st);
+        ++sf.count;
+    }
+
+    if (sf.count)
+        files.push_back(sf);
+}
+
+/**************************************************************
+ * ipmistats::readfile - read the current values from one file
+ *
+ * Lines of a list file are matched to counters by name, since a
+ * newer driver may add counters in the middle of the file. The
+ * file is read into tf's buffer and parsed in place, so a sample
+ * allocates nothing.
+ *
+ * Returns false if the file could not be read.
+ */
+bool ipmistats::readfile(statfile& sf)
+{
+    string_view text;
+    string_view line;
+    long long num;
+
+    if (!tf.setpath({sf.path}) || !tf.read(text))
+        return false;
+
+    if (!sf.islist) {
+        if (parseint(text, 10, num) != PARSE_OK)
+            return false;
+        stats[sf.first].value = num;
+        return true;
+    }
+
+    int next = sf.first;
+    int end = sf.first + sf.count;
+
+    while (!text.empty()) {
+        line = nextline(text);
+        size_t colon = line.find(':');
+        if (colon == string_view::npos)
+            continue;
+
+        string_view name = line.substr(0, colon);
+        if (next >= end || stats[next].name != name)
+            for (next = sf.first; next < end; ++next)
+                if (stats[next].name == name)
+                    break;
+        if (next >= end)
+            continue;
+
+        if (parseint(line.substr(colon + 1), 10, num) == PARSE_OK)
+            stats[next].value = num;
+        ++next;
+    }
+    return true;
+}
+
+/**************************************************************
+ * ipmistats::sample - read all counters and compute the deltas
+ *                     and rates since the previous sample
+ *
+ * The first sample after discover only primes the previous values,
+ * so its deltas and rates are zero.
+ *
+ * Returns the number of files that could not be read.
+ */
+int ipmistats::sample()
+{
+    struct timespec now;
+    int errs = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (uint i = 0; i < stats.size(); ++i)
+        stats[i].prev = stats[i].value;
+
+    for (uint f = 0; f < files.size(); ++f)
+        if (!readfile(files[f]))
+            ++errs;
+
+    interval = primed ? (now.tv_sec - last.tv_sec)
+                        + (now.tv_nsec - last.tv_nsec) / 1e9 : 0.0;
+
+    for (uint i = 0; i < stats.size(); ++i) {
+        ipmistat& st = stats[i];
+        st.delta = primed && st.value >= st.prev ? st.value - st.prev : 0;
+        st.rate = interval > 0.0 ? st.delta / interval : 0.0;
+    }
+
+    last = now;
+    primed = true;
+    return errs;
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+**
+**  ipmistats.h - ipmi_si and ipmi_msghandler driver counters for ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef IPMISTATS_H
+#define IPMISTATS_H
+
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "parmfmt.h"
+
+/**************************************************************
+ * class ipmistat - one driver counter
+ *************************************************************/
+class ipmistat {
+public:
+    ipmistat() {file = 0; value = 0; prev = 0; delta = 0; rate = 0.0;}
+
+    std::string source;     // device or interface the counter belongs to
+    std::string name;       // counter name, e.g. short_timeouts
+    int    file;            // index into ipmistats::files
+
+    unsigned long long value;
+    unsigned long long prev;
+    unsigned long long delta;
+    double rate;            // per second over the last sample interval
+};
+
+/**************************************************************
+ * class statfile - a file holding one or more counters
+ *
+ * sysfs device attributes hold a single value, while the procfs
+ * stats files hold one "name: value" pair per line.
+ *************************************************************/
+class statfile {
+public:
+    statfile() {first = 0; count = 0; islist = false;}
+
+    std::string path;
+    int    first;           // first counter in ipmistats::stats
+    int    count;
+    bool   islist;
+};
+
+/**************************************************************
+ * class ipmistats - discovers and samples the driver counters
+ *************************************************************/
+class ipmistats {
+public:
+    ipmistats() {primed = false; interval = 0.0;}
+
+    int    discover();
+    int    sample();
+
+    std::vector<ipmistat> stats;
+    std::vector<statfile> files;
+    double interval;        // seconds between the last two samples
+
+private:
+    bool   primed;
+    struct timespec last;
+    textfile tf;            // reused by readfile
+
+    void   addsysfs(std::string source, std::string dir);
+    void   addproc(std::string source, std::string path);
+    bool   readfile(statfile& sf);
+};
+
+#endif // IPMISTATS_H
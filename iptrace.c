@@ -0,0 +1,213 @@
+/*
+ * iptrace.c - phase tracing, see iptrace.h
+ *
+ * Everything here is under IPMI_TRACE; without it this file is empty.
+ */
+
+#include "iptrace.h"
+
+#ifdef IPMI_TRACE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define IPTRACE_EVENTS	4096		/* ring size, a power of two */
+#define IPTRACE_DEPTH	16		/* deepest nesting traced */
+
+static const char *phasenames[TP_NPHASES] = {
+	"shell",
+	"init_kmod",
+	"sysfs_write",
+	"ipmicmd",
+	"dmidecode",
+	"setipmbaddr",
+	"detect",
+	"read_address",
+	"prefetch_wait",
+};
+
+struct iptrace_event {
+	int64_t		ns;		/* since the first event */
+	short		phase;
+	short		kind;		/* 'B'egin, 'E'nd or 'F'ork */
+};
+
+struct iptrace_frame {
+	int		phase;
+	int64_t		t0;
+	int64_t		sys0;
+	int64_t		forks0;
+};
+
+struct iptrace_total {
+	int64_t		count;
+	int64_t		ns;
+	int64_t		syscalls;
+	int64_t		forks;
+};
+
+static struct iptrace_event ring[IPTRACE_EVENTS];
+static uint64_t nevents;
+static struct iptrace_frame stack[IPTRACE_DEPTH];
+static int depth;
+static struct iptrace_total totals[TP_NPHASES];
+static int64_t forks;
+static int64_t epoch = -1;
+static int iofd = -2;
+static int64_t selfsys;		/* syscalls made reading /proc/self/io */
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * The read and write syscalls made so far, from syscr and syscw in
+ * /proc/self/io, less those made here to read it. -1 if unavailable.
+ */
+static int64_t syscalls(void)
+{
+	char buf[512], *p;
+	int64_t r = -1, w = -1;
+	ssize_t n;
+
+	if (iofd == -2)
+		iofd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+	if (iofd < 0)
+		return -1;
+
+	n = pread(iofd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0)
+		return -1;
+	buf[n] = '\0';
+	selfsys++;
+
+	if ((p = strstr(buf, "syscr:")))
+		r = strtoll(p + 6, NULL, 10);
+	if ((p = strstr(buf, "syscw:")))
+		w = strtoll(p + 6, NULL, 10);
+	if (r < 0 || w < 0)
+		return -1;
+	return r + w - selfsys;
+}
+
+static void logevent(int phase, int kind, int64_t t)
+{
+	struct iptrace_event *ev = &ring[nevents++ & (IPTRACE_EVENTS - 1)];
+
+	if (epoch < 0)
+		epoch = t;
+	ev->ns = t - epoch;
+	ev->phase = phase;
+	ev->kind = kind;
+}
+
+void iptrace_begin(int phase)
+{
+	int64_t t = now_ns();
+
+	logevent(phase, 'B', t);
+	if (depth < IPTRACE_DEPTH) {
+		struct iptrace_frame *f = &stack[depth];
+
+		f->phase = phase;
+		f->sys0 = syscalls();
+		f->forks0 = forks;
+		f->t0 = now_ns();
+	}
+	depth++;
+}
+
+void iptrace_end(int phase)
+{
+	int64_t t = now_ns();
+	struct iptrace_frame *f;
+	struct iptrace_total *tot;
+	int64_t sys;
+
+	logevent(phase, 'E', t);
+	if (depth == 0)
+		return;
+	if (--depth >= IPTRACE_DEPTH)
+		return;
+
+	f = &stack[depth];
+	if (f->phase != phase || phase < 0 || phase >= TP_NPHASES)
+		return;
+
+	tot = &totals[phase];
+	tot->count++;
+	tot->ns += t - f->t0;
+	tot->forks += forks - f->forks0;
+	sys = syscalls();
+	if (sys >= 0 && f->sys0 >= 0)
+		tot->syscalls += sys - f->sys0;
+}
+
+void iptrace_fork(void)
+{
+	forks++;
+	logevent(depth > 0 && depth <= IPTRACE_DEPTH
+		 ? stack[depth - 1].phase : -1, 'F', now_ns());
+}
+
+/*
+ * Print the per-phase totals, and the event ring if IPMI_TRACE_EVENTS
+ * is set in the environment.
+ */
+void iptrace_report(FILE *fp)
+{
+	uint64_t i, first;
+	int p;
+
+	fprintf(fp, "\n%-14s %8s %12s %10s %10s %8s\n",
+		"phase", "calls", "total ms", "avg us", "syscalls", "forks");
+	for (p = 0; p < TP_NPHASES; p++) {
+		struct iptrace_total *t = &totals[p];
+
+		if (t->count == 0)
+			continue;
+		fprintf(fp, "%-14s %8lld %12.3f %10.1f %10lld %8lld\n",
+			phasenames[p], (long long)t->count, t->ns / 1e6,
+			t->ns / 1e3 / t->count, (long long)t->syscalls,
+			(long long)t->forks);
+	}
+	if (iofd < 0)
+		fprintf(fp, "(syscall counts unavailable: no /proc/self/io)\n");
+
+	if (getenv("IPMI_TRACE_EVENTS") == NULL)
+		return;
+
+	first = nevents > IPTRACE_EVENTS ? nevents - IPTRACE_EVENTS : 0;
+	fprintf(fp, "\nlast %llu of %llu events:\n",
+		(unsigned long long)(nevents - first),
+		(unsigned long long)nevents);
+	for (i = first; i < nevents; i++) {
+		struct iptrace_event *ev = &ring[i & (IPTRACE_EVENTS - 1)];
+
+		fprintf(fp, "%12.3f ms  %c  %s\n", ev->ns / 1e6, ev->kind,
+			ev->phase >= 0 && ev->phase < TP_NPHASES
+			? phasenames[ev->phase] : "-");
+	}
+}
+
+static void report_stderr(void)
+{
+	iptrace_report(stderr);
+}
+
+void iptrace_report_at_exit(void)
+{
+	static int registered;
+
+	if (!registered++)
+		atexit(report_stderr);
+}
+
+#endif /* IPMI_TRACE */
@@ -0,0 +1,104 @@
+/*
+ * iptrace.h - phase tracing for ipmiparm, getInfoIPMI and the tools
+ *	       built on the IPMI command layer.
+ *
+ * Built with -DIPMI_TRACE, each instrumented phase
+ *
+ *  - fires a USDT probe on entry and exit (ipmitools:phase__begin and
+ *    ipmitools:phase__end, with the phase number), when <sys/sdt.h>
+ *    is available
+ *  - logs its entry and exit in an in-process ring of recent events
+ *  - adds its wall time, the read/write syscalls the process made and
+ *    the processes it forked to a per-phase total
+ *
+ * and iptrace_report prints the totals. Without IPMI_TRACE the macros
+ * compile to nothing, and iptrace.c is empty.
+ *
+ * TRACE_SCOPE(phase) traces from that line to the end of the block,
+ * however the block is left, so functions with many returns need
+ * only the one line. Phase times are inclusive of nested phases.
+ */
+
+#ifndef IPTRACE_H
+#define IPTRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum iptrace_phase {
+	TP_SHELL,		// parmapp::shell
+	TP_INIT_KMOD,		// parmapp::init_kmod
+	TP_SYSFS_WRITE,		// parmapp::writeparm
+	TP_IPMICMD,		// ipmicmd_mv
+	TP_DMIDECODE,		// run_dmidecode
+	TP_SETIPMBADDR,		// setipmbaddr
+	TP_DETECT,		// detect_hardware
+	TP_READ_ADDRESS,	// read_address
+	TP_PREFETCH,		// prefetch_wait
+	TP_NPHASES
+};
+
+#ifdef IPMI_TRACE
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define IPTRACE_USDT	1
+#endif
+#endif
+
+void iptrace_begin(int phase);
+void iptrace_end(int phase);
+void iptrace_fork(void);
+void iptrace_report(FILE *fp);
+void iptrace_report_at_exit(void);
+
+#ifdef IPTRACE_USDT
+#define TRACE_PROBE(name, phase)	DTRACE_PROBE1(ipmitools, name, phase)
+#else
+#define TRACE_PROBE(name, phase)	do { } while (0)
+#endif
+
+static inline int iptrace_scope_begin(int phase)
+{
+	TRACE_PROBE(phase__begin, phase);
+	iptrace_begin(phase);
+	return phase;
+}
+
+static inline void iptrace_scope_end(int *phase)
+{
+	iptrace_end(*phase);
+	TRACE_PROBE(phase__end, *phase);
+}
+
+#define TRACE_BEGIN(phase)	do { TRACE_PROBE(phase__begin, phase); \
+				     iptrace_begin(phase); } while (0)
+#define TRACE_END(phase)	do { iptrace_end(phase); \
+				     TRACE_PROBE(phase__end, phase); } while (0)
+#define TRACE_FORK()		iptrace_fork()
+#define TRACE_SCOPE(phase)						\
+	int __iptrace_scope __attribute__((cleanup(iptrace_scope_end)))	\
+		= iptrace_scope_begin(phase)
+#define TRACE_REPORT_AT_EXIT()	iptrace_report_at_exit()
+
+#else /* !IPMI_TRACE */
+
+#define TRACE_BEGIN(phase)	do { } while (0)
+#define TRACE_END(phase)	do { } while (0)
+#define TRACE_FORK()		do { } while (0)
+#define TRACE_SCOPE(phase)	do { } while (0)
+#define TRACE_REPORT_AT_EXIT()						\
+	fprintf(stderr, "timing: built without IPMI_TRACE\n")
+
+#endif /* IPMI_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IPTRACE_H */
@@ -0,0 +1,196 @@
+/*
+ * kcsport.c - KCS port I/O for ipmi-hang-kcs and kcssample
+ *
+ * See kcsport.h for the simulation spec.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "kcsport.h"
+
+static int sim_parse(struct kcs_sim *s, const char *spec)
+{
+	char buf[256], *tok, *save;
+
+	s->period = 1000000;
+	s->byte_ns = 10000;
+	s->req = 2;
+	s->rsp = 3;
+	s->stuck = -1;
+	s->every = 0;
+	s->stuck_ns = 500000000;
+	s->aborted = -1;
+
+	if (strncmp(spec, "sim", 3) || (spec[3] && spec[3] != ','))
+		return -1;
+
+	snprintf(buf, sizeof(buf), "%s", spec + 3);
+	for (tok = strtok_r(buf, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		char *val = strchr(tok, '=');
+
+		if (val == NULL)
+			return -1;
+		*val++ = '\0';
+
+		if (!strcmp(tok, "period"))
+			s->period = atoll(val) * 1000;
+		else if (!strcmp(tok, "byte"))
+			s->byte_ns = atoll(val) * 1000;
+		else if (!strcmp(tok, "req"))
+			s->req = atoi(val);
+		else if (!strcmp(tok, "rsp"))
+			s->rsp = atoi(val);
+		else if (!strcmp(tok, "every"))
+			s->every = atoll(val);
+		else if (!strcmp(tok, "for"))
+			s->stuck_ns = atoll(val) * 1000000;
+		else if (!strcmp(tok, "stuck"))
+			s->stuck = !strcmp(val, "write") ? KCS_WRITE
+				 : !strcmp(val, "read") ? KCS_READ
+				 : !strcmp(val, "error") ? KCS_ERROR : -2;
+		else
+			return -1;
+	}
+
+	if (s->period <= 0 || s->byte_ns <= 0 || s->req < 1 || s->rsp < 1
+	    || s->stuck == -2 || s->stuck_ns < 0
+	    || (s->req + s->rsp) * s->byte_ns > s->period)
+		return -1;
+	if (s->stuck >= 0 && s->every <= 0)
+		s->every = 1;
+	return 0;
+}
+
+/*
+ * Open a KCS interface at port, real if spec is NULL, else simulated.
+ *
+ * Returns 0 on success, else -1 with errno set.
+ */
+int kcs_open(struct kcsport *kp, int port, const char *spec)
+{
+	memset(kp, 0, sizeof(*kp));
+	kp->port = port;
+
+	if (spec) {
+		if (sim_parse(&kp->s, spec) < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		kp->sim = 1;
+		kp->s.epoch = kcs_now();
+		return 0;
+	}
+
+#ifdef KCS_HAVE_PORTS
+	// we need privileges to read the i/o port
+	//
+	return iopl(3);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * The latest transaction at or before txn that gets stuck, or -1.
+ */
+static int64_t stuck_txn(struct kcs_sim *s, int64_t txn)
+{
+	int64_t k;
+
+	if (s->stuck < 0)
+		return -1;
+	k = txn - (txn + 1) % s->every;
+	return k == s->aborted ? -1 : k;
+}
+
+/*
+ * The status register, and the data register in *data, rel ns after
+ * the interface was opened.
+ */
+static uint8_t sim_status(struct kcs_sim *s, int64_t rel, uint8_t *data)
+{
+	int64_t w = s->req * s->byte_ns;
+	int64_t r = s->rsp * s->byte_ns;
+	int64_t txn = rel / s->period;
+	int64_t k = stuck_txn(s, txn);
+	int64_t off, half, at;
+	int byte;
+
+	*data = 0;
+
+	if (k >= 0 && rel < k * s->period + w + r + s->stuck_ns) {
+		/* in a stuck transaction, which may outlast its period */
+		off = rel - k * s->period;
+		at = s->stuck == KCS_WRITE ? 0 : w;
+
+		if (off >= at && off < at + s->stuck_ns) {
+			switch (s->stuck) {
+			case KCS_WRITE:	return KCS_WRITE << 6 | KCS_IBF;
+			case KCS_READ:	return KCS_READ << 6;
+			default:	return KCS_ERROR << 6;
+			}
+		}
+		if (off >= at + s->stuck_ns) {
+			if (s->stuck == KCS_ERROR)
+				return KCS_IDLE << 6;
+			off -= s->stuck_ns;
+		}
+	} else {
+		/* transactions due while stuck were never started */
+		if (k >= 0 && k < txn
+		    && txn * s->period < k * s->period + w + r + s->stuck_ns)
+			return KCS_IDLE << 6;
+		off = rel - txn * s->period;
+	}
+
+	half = s->byte_ns / 2;
+
+	if (off < w) {
+		byte = off / s->byte_ns;
+		if (off % s->byte_ns >= half)
+			return KCS_WRITE << 6;
+		return KCS_WRITE << 6 | KCS_IBF | (byte == 0 ? KCS_CD : 0);
+	}
+
+	if (off < w + r) {
+		static const uint8_t rsp[] = { 0x1c, 0x01, 0x00 };
+
+		byte = (off - w) / s->byte_ns;
+		*data = byte < 3 ? rsp[byte] : byte;
+		if ((off - w) % s->byte_ns >= half)
+			return KCS_READ << 6;
+		return KCS_READ << 6 | KCS_OBF;
+	}
+
+	return KCS_IDLE << 6;
+}
+
+uint8_t kcs_sim_inb(struct kcsport *kp, int port)
+{
+	uint8_t data;
+	uint8_t status = sim_status(&kp->s, kcs_now() - kp->s.epoch, &data);
+
+	return port == KCS_STATUS(kp->port) ? status : data;
+}
+
+/*
+ * Only ABORT on the command port does anything: it ends the stuck
+ * transaction in progress.
+ */
+void kcs_sim_outb(struct kcsport *kp, int port, uint8_t val)
+{
+	struct kcs_sim *s = &kp->s;
+	int64_t rel = kcs_now() - s->epoch;
+	int64_t k = stuck_txn(s, rel / s->period);
+
+	if (port != KCS_STATUS(kp->port) || val != KCS_ABORT || k < 0)
+		return;
+
+	if (rel < k * s->period + (s->req + s->rsp) * s->byte_ns + s->stuck_ns)
+		s->aborted = k;
+}
@@ -0,0 +1,125 @@
+/*
+ * kcsport.h - KCS port I/O for ipmi-hang-kcs and kcssample
+ *
+ * kcs_inb and kcs_outb go straight to inb and outb on a real KCS
+ * interface, which needs iopl(3) and an x86 machine. Opened with a
+ * simulation spec instead, the same calls are answered by a model
+ * of a KCS interface that runs IDLE -> WRITE -> READ -> IDLE
+ * transactions on a fixed schedule, with the OBF and IBF flags
+ * following each byte, and that can be told to get stuck. That
+ * lets the sampler and the hang detection run on any Linux machine.
+ *
+ * A spec is "sim" followed by any of these, comma separated:
+ *
+ *	period=us	time between transactions, default 1000
+ *	byte=us		time to move one byte, default 10
+ *	req=n		request bytes, default 2
+ *	rsp=n		response bytes, default 3
+ *	stuck=state	write, read or error: where to get stuck
+ *	every=n		get stuck on every nth transaction
+ *	for=ms		and stay stuck this long, default 500
+ *
+ * The model's state is a pure function of the time since open, so
+ * a run is reproducible and reading it has no side effects. The one
+ * exception is an ABORT written to the command port, which ends the
+ * stuck transaction in progress, as a real BMC would.
+ */
+
+#ifndef KCSPORT_H
+#define KCSPORT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <sys/io.h>
+#include <x86intrin.h>
+#define KCS_HAVE_PORTS	1
+#endif
+
+#define KCS_DATA_PORT	0xc80
+#define KCS_STATUS(p)	((p) + 1)	/* status on read, command on write */
+
+#define KCS_OBF		0x01
+#define KCS_IBF		0x02
+#define KCS_ATN		0x04
+#define KCS_CD		0x08
+#define KCS_STATE(s)	(((s) >> 6) & 3)
+
+#define KCS_IDLE	0
+#define KCS_READ	1
+#define KCS_WRITE	2
+#define KCS_ERROR	3
+
+#define KCS_ABORT	0x60	/* GET_STATUS/ABORT control code */
+
+struct kcs_sim {
+	int64_t		epoch;		/* ns, CLOCK_MONOTONIC at open */
+	int64_t		period;		/* ns between transactions */
+	int64_t		byte_ns;
+	int		req;
+	int		rsp;
+	int		stuck;		/* KCS_WRITE, KCS_READ, KCS_ERROR or -1 */
+	int64_t		every;
+	int64_t		stuck_ns;
+	int64_t		aborted;	/* transaction ended by an ABORT */
+};
+
+struct kcsport {
+	int		port;		/* data port */
+	int		sim;		/* 1 if simulated */
+	struct kcs_sim	s;
+};
+
+int kcs_open(struct kcsport *kp, int port, const char *spec);
+uint8_t kcs_sim_inb(struct kcsport *kp, int port);
+void kcs_sim_outb(struct kcsport *kp, int port, uint8_t val);
+
+static inline int64_t kcs_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * A fast timestamp: the TSC on x86, else monotonic nanoseconds.
+ */
+static inline uint64_t kcs_tsc(void)
+{
+#ifdef KCS_HAVE_PORTS
+	return __rdtsc();
+#else
+	return kcs_now();
+#endif
+}
+
+static inline void kcs_pause(void)
+{
+#ifdef KCS_HAVE_PORTS
+	_mm_pause();
+#endif
+}
+
+static inline uint8_t kcs_inb(struct kcsport *kp, int port)
+{
+#ifdef KCS_HAVE_PORTS
+	if (__builtin_expect(!kp->sim, 1))
+		return inb(port);
+#endif
+	return kcs_sim_inb(kp, port);
+}
+
+static inline void kcs_outb(struct kcsport *kp, int port, uint8_t val)
+{
+#ifdef KCS_HAVE_PORTS
+	if (__builtin_expect(!kp->sim, 1)) {
+		outb(val, port);
+		return;
+	}
+#endif
+	kcs_sim_outb(kp, port, val);
+}
+
+#endif /* KCSPORT_H */
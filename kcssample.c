@@ -0,0 +1,675 @@
+/*
+ * High rate KCS port sampler
+ *
+ * ipmi-hang-kcs.c reads the KCS data port every 1 to 2 seconds, which
+ * is far too coarse to catch a hang window. This polls the KCS data
+ * and status ports from a thread pinned to one cpu, at a fixed rate
+ * or in a tight spin loop, and timestamps every sample with the TSC.
+ * Samples go through a lock-free single producer, single consumer
+ * ring to a writer thread that appends them to a binary log, so the
+ * sampler never blocks on the disk.
+ *
+ * -S runs the sampler against the simulated KCS interface described
+ * in kcsport.h instead of the real ports, so it can be benchmarked
+ * and tested on any machine.
+ *
+ * -X is the contention stress mode. For each read rate in its list,
+ * -N threads hammer the KCS ports at that combined rate while the
+ * main thread sends Get Device ID through /dev/ipmi0 back to back.
+ * Each step reports the command latency percentiles next to the
+ * change in the ipmi_si timeout and hosed counters, showing how far
+ * out-of-band port reads can go before they disturb the driver.
+ *
+ * -D decodes a log: it follows the state bits of the status register
+ * and prints every KCS state transition with the time spent in the
+ * previous state, then the longest time seen in each state and each
+ * stay in a busy state (READ, WRITE or ERROR) that lasted longer than
+ * -s milliseconds.
+ *
+ *	$ gcc -O2 -o kcssample kcssample.c kcsport.c ipmicmd.c iptrace.c -lpthread
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/select.h>
+
+#include "kcsport.h"
+#include "ipmicmd.h"
+
+#define RING_SIZE	(1 << 20)	/* samples, a power of two */
+#define BATCH		4096		/* samples per fwrite */
+#define LOG_MAGIC	"KCSLOG1"
+
+static const char *statename[4] = { "IDLE", "READ", "WRITE", "ERROR" };
+
+struct sample {
+	uint64_t	tsc;
+	uint8_t		status;
+	uint8_t		data;
+} __attribute__((packed));
+
+struct loghdr {
+	char		magic[8];
+	uint32_t	port;
+	uint32_t	flags;		/* 1: only changes were logged */
+	uint64_t	tsc_hz;
+	uint64_t	start_tsc;
+	int64_t		start_ns;	/* CLOCK_REALTIME at start_tsc */
+} __attribute__((packed));
+
+/*
+ * The producer only writes head and the consumer only writes tail,
+ * each on its own cache line so they don't bounce between cpus.
+ */
+struct ring {
+	uint64_t	head __attribute__((aligned(64)));
+	uint64_t	tail __attribute__((aligned(64)));
+	uint64_t	dropped __attribute__((aligned(64)));
+	struct sample	buf[RING_SIZE];
+};
+
+static struct ring ring;
+static volatile sig_atomic_t stop;
+static int done;
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static int64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Measure the TSC rate against CLOCK_MONOTONIC over 100 ms.
+ */
+static uint64_t tsc_hz(void)
+{
+	struct timespec t0, t1, nap = { 0, 100000000 };
+	uint64_t c0, c1;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	c0 = kcs_tsc();
+	nanosleep(&nap, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	c1 = kcs_tsc();
+
+	ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	return (uint64_t)((c1 - c0) * 1e9 / ns);
+}
+
+static inline int ring_put(struct sample *s)
+{
+	uint64_t head = ring.head;
+
+	if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+		ring.dropped++;
+		return -1;
+	}
+	ring.buf[head & (RING_SIZE - 1)] = *s;
+	__atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+struct writer_args {
+	FILE		*fp;
+	uint64_t	written;
+};
+
+static void *writer(void *arg)
+{
+	struct writer_args *wa = arg;
+	struct timespec nap = { 0, 1000000 };
+
+	while (1) {
+		uint64_t tail = ring.tail;
+		uint64_t head = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		uint64_t n = head - tail;
+
+		if (n == 0) {
+			if (__atomic_load_n(&done, __ATOMIC_ACQUIRE)
+			    && tail == __atomic_load_n(&ring.head,
+						       __ATOMIC_ACQUIRE))
+				break;
+			nanosleep(&nap, NULL);
+			continue;
+		}
+
+		/* write up to the end of the buffer, or a batch */
+		uint64_t off = tail & (RING_SIZE - 1);
+		if (n > RING_SIZE - off)
+			n = RING_SIZE - off;
+		if (n > BATCH)
+			n = BATCH;
+
+		if (fwrite(&ring.buf[off], sizeof(struct sample), n, wa->fp)
+		    != n) {
+			perror("log write failed: ");
+			exit(1);
+		}
+		wa->written += n;
+		__atomic_store_n(&ring.tail, tail + n, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+static int record(const char *path, int port, const char *spec, int cpu,
+		  long rate, int changes, long seconds)
+{
+	struct kcsport kp;
+	struct loghdr hdr;
+	struct writer_args wa = { NULL, 0 };
+	struct sample s, prev = { 0, 0, 0 };
+	pthread_t tid;
+	uint64_t hz, period = 0, next, end = 0, polls = 0;
+	cpu_set_t set;
+
+	if (kcs_open(&kp, port, spec) < 0) {
+		perror(spec ? "bad simulation spec: " : "iopl failed: ");
+		return 1;
+	}
+
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			perror("sched_setaffinity failed: ");
+	}
+
+	if ((wa.fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	setvbuf(wa.fp, NULL, _IOFBF, 1 << 20);
+
+	hz = tsc_hz();
+	if (rate > 0)
+		period = hz / rate;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOG_MAGIC, sizeof(hdr.magic));
+	hdr.port = port;
+	hdr.flags = changes;
+	hdr.tsc_hz = hz;
+	hdr.start_tsc = kcs_tsc();
+	hdr.start_ns = realtime_ns();
+	fwrite(&hdr, sizeof(hdr), 1, wa.fp);
+
+	if (pthread_create(&tid, NULL, writer, &wa)) {
+		fprintf(stderr, "cannot start the writer thread\n");
+		return 1;
+	}
+
+	printf("sampling %sports 0x%x/0x%x at %s, tsc %.3f MHz\n",
+	       kp.sim ? "simulated " : "", port, KCS_STATUS(port),
+	       rate ? "a fixed rate" : "full speed", hz / 1e6);
+	fflush(stdout);
+
+	next = kcs_tsc();
+	if (seconds)
+		end = next + seconds * hz;
+
+	/*
+	 * The sampling loop. At short periods it spins on the TSC, at
+	 * long ones it sleeps, but always against absolute deadlines
+	 * so the rate doesn't drift.
+	 */
+	while (!stop) {
+		s.tsc = kcs_tsc();
+		s.status = kcs_inb(&kp, KCS_STATUS(port));
+		s.data = kcs_inb(&kp, port);
+		polls++;
+
+		if (!changes || polls == 1 || s.status != prev.status
+		    || s.data != prev.data)
+			ring_put(&s);
+		prev = s;
+
+		if (end && s.tsc >= end)
+			break;
+
+		if (period) {
+			next += period;
+			if (period > hz / 10000) {
+				int64_t wait = (int64_t)(next - kcs_tsc());
+				if (wait > 0) {
+					struct timespec ts = {
+						wait / hz,
+						(wait % hz) * 1000000000 / hz
+					};
+					nanosleep(&ts, NULL);
+				}
+			}
+			while ((int64_t)(next - kcs_tsc()) > 0)
+				kcs_pause();
+		}
+	}
+
+	/* log a final sample so the decoder knows how long the last
+	 * state lasted */
+	if (changes) {
+		prev.tsc = kcs_tsc();
+		ring_put(&prev);
+	}
+
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	pthread_join(tid, NULL);
+	fclose(wa.fp);
+
+	printf("%llu polls, %llu samples logged, %llu dropped\n",
+	       (unsigned long long)polls, (unsigned long long)wa.written,
+	       (unsigned long long)ring.dropped);
+	return 0;
+}
+
+static void flagstr(uint8_t status, char *buf)
+{
+	sprintf(buf, "%s%s%s%s", status & KCS_OBF ? " OBF" : "",
+		status & KCS_IBF ? " IBF" : "", status & KCS_ATN ? " ATN" : "",
+		status & KCS_CD ? " C/D" : "");
+}
+
+static int decode(const char *path, double stuck_ms, int quiet)
+{
+	struct loghdr hdr;
+	struct sample s, first;
+	FILE *fp = fopen(path, "r");
+	double maxdur[4] = { 0 }, totdur[4] = { 0 };
+	uint64_t entered[4] = { 0 }, nstuck = 0, nsamples = 0;
+	uint64_t since;
+	int state;
+	char flags[32];
+
+	if (fp == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1
+	    || memcmp(hdr.magic, LOG_MAGIC, sizeof(hdr.magic))
+	    || hdr.tsc_hz == 0) {
+		fprintf(stderr, "%s: not a kcssample log\n", path);
+		return 1;
+	}
+
+	if (fread(&first, sizeof(first), 1, fp) != 1) {
+		printf("no samples\n");
+		return 0;
+	}
+
+	state = KCS_STATE(first.status);
+	since = first.tsc;
+	entered[state]++;
+	s = first;
+	nsamples = 1;
+
+#define USEC(t)	(((double)(int64_t)((t) - first.tsc)) * 1e6 / hdr.tsc_hz)
+
+	flagstr(first.status, flags);
+	if (!quiet)
+		printf("%14.3f us  %-5s%s  data %02x\n", 0.0,
+		       statename[state], flags, first.data);
+
+	while (1) {
+		int more = fread(&s, sizeof(s), 1, fp) == 1;
+		int next = more ? KCS_STATE(s.status) : -1;
+		double dur;
+
+		if (more)
+			nsamples++;
+		if (more && next == state)
+			continue;
+
+		dur = USEC(s.tsc) - USEC(since);
+		totdur[state] += dur;
+		if (dur > maxdur[state])
+			maxdur[state] = dur;
+		/* an idle interface is healthy, however long it idles */
+		if (state != KCS_IDLE && dur > stuck_ms * 1000) {
+			nstuck++;
+			printf("STUCK in %s for %.3f ms from %.3f us\n",
+			       statename[state], dur / 1000, USEC(since));
+		}
+
+		if (!more)
+			break;
+
+		flagstr(s.status, flags);
+		if (!quiet)
+			printf("%14.3f us  %-5s%s  data %02x  (%s for %.3f us)\n",
+			       USEC(s.tsc), statename[next], flags, s.data,
+			       statename[state], dur);
+		state = next;
+		since = s.tsc;
+		entered[state]++;
+	}
+	fclose(fp);
+
+	printf("\n%llu samples over %.3f s from port 0x%x, %llu stuck\n",
+	       (unsigned long long)nsamples, USEC(s.tsc) / 1e6, hdr.port,
+	       (unsigned long long)nstuck);
+	printf("%-6s %10s %14s %14s\n", "state", "entered", "total ms",
+	       "longest ms");
+	for (state = 0; state < 4; state++)
+		printf("%-6s %10llu %14.3f %14.3f\n", statename[state],
+		       (unsigned long long)entered[state],
+		       totdur[state] / 1000, maxdur[state] / 1000);
+	return 0;
+}
+
+/*
+ * The ipmi_si counters that show the driver being disturbed
+ */
+static const char *si_counters[] = {
+	"short_timeouts", "long_timeouts", "hosed_count", "attentions"
+};
+#define NCOUNTERS	4
+
+static const char *si_drivers[] = {
+	"/sys/bus/platform/drivers/ipmi_si/",
+	"/sys/bus/pci/drivers/ipmi_si/",
+};
+
+static char si_dir[512];
+
+static void find_si(void)
+{
+	unsigned d;
+
+	for (d = 0; d < 2 && !si_dir[0]; d++) {
+		DIR *dp = opendir(si_drivers[d]);
+		struct dirent *de;
+		char path[512];
+
+		if (dp == NULL)
+			continue;
+		while ((de = readdir(dp)) != NULL) {
+			snprintf(path, sizeof(path), "%s%s/short_timeouts",
+				 si_drivers[d], de->d_name);
+			if (access(path, R_OK) == 0) {
+				snprintf(si_dir, sizeof(si_dir), "%s%s/",
+					 si_drivers[d], de->d_name);
+				break;
+			}
+		}
+		closedir(dp);
+	}
+}
+
+static void read_counters(unsigned long long *val)
+{
+	char path[600];
+	int c;
+
+	for (c = 0; c < NCOUNTERS; c++) {
+		FILE *fp;
+
+		val[c] = 0;
+		if (!si_dir[0])
+			continue;
+		snprintf(path, sizeof(path), "%s%s", si_dir, si_counters[c]);
+		if ((fp = fopen(path, "r")) == NULL)
+			continue;
+		if (fscanf(fp, "%llu", &val[c]) != 1)
+			val[c] = 0;
+		fclose(fp);
+	}
+}
+
+struct hammer {
+	pthread_t	tid;
+	struct kcsport	*kp;
+	int		cpu;
+	long		rate;		/* reads per second, 0 to spin */
+	uint64_t	reads __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+static int stepping;
+
+static void *hammer(void *arg)
+{
+	struct hammer *h = arg;
+	int64_t next = kcs_now();
+	int64_t period = h->rate ? 1000000000 / h->rate : 0;
+	uint64_t reads = 0;
+
+	if (h->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(h->cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	while (__atomic_load_n(&stepping, __ATOMIC_RELAXED)) {
+		kcs_inb(h->kp, KCS_STATUS(h->kp->port));
+		kcs_inb(h->kp, h->kp->port);
+		reads++;
+
+		if (period) {
+			next += period;
+			if (period > 100000) {
+				int64_t wait = next - kcs_now();
+				if (wait > 0) {
+					struct timespec ts = {
+						wait / 1000000000,
+						wait % 1000000000
+					};
+					nanosleep(&ts, NULL);
+				}
+			}
+			while (next - kcs_now() > 0)
+				kcs_pause();
+		}
+	}
+	h->reads = reads;
+	return NULL;
+}
+
+static int cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+#define MAXCMDS	(1 << 20)
+
+static int stress(const char *rates, int port, const char *spec, int nthreads,
+		  int cpu, int seconds)
+{
+	struct kcsport kp;
+	struct hammer *h;
+	int64_t *lat;
+	char buf[256], *tok, *save;
+	int ipmi_fd, t;
+
+	if (kcs_open(&kp, port, spec) < 0) {
+		perror(spec ? "bad simulation spec: " : "iopl failed: ");
+		return 1;
+	}
+
+	h = aligned_alloc(64, nthreads * sizeof(*h));
+	lat = malloc(MAXCMDS * sizeof(*lat));
+	if (h == NULL || lat == NULL) {
+		perror("malloc failed: ");
+		return 1;
+	}
+
+	find_si();
+	if ((ipmi_fd = ipmi_open()) < 0)
+		fprintf(stderr, "no IPMI commands, measuring port reads only\n");
+	if (!si_dir[0])
+		fprintf(stderr, "no ipmi_si counters found in sysfs\n");
+
+	printf("%10s %12s %8s %6s %9s %9s %9s %9s %7s %7s %7s %7s\n",
+	       "rate", "reads/s", "cmds", "fail", "p50 us", "p90 us", "p99 us",
+	       "max us", "short", "long", "hosed", "attn");
+
+	snprintf(buf, sizeof(buf), "%s", rates);
+	for (tok = strtok_r(buf, ",", &save); tok && !stop;
+	     tok = strtok_r(NULL, ",", &save)) {
+		long rate = atol(tok);
+		unsigned long long before[NCOUNTERS], after[NCOUNTERS];
+		uint64_t reads = 0;
+		int64_t start, end;
+		int ncmds = 0, fails = 0;
+
+		read_counters(before);
+		__atomic_store_n(&stepping, 1, __ATOMIC_RELEASE);
+
+		for (t = 0; t < nthreads; t++) {
+			h[t].kp = &kp;
+			h[t].cpu = cpu >= 0 ? cpu + t : -1;
+			h[t].rate = rate / nthreads;
+			h[t].reads = 0;
+			if (rate && h[t].rate == 0)
+				h[t].rate = 1;
+			pthread_create(&h[t].tid, NULL, hammer, &h[t]);
+		}
+
+		start = kcs_now();
+		end = start + seconds * 1000000000LL;
+
+		while (kcs_now() < end && !stop) {
+			uchar rsp[40];
+			int rlen;
+			int64_t t0;
+
+			if (ipmi_fd < 0) {
+				struct timespec nap = { 0, 10000000 };
+				nanosleep(&nap, NULL);
+				continue;
+			}
+
+			t0 = kcs_now();
+			if (ipmicmd_fd(ipmi_fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+				       0x01, 0x06, 0, NULL, 0, rsp, sizeof(rsp),
+				       &rlen) < 0 || rlen < 1 || rsp[0] != 0)
+				fails++;
+			else if (ncmds < MAXCMDS)
+				lat[ncmds++] = kcs_now() - t0;
+		}
+
+		__atomic_store_n(&stepping, 0, __ATOMIC_RELEASE);
+		for (t = 0; t < nthreads; t++) {
+			pthread_join(h[t].tid, NULL);
+			reads += h[t].reads;
+		}
+		end = kcs_now();
+		read_counters(after);
+
+		qsort(lat, ncmds, sizeof(*lat), cmp64);
+#define PCT(p)	(ncmds ? lat[(int)((ncmds - 1) * (p))] / 1e3 : 0.0)
+		printf("%10s %12.0f %8d %6d %9.1f %9.1f %9.1f %9.1f"
+		       " %7llu %7llu %7llu %7llu\n",
+		       rate ? tok : "spin", reads * 1e9 / (end - start),
+		       ncmds, fails, PCT(0.5), PCT(0.9), PCT(0.99), PCT(1.0),
+		       after[0] - before[0], after[1] - before[1],
+		       after[2] - before[2], after[3] - before[3]);
+#undef PCT
+		fflush(stdout);
+	}
+
+	if (ipmi_fd >= 0)
+		close(ipmi_fd);
+	free(lat);
+	free(h);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: kcssample -o log [-p port | -S spec] [-c cpu] [-r rate]"
+		" [-C] [-t secs]\n"
+		"       kcssample -X rates [-N threads] [-d secs] [-p port | -S spec]"
+		" [-c cpu]\n"
+		"       kcssample -D log [-s ms] [-q]\n\n"
+		"  -o log    write samples to this file\n"
+		"  -p port   KCS data port, default 0x%x\n"
+		"  -S spec   sample a simulated interface, e.g.\n"
+		"            sim,stuck=write,every=100,for=200\n"
+		"  -c cpu    pin the sampler to this cpu\n"
+		"  -r rate   samples per second, default 0 (spin)\n"
+		"  -C        only log samples that differ from the last one\n"
+		"  -t secs   stop after this many seconds\n"
+		"  -X rates  stress mode: comma separated combined port reads per\n"
+		"            second, 0 to spin, e.g. 1000,10000,100000,0\n"
+		"  -N n      reader threads in stress mode, default 1\n"
+		"  -d secs   seconds per stress step, default 5\n"
+		"  -D log    decode a log\n"
+		"  -s ms     report busy states held longer than this, default 100\n"
+		"  -q        only print the stuck states and the summary\n",
+		KCS_DATA_PORT);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	char *out = NULL, *in = NULL, *spec = NULL, *rates = NULL;
+	int nthreads = 1, step = 5;
+	int port = KCS_DATA_PORT;
+	int cpu = -1;
+	int changes = 0;
+	int quiet = 0;
+	long rate = 0, seconds = 0;
+	double stuck_ms = 100;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:p:S:c:r:Ct:D:s:qX:N:d:v")) != -1) {
+		switch (opt) {
+		case 'o': out = optarg; break;
+		case 'p': port = strtol(optarg, NULL, 0); break;
+		case 'S': spec = optarg; break;
+		case 'c': cpu = atoi(optarg); break;
+		case 'r': rate = atol(optarg); break;
+		case 'C': changes = 1; break;
+		case 't': seconds = atol(optarg); break;
+		case 'D': in = optarg; break;
+		case 's': stuck_ms = atof(optarg); break;
+		case 'q': quiet = 1; break;
+		case 'X': rates = optarg; break;
+		case 'N': nthreads = atoi(optarg); break;
+		case 'd': step = atoi(optarg); break;
+		case 'v': Verbose = 1; break;
+		default: usage();
+		}
+	}
+
+	if (in)
+		return decode(in, stuck_ms, quiet);
+
+	signal(SIGINT, onstop);
+	signal(SIGTERM, onstop);
+	strncpy(toolname, "kcssample", sizeof(toolname) - 1);
+
+	if (rates) {
+		if (nthreads < 1 || step < 1)
+			usage();
+		return stress(rates, port, spec, nthreads, cpu, step);
+	}
+
+	if (out == NULL || rate < 0)
+		usage();
+
+	printf("\nipmi kcs sampler\n\n");
+	return record(out, port, spec, cpu, rate, changes, seconds);
+}
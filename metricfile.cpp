@@ -0,0 +1,162 @@
+/******************************************************************************
+**
+**  metricfile.cpp - Prometheus textfile writer
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  The file is meant to be rewritten every few seconds, on every node, so
+**  nothing here forks or, once the buffer has grown to the size of the
+**  exposition, allocates. The file is not fsynced: after a crash a stale
+**  or missing file only costs a scrape, and the next commit replaces it.
+**
+******************************************************************************/
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "metricfile.h"
+#include "parmfmt.h"
+
+using namespace std;
+
+#define METRIC_BUFSIZE  16384   // first guess at the exposition's size
+
+/**************************************************************
+ * metricfile::open - set the file to write
+ *
+ * The file itself is not touched until the first commit.
+ *
+ * Returns 0, or -1 if path is empty.
+ */
+int metricfile::open(string p)
+{
+    if (p.empty()) {
+        errno = EINVAL;
+        return -1;
+    }
+    path = p;
+    tmppath = p + ".tmp";
+    buf.reserve(METRIC_BUFSIZE);
+    return 0;
+}
+
+void metricfile::begin()
+{
+    buf.clear();
+    nlabels = 0;
+}
+
+/**************************************************************
+ * metricfile::family - the HELP and TYPE of a metric family
+ *
+ * Must come before the family's samples, which must all be named
+ * name.
+ */
+void metricfile::family(string_view name, string_view type,
+                        string_view help)
+{
+    buf.append("# HELP ").append(name).append(" ").append(help)
+       .append("\n");
+    buf.append("# TYPE ").append(name).append(" ").append(type)
+       .append("\n");
+}
+
+void metricfile::sample(string_view name)
+{
+    buf.append(name);
+    nlabels = 0;
+}
+
+/**************************************************************
+ * metricfile::label - add a label to the current sample
+ *
+ * Backslashes, double quotes and newlines in the value are escaped
+ * as the text format requires; name is taken as a valid label name.
+ */
+void metricfile::label(string_view name, string_view val)
+{
+    buf.push_back(nlabels++ ? ',' : '{');
+    buf.append(name).append("=\"");
+    for (size_t i = 0; i < val.size(); ++i) {
+        switch (val[i]) {
+        case '\\': buf.append("\\\\"); break;
+        case '"':  buf.append("\\\""); break;
+        case '\n': buf.append("\\n"); break;
+        default:   buf.push_back(val[i]);
+        }
+    }
+    buf.push_back('"');
+}
+
+void metricfile::endlabels()
+{
+    if (nlabels)
+        buf.push_back('}');
+    buf.push_back(' ');
+    nlabels = 0;
+}
+
+void metricfile::value(long long num)
+{
+    char tmp[FMT_INTLEN];
+
+    endlabels();
+    buf.append(tmp, fmtint(tmp, sizeof(tmp), num, 10)).push_back('\n');
+}
+
+void metricfile::value(double num)
+{
+    char tmp[32];
+    int n;
+
+    endlabels();
+    n = snprintf(tmp, sizeof(tmp), "%.3f", num);
+    buf.append(tmp, n > 0 && n < (int)sizeof(tmp) ? n : 0)
+       .push_back('\n');
+}
+
+/**************************************************************
+ * metricfile::commit - put the exposition in place
+ *
+ * Returns 0 on success, else -1 with errno set; path is then left
+ * as it was.
+ */
+int metricfile::commit()
+{
+    const char *p;
+    size_t left;
+    ssize_t n;
+    int fd;
+
+    if ((fd = ::open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -1;
+
+    for (p = buf.data(), left = buf.size(); left > 0; p += n, left -= n) {
+        if ((n = write(fd, p, left)) < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            close(fd);
+            unlink(tmppath.c_str());
+            return -1;
+        }
+    }
+
+    if (close(fd) < 0 || rename(tmppath.c_str(), path.c_str()) < 0) {
+        int err = errno;
+        unlink(tmppath.c_str());
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
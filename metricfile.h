@@ -0,0 +1,66 @@
+/******************************************************************************
+**
+**  metricfile.h - Prometheus textfile writer
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef METRICFILE_H
+#define METRICFILE_H
+
+#include <string>
+#include <string_view>
+
+/**************************************************************
+ * class metricfile - builds a Prometheus text format exposition
+ *                    in memory and puts it in place in one rename
+ *
+ * A file is written as
+ *
+ *   begin()
+ *   family("ipmi_kmod_parameter", "gauge", "help")
+ *   sample("ipmi_kmod_parameter"); label("kmod", "ipmi_si");
+ *       value(100);
+ *   ...
+ *   commit()
+ *
+ * This is the format the node_exporter textfile collector parses,
+ * so a family's name is exactly its samples' name, _total and all,
+ * and its type one of counter, gauge or untyped. The text is built
+ * in a buffer that keeps its capacity from one commit to the next,
+ * and written to path.tmp, which is renamed over path, so a scraper
+ * reading path never sees a partial file.
+ *************************************************************/
+class metricfile {
+public:
+    metricfile() {nlabels = 0;}
+
+    int    open(std::string path);
+    void   begin();
+    void   family(std::string_view name, std::string_view type,
+                  std::string_view help);
+    void   sample(std::string_view name);
+    void   label(std::string_view name, std::string_view val);
+    void   value(long long num);
+    void   value(double num);
+    int    commit();
+
+    std::string path;
+
+private:
+    std::string tmppath;
+    std::string buf;        // the exposition, reused
+    int         nlabels;    // labels of the current sample so far
+
+    void   endlabels();
+};
+
+#endif // METRICFILE_H
@@ -0,0 +1,556 @@
+/******************************************************************************
+**
+**  modreload.cpp - reload ipmi kmods with new load-time parameters
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  Parameters with mode 0444 in sysfs are read when the module loads
+**  and never again, so the only way to change one is to reload the
+**  module, and with it every module that holds it. The window to keep
+**  short is the one between the first unload that takes a device away
+**  and the device coming back, so the modules are resolved and read
+**  into the page cache beforehand, unloads are a syscall each with no
+**  fork, and nothing else runs until the loads are done.
+**
+**  Only the new options are given to modprobe. The module's other
+**  load-time parameters come from /etc/modprobe.d as they do at boot;
+**  runtime parameters are written back by the caller afterwards.
+**
+******************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "modreload.h"
+
+using namespace std;
+
+#define SYSMOD          "/sys/module/"
+#define IPMI_DEV        "/dev/ipmi0"
+#define IPMI_CLASSDEV   "/sys/class/ipmi/ipmi0"
+#define WD_DEV          "/dev/watchdog"
+#define WD_KMOD         "ipmi_watchdog"
+#define COMEBACK_MS     10000   // how long to wait for the devices
+
+// System interface modules, and the modules that register an ipmi
+// user with one and so take a reference on it; sysfs doesn't list
+// those as holders.
+//
+static const char *ifaces[] = {"ipmi_si", "ipmi_ssif", "ipmi_powernv"};
+static const char *users[] = {"ipmi_watchdog", "ipmi_poweroff", "acpi_ipmi"};
+
+static bool isone(const string& kmod, const char **list, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (kmod == list[i])
+            return true;
+    return false;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool exists(string path)
+{
+    struct stat st;
+
+    return stat(path.c_str(), &st) == 0;
+}
+
+/**************************************************************
+ * runcmd - run a command, without a shell
+ *
+ * With out, the command's stdout and stderr are read into it,
+ * else they are left as they are.
+ *
+ * Returns the exit status, or -1 if it could not be run.
+ */
+static int runcmd(const vector<string>& args, string *out)
+{
+    vector<char *> argv;
+    char buf[4096];
+    int pfd[2] = {-1, -1};
+    int status;
+    ssize_t n;
+    pid_t pid;
+
+    for (uint i = 0; i < args.size(); ++i)
+        argv.push_back((char *)args[i].c_str());
+    argv.push_back(NULL);
+
+    if (out && pipe(pfd) < 0)
+        return -1;
+    if ((pid = fork()) < 0) {
+        if (out) {
+            close(pfd[0]);
+            close(pfd[1]);
+        }
+        return -1;
+    }
+    if (pid == 0) {
+        if (out) {
+            dup2(pfd[1], 1);
+            dup2(pfd[1], 2);
+            close(pfd[0]);
+            close(pfd[1]);
+        }
+        execvp(argv[0], &argv[0]);
+        _exit(127);
+    }
+    if (out) {
+        close(pfd[1]);
+        out->clear();
+        while ((n = read(pfd[0], buf, sizeof(buf))) != 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                break;
+            out->append(buf, n);
+        }
+        close(pfd[0]);
+    }
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**************************************************************
+ * optstr - options as they would be written after modprobe,
+ *          a value with a space in double quotes
+ */
+static string optstr(const vector<string>& opts)
+{
+    string s;
+
+    for (uint i = 0; i < opts.size(); ++i) {
+        size_t eq = opts[i].find('=');
+
+        if (i)
+            s += " ";
+        if (eq != string::npos && opts[i].find(' ') != string::npos)
+            s += opts[i].substr(0, eq + 1) + "\"" + opts[i].substr(eq + 1)
+               + "\"";
+        else
+            s += opts[i];
+    }
+    return s;
+}
+
+/**************************************************************
+ * modreload::holders - add kmod to order after every module that
+ *                      holds it, depth first
+ *
+ * The holders of an interface module include the loaded ipmi
+ * users. heldby counts, for each module, the holders found, each
+ * of which has a reference on it that goes away with the holder.
+ */
+void modreload::holders(string kmod, vector<string>& order,
+                        map<string, int>& seen, map<string, int>& heldby)
+{
+    DIR *dp;
+    struct dirent *de;
+    vector<string> hs;
+
+    if (seen[kmod]++)
+        return;
+
+    if ((dp = opendir((SYSMOD + kmod + "/holders").c_str())) != NULL) {
+        while ((de = readdir(dp)) != NULL)
+            if (de->d_name[0] != '.')
+                hs.push_back(de->d_name);
+        closedir(dp);
+    }
+
+    if (isone(kmod, ifaces, sizeof(ifaces) / sizeof(ifaces[0])))
+        for (uint i = 0; i < sizeof(users) / sizeof(users[0]); ++i)
+            if (exists(SYSMOD + string(users[i]) + "/initstate")
+                && find(hs.begin(), hs.end(), users[i]) == hs.end())
+                hs.push_back(users[i]);
+
+    for (uint i = 0; i < hs.size(); ++i) {
+        heldby[kmod]++;
+        holders(hs[i], order, seen, heldby);
+    }
+    order.push_back(kmod);
+}
+
+/**************************************************************
+ * modreload::plan - work out the unloads and loads that give the
+ *                   modules in newopts their new options
+ *
+ * newopts maps a kmod to its options, "parm=value" each.
+ *
+ * Returns 0 if the plan can be run, else -1 with error or
+ * blockers saying why not.
+ */
+int modreload::plan(const modopts& newopts)
+{
+    vector<string> order;
+    vector<string> notloaded;
+    map<string, int> seen;
+    map<string, int> heldby;
+    modopts::const_iterator it;
+
+    unload.clear();
+    load.clear();
+    kofiles.clear();
+    blockers.clear();
+    error.clear();
+
+    for (it = newopts.begin(); it != newopts.end(); ++it) {
+        string dir = SYSMOD + it->first;
+        if (exists(dir) && !exists(dir + "/initstate")) {
+            error = it->first + " is built into the kernel; set "
+                  + it->first + ".<parm> on the kernel command line";
+            return -1;
+        }
+        if (exists(dir))
+            holders(it->first, order, seen, heldby);
+        else
+            notloaded.push_back(it->first);
+    }
+
+    for (uint i = 0; i < order.size(); ++i) {
+        modstep st;
+        st.kmod = order[i];
+        st.heldby = heldby[order[i]];
+        unload.push_back(st);
+    }
+    for (uint i = order.size(); i-- > 0; ) {
+        modstep st;
+        st.kmod = order[i];
+        it = newopts.find(st.kmod);
+        if (it != newopts.end())
+            st.opts = it->second;
+        load.push_back(st);
+    }
+    for (uint i = 0; i < notloaded.size(); ++i) {
+        modstep st;
+        st.kmod = notloaded[i];
+        st.opts = newopts.find(st.kmod)->second;
+        load.push_back(st);
+    }
+
+    prewarm();
+    findblockers();
+    return error.empty() && blockers.empty() ? 0 : -1;
+}
+
+/**************************************************************
+ * modreload::prewarm - have modprobe resolve every module to be
+ *                      loaded and read the files into the page
+ *                      cache
+ *
+ * A module modprobe can't find is an error here rather than in
+ * the middle of the reload.
+ */
+void modreload::prewarm()
+{
+    char buf[65536];
+    string out;
+
+    for (uint i = 0; i < load.size(); ++i) {
+        vector<string> args = {"modprobe", "--show-depends", "--",
+                               load[i].kmod};
+        bool found = false;
+        int rc;
+
+        if ((rc = runcmd(args, &out)) < 0 || rc == 127) {
+            error = "cannot run modprobe";
+            return;
+        }
+        stringstream lines(out);
+        string line;
+        while (getline(lines, line)) {
+            stringstream ss(line);
+            string word, path;
+            ss >> word >> path;
+            if (word == "insmod" || word == "builtin")
+                found = true;
+            if (word == "insmod")
+                kofiles.push_back(path);
+        }
+        if (rc != 0 || !found) {
+            error = "modprobe cannot find " + load[i].kmod;
+            return;
+        }
+    }
+
+    for (uint i = 0; i < kofiles.size(); ++i) {
+        int fd = open(kofiles[i].c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        while (read(fd, buf, sizeof(buf)) > 0)
+            ;
+        close(fd);
+    }
+}
+
+/**************************************************************
+ * modreload::findblockers - modules to be unloaded that are in
+ *                           use, and the processes using them
+ *
+ * A module's refcnt includes a reference from each of its holders,
+ * which are unloaded before it, so only references beyond those
+ * keep it busy. Processes with an ipmi device open hold the
+ * interface and ipmi_devintf, or ipmi_watchdog for its device, so
+ * they are named whenever one of those is to be unloaded, whether
+ * or not the refcnt shows it.
+ */
+void modreload::findblockers()
+{
+    DIR *dp;
+    struct dirent *de;
+    bool ipmibusy = false;
+    bool wdbusy = false;
+
+    for (uint i = 0; i < unload.size(); ++i) {
+        ifstream fin((SYSMOD + unload[i].kmod + "/refcnt").c_str());
+        int refcnt = 0;
+        if (fin >> refcnt && refcnt > unload[i].heldby) {
+            stringstream ss;
+            ss << unload[i].kmod << " is in use, refcnt " << refcnt;
+            if (unload[i].heldby)
+                ss << ", " << unload[i].heldby << " of them from modules"
+                   << " unloaded before it";
+            blockers.push_back(ss.str());
+        }
+        if (unload[i].kmod == WD_KMOD)
+            wdbusy = true;
+        else if (!isone(unload[i].kmod, users,
+                        sizeof(users) / sizeof(users[0])))
+            ipmibusy = true;
+    }
+
+    if ((!ipmibusy && !wdbusy) || (dp = opendir("/proc")) == NULL)
+        return;
+
+    while ((de = readdir(dp)) != NULL) {
+        char *end;
+        long pid = strtol(de->d_name, &end, 10);
+        string fddir = string("/proc/") + de->d_name + "/fd/";
+        DIR *fp;
+        struct dirent *fe;
+
+        if (*end || pid <= 0 || (fp = opendir(fddir.c_str())) == NULL)
+            continue;
+
+        while ((fe = readdir(fp)) != NULL) {
+            char link[256];
+            ssize_t n = readlink((fddir + fe->d_name).c_str(), link,
+                                 sizeof(link) - 1);
+            if (n <= 0)
+                continue;
+            link[n] = '\0';
+            if (!(ipmibusy && strncmp(link, "/dev/ipmi", 9) == 0)
+                && !(wdbusy && strncmp(link, WD_DEV, 13) == 0))
+                continue;
+
+            string comm;
+            ifstream fin((string("/proc/") + de->d_name + "/comm").c_str());
+            getline(fin, comm);
+            blockers.push_back(comm + " (pid " + de->d_name + ") has "
+                               + link + " open");
+        }
+        closedir(fp);
+    }
+    closedir(dp);
+}
+
+/**************************************************************
+ * modreload::modprobe - load a module, without a shell
+ *
+ * Each option is one argument, so a value may hold spaces;
+ * modprobe quotes it for the kernel.
+ *
+ * Returns 0 on success, else the exit status of modprobe or -1.
+ */
+int modreload::modprobe(string kmod, const vector<string>& opts)
+{
+    vector<string> args = {"modprobe", "--", kmod};
+
+    args.insert(args.end(), opts.begin(), opts.end());
+    return runcmd(args, NULL);
+}
+
+/**************************************************************
+ * modreload::run - unload and reload the modules as planned and
+ *                  time the window
+ *
+ * If an unload fails, the modules already unloaded are loaded
+ * again as they were. If a load with the new options fails, the
+ * module is loaded without them so the devices come back.
+ *
+ * Returns 0 if every step worked, else -1 with error set.
+ */
+int modreload::run()
+{
+    bool ipmiup = exists(IPMI_CLASSDEV);
+    double t0, ts;
+    double ipmi_down = -1.0;
+    double wd_down = -1.0;
+
+    ipmi_ms = wd_ms = total_ms = -1.0;
+
+    if (geteuid() != 0) {
+        error = "must be root to reload modules";
+        return -1;
+    }
+
+    t0 = now();
+
+    for (uint i = 0; i < unload.size(); ++i) {
+        modstep& st = unload[i];
+
+        ts = now();
+        if (syscall(SYS_delete_module, st.kmod.c_str(), O_NONBLOCK) < 0) {
+            st.err = errno;
+            st.ms = now() - ts;
+            error = "cannot unload " + st.kmod + ": " + strerror(st.err);
+            while (i-- > 0)
+                modprobe(unload[i].kmod, {});
+            return -1;
+        }
+        st.ms = now() - ts;
+
+        if (ipmiup && ipmi_down < 0 && !exists(IPMI_CLASSDEV))
+            ipmi_down = ts;
+        if (st.kmod == WD_KMOD)
+            wd_down = ts;
+    }
+
+    for (uint i = 0; i < load.size(); ++i) {
+        modstep& st = load[i];
+
+        ts = now();
+        if (modprobe(st.kmod, st.opts) != 0) {
+            st.err = EINVAL;
+            if (error.empty())
+                error = "modprobe " + st.kmod + " " + optstr(st.opts)
+                      + " failed, loaded without the new options";
+            if (!st.opts.empty())
+                modprobe(st.kmod, {});
+        }
+        st.ms = now() - ts;
+    }
+
+    // The loads are done, but udev may not have made the nodes yet;
+    // the devices are only back when a program can use them.
+    //
+    while (now() - t0 < COMEBACK_MS
+           && ((ipmi_down >= 0 && ipmi_ms < 0)
+               || (wd_down >= 0 && wd_ms < 0))) {
+        if (ipmi_down >= 0 && ipmi_ms < 0) {
+            int fd = open(IPMI_DEV, O_RDWR);
+            if (fd >= 0) {
+                ipmi_ms = now() - ipmi_down;
+                close(fd);
+            }
+        }
+        if (wd_down >= 0 && wd_ms < 0) {
+            struct stat st;
+            if (stat(WD_DEV, &st) == 0 && S_ISCHR(st.st_mode)
+                && exists(SYSMOD WD_KMOD))
+                wd_ms = now() - wd_down;
+        }
+        usleep(500);
+    }
+    total_ms = now() - t0;
+
+    if (ipmi_down >= 0 && ipmi_ms < 0 && error.empty())
+        error = IPMI_DEV " did not come back";
+    if (wd_down >= 0 && wd_ms < 0 && error.empty())
+        error = "the ipmi watchdog did not come back";
+    return error.empty() ? 0 : -1;
+}
+
+/**************************************************************
+ * modreload::showplan - print what run will do
+ *
+ */
+void modreload::showplan(ostream& out)
+{
+    bool wd = false;
+
+    out << "  Reload plan\n"
+        << "  --------------------------------------\n";
+    for (uint i = 0; i < unload.size(); ++i) {
+        out << "  unload  " << unload[i].kmod << "\n";
+        wd |= unload[i].kmod == WD_KMOD;
+    }
+    for (uint i = 0; i < load.size(); ++i)
+        out << "  load    " << left << setw(18) << load[i].kmod << right
+            << optstr(load[i].opts) << "\n";
+
+    out << "\n";
+    if (!unload.empty())
+        out << "  " << IPMI_DEV << (wd ? " and the ipmi watchdog are"
+                                       : " is")
+            << " unavailable while this runs.\n";
+    if (wd)
+        out << "  The BMC watchdog is not kept alive in that window.\n";
+    out << "  Other load-time parameters come from /etc/modprobe.d.\n";
+
+    for (uint i = 0; i < blockers.size(); ++i)
+        out << "  Blocked: " << blockers[i] << "\n";
+    if (!error.empty())
+        out << "  Cannot reload: " << error << "\n";
+}
+
+/**************************************************************
+ * modreload::report - print the step times and the windows
+ *
+ */
+void modreload::report(ostream& out)
+{
+    out << fixed << setprecision(1);
+
+    for (uint i = 0; i < unload.size(); ++i)
+        out << "  unload  " << left << setw(18) << unload[i].kmod << right
+            << setw(8) << unload[i].ms << " ms"
+            << (unload[i].err ? "  failed" : "") << "\n";
+    for (uint i = 0; i < load.size(); ++i)
+        out << "  load    " << left << setw(18) << load[i].kmod << right
+            << setw(8) << load[i].ms << " ms"
+            << (load[i].err ? "  failed" : "") << "\n";
+
+    out << "\n";
+    if (ipmi_ms >= 0)
+        out << "  " << IPMI_DEV << " unavailable for " << ipmi_ms << " ms\n";
+    if (wd_ms >= 0)
+        out << "  ipmi watchdog unavailable for " << wd_ms << " ms\n";
+    if (total_ms >= 0)
+        out << "  reload took " << total_ms << " ms\n";
+    if (!error.empty())
+        out << "  " << error << "\n";
+
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+}
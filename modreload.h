@@ -0,0 +1,90 @@
+/******************************************************************************
+**
+**  modreload.h - reload ipmi kmods with new load-time parameters
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef MODRELOAD_H
+#define MODRELOAD_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A kmod's new options, parm=value each, by kmod.
+//
+typedef std::map<std::string, std::vector<std::string>> modopts;
+
+/**************************************************************
+ * modstep - one module unloaded or loaded by a reload
+ *************************************************************/
+struct modstep {
+    modstep() {ms = 0; err = 0; heldby = 0;}
+
+    std::string kmod;
+    std::vector<std::string> opts;  // parm=value, one modprobe argument
+                                    // each, load steps only
+    int         heldby;     // references held by modules unloaded before
+                            // it, unload steps only
+    double      ms;         // how long the step took
+    int         err;        // errno of a failed step, else 0
+};
+
+/**************************************************************
+ * class modreload - plan and run a reload of a set of kmods
+ *
+ * plan finds the modules that have to go with the ones being
+ * given new options, those holding them in /sys/module/<m>/holders
+ * and, for an interface module like ipmi_si, the loaded ipmi users
+ * like ipmi_watchdog, which hold it through ipmi_create_user rather
+ * than a symbol reference. It orders them: holders are unloaded
+ * first and loaded last.
+ * Everything that can fail or wait on the disk is done by plan,
+ * before anything is unloaded: modprobe resolves the module files
+ * and they are read into the page cache, and any process keeping
+ * a module busy is named.
+ *
+ * run then unloads with delete_module directly and loads each
+ * module with one modprobe, and times how long /dev/ipmi0 and
+ * the ipmi watchdog were gone: from the unload that removed the
+ * device until its node is back in /dev.
+ *************************************************************/
+class modreload {
+public:
+    modreload() {ipmi_ms = wd_ms = total_ms = -1.0;}
+
+    int    plan(const modopts& newopts);
+    void   showplan(std::ostream& out);
+    int    run();
+    void   report(std::ostream& out);
+
+    std::vector<modstep>     unload;    // in unload order
+    std::vector<modstep>     load;      // in load order
+    std::vector<std::string> kofiles;   // module files modprobe will insmod
+    std::vector<std::string> blockers;  // why a module can't be unloaded
+    std::string              error;
+
+    double ipmi_ms;         // /dev/ipmi0 unavailable, -1 if untouched
+    double wd_ms;           // ipmi watchdog unavailable, -1 if untouched
+    double total_ms;        // first unload to last device back
+
+private:
+    void   holders(std::string kmod, std::vector<std::string>& order,
+                   std::map<std::string, int>& seen,
+                   std::map<std::string, int>& heldby);
+    int    modprobe(std::string kmod, const std::vector<std::string>& opts);
+    void   prewarm();
+    void   findblockers();
+};
+
+#endif // MODRELOAD_H
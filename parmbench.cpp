@@ -0,0 +1,340 @@
+/******************************************************************************
+**
+**  parmbench.cpp - time the parmfmt parsing and formatting against the
+**                  stringstream code it replaced in ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  Each case runs the old and the new code -n times over the same input
+**  and prints the time and the heap allocations per call; operator new
+**  is replaced here to count them. The refresh case rereads a fake
+**  parameter tree of -p files in a temporary directory, as refresh does
+**  on every sample of the recorder.
+**
+**      $ g++ -O2 -o parmbench parmbench.cpp parmfmt.cpp
+**
+******************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+#include "parmfmt.h"
+
+using namespace std;
+
+static unsigned long nallocs;
+
+void *operator new(size_t n)
+{
+    void *p;
+
+    ++nallocs;
+    if ((p = malloc(n ? n : 1)) == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void *p) noexcept {free(p);}
+void operator delete[](void *p) noexcept {free(p);}
+void operator delete(void *p, size_t) noexcept {free(p);}
+void operator delete[](void *p, size_t) noexcept {free(p);}
+
+static const char *decs[] = {"0", "5", "-1", "100", "2147483647", "-42",
+                             "65535", "12"};
+static const char *hexs[] = {"0", "f", "ff", "f00", "7fffffff", "a5",
+                             "10", "dead"};
+static const char *lines[] = {
+    "parm ipmi_si kipmid_max_busy_us 100",
+    "kthread kipmi0 0-3 fifo 10",
+    "irq 17 ipmi_si 2",
+    "parm ipmi_watchdog action reset",
+};
+
+#define NPARMS  16
+
+static string dir;
+static string parmnames[NPARMS];
+static int    values[NPARMS];
+static string strvals[NPARMS];
+
+static long long now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**************************************************************
+ * The old code, as it was in ipmiparm
+ *************************************************************/
+static int old_dec(int i)
+{
+    int num = 0;
+    stringstream ss(decs[i % 8]);
+
+    ss >> num;
+    return num;
+}
+
+static int old_hex(int i)
+{
+    int num = 0;
+    string s(hexs[i % 8]);
+    bool isnumber = true;
+
+    for (string::const_iterator k = s.begin(); k != s.end(); ++k)
+        isnumber = isnumber && isxdigit(*k);
+    if (!isnumber)
+        return 0;
+
+    stringstream ss(s);
+    ss >> hex >> num;
+    return num;
+}
+
+static int old_fmtint(int i)
+{
+    stringstream ss;
+
+    ss << i * 7919;
+    return ss.str().size();
+}
+
+static string tobin(int num, int bits)
+{
+    string temp;
+    int bit;
+
+    temp.resize(bits);
+    for (int i = 0; i < bits; ++i) {
+        bit = 1 << (bits - 1 - i);
+        temp[i] = bit & num ? '1' : '0';
+    }
+    return temp;
+}
+
+static int old_fmtbin(int i)
+{
+    return tobin(i, 8)[7];
+}
+
+static int old_tokenize(int i)
+{
+    stringstream ss(lines[i % 4]);
+    vector<string> tokens;
+    string str;
+
+    while (ss >> str)
+        tokens.push_back(str);
+    return tokens.size();
+}
+
+static int old_refresh(int)
+{
+    for (uint k = 0; k < NPARMS; ++k) {
+        ifstream fin((dir + "module/ipmi_si/parameters/"
+                      + parmnames[k]).c_str());
+        if (k % 4 == 3)
+            fin >> strvals[k];
+        else
+            fin >> values[k];
+    }
+    return values[0];
+}
+
+/**************************************************************
+ * The same with parmfmt
+ *************************************************************/
+static char fmtbuf[FMT_INTLEN];
+static textfile tf;
+
+static int new_dec(int i)
+{
+    int num = 0;
+
+    parseint(decs[i % 8], 10, num);
+    return num;
+}
+
+static int new_hex(int i)
+{
+    int num = 0;
+
+    parseint(hexs[i % 8], 16, num);
+    return num;
+}
+
+static int new_fmtint(int i)
+{
+    return fmtint(fmtbuf, sizeof(fmtbuf), i * 7919, 10);
+}
+
+static int new_fmtbin(int i)
+{
+    fmtbin(fmtbuf, sizeof(fmtbuf), i, 8);
+    return fmtbuf[7];
+}
+
+static int new_tokenize(int i)
+{
+    string_view tokens[8];
+
+    return splitws(lines[i % 4], tokens, 8);
+}
+
+static int new_refresh(int)
+{
+    string_view text;
+    string_view tok;
+
+    for (uint k = 0; k < NPARMS; ++k) {
+        if (!tf.setpath({dir, "module/ipmi_si/parameters/", parmnames[k]})
+            || !tf.read(text))
+            continue;
+        if (k % 4 == 3) {
+            if (splitws(text, &tok, 1) && strvals[k] != tok)
+                strvals[k].assign(tok);
+        } else {
+            parseint(text, 10, values[k]);
+        }
+    }
+    return values[0];
+}
+
+static const struct {
+    const char *name;
+    int       (*oldfn)(int);
+    int       (*newfn)(int);
+    int         div;            // fewer calls for the slow ones
+} cases[] = {
+    {"parse dec",  old_dec,      new_dec,      1},
+    {"parse hex",  old_hex,      new_hex,      1},
+    {"format int", old_fmtint,   new_fmtint,   1},
+    {"format bin", old_fmtbin,   new_fmtbin,   1},
+    {"tokenize",   old_tokenize, new_tokenize, 1},
+    {"refresh",    old_refresh,  new_refresh,  100},
+};
+
+/**************************************************************
+ * mktree - a fake sysfs parameter directory under /tmp, every
+ *          fourth parameter a string
+ *
+ * Returns false if it could not be made.
+ */
+static bool mktree()
+{
+    char tmpl[] = "/tmp/parmbenchXXXXXX";
+
+    if (mkdtemp(tmpl) == NULL)
+        return false;
+    dir = string(tmpl) + "/";
+
+    string pdir = dir + "module/ipmi_si/parameters/";
+    string cmd = "mkdir -p " + pdir;
+    if (system(cmd.c_str()))
+        return false;
+
+    for (uint k = 0; k < NPARMS; ++k) {
+        parmnames[k] = "kipmid_parameter_" + to_string(k);
+        ofstream fout((pdir + parmnames[k]).c_str());
+        if (k % 4 == 3)
+            fout << "kcs" << endl;
+        else
+            fout << k * 1000 << endl;
+        if (!fout)
+            return false;
+    }
+    return true;
+}
+
+static void rmtree()
+{
+    string cmd = "rm -rf " + dir;
+
+    if (system(cmd.c_str()))
+        cerr << "parmbench: cannot remove " << dir << endl;
+}
+
+static void usage()
+{
+    cerr << "usage: parmbench [-n calls]\n\n"
+         << "  -n calls  calls per case, default 1000000, a hundredth\n"
+         << "            of that for refresh, which reads "
+         << NPARMS << " files a call\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    long n = 1000000;
+    int opt;
+    volatile int sink = 0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n': n = atol(optarg); break;
+        default: usage();
+        }
+    }
+    if (n < 100)
+        usage();
+
+    if (!mktree()) {
+        cerr << "parmbench: cannot make a parameter tree in /tmp" << endl;
+        return 1;
+    }
+
+    printf("%-12s %10s %10s %12s %12s %8s\n", "case", "old ns", "new ns",
+           "old allocs", "new allocs", "speedup");
+
+    for (uint c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        long calls = n / cases[c].div;
+        long long t0, t1, t2;
+        unsigned long a0, a1, a2;
+
+        // once each first, so the string values have settled
+        sink += cases[c].oldfn(0) + cases[c].newfn(0);
+
+        a0 = nallocs;
+        t0 = now_ns();
+        for (long i = 0; i < calls; ++i)
+            sink += cases[c].oldfn(i);
+        a1 = nallocs;
+        t1 = now_ns();
+        for (long i = 0; i < calls; ++i)
+            sink += cases[c].newfn(i);
+        a2 = nallocs;
+        t2 = now_ns();
+
+        printf("%-12s %10.1f %10.1f %12.2f %12.2f %7.1fx\n", cases[c].name,
+               (double)(t1 - t0) / calls, (double)(t2 - t1) / calls,
+               (double)(a1 - a0) / calls, (double)(a2 - a1) / calls,
+               (double)(t1 - t0) / (t2 - t1 ? t2 - t1 : 1));
+    }
+
+    rmtree();
+    return sink == 0x7fffffff;
+
+} // end of main()
@@ -0,0 +1,331 @@
+/******************************************************************************
+**
+**  parmdrift - group ipmiparm snapshots from a fleet by configuration
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  Reads the snapshots written by ipmiparm -S, files or whole directories
+**  of them, and sorts the hosts into clusters of identical ipmi_si,
+**  ipmi_msghandler and ipmi_watchdog settings. Each cluster is printed
+**  with the settings where it differs from the baseline, the approved
+**  snapshot given with -b or else the biggest cluster.
+**
+**  The snapshots are mapped and checked by a pool of threads, one per
+**  cpu by default; each thread only reads the hash and the hostname, so
+**  the work is the hash check over a few hundred bytes a file. Only one
+**  snapshot per cluster is ever decoded.
+**
+**  Very simple compile
+**
+**      $ g++ -O2 -o parmdrift parmdrift.cpp snapfile.cpp -lpthread
+**
+******************************************************************************/
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "snapfile.h"
+
+using namespace std;
+
+#define CLAIM       64      // snapshots a thread takes at a time
+#define HOSTLEN     64
+
+/**************************************************************
+ * snapinfo - what a worker keeps of one snapshot
+ *************************************************************/
+struct snapinfo {
+    uint64_t hash;
+    int      err;           // errno if the snapshot is unreadable
+    char     host[HOSTLEN];
+};
+
+/**************************************************************
+ * cluster - the snapshots with one configuration
+ *************************************************************/
+struct cluster {
+    uint64_t    hash;
+    vector<int> members;    // indexes into paths
+
+    bool operator<(const cluster& c) const
+        {return members.size() > c.members.size();}
+};
+
+static vector<string> paths;
+static vector<snapinfo> infos;
+static long nextpath = 0;
+
+/**************************************************************
+ * worker - map and check snapshots until there are none left
+ *
+ */
+static void *worker(void *)
+{
+    snapfile sf;
+
+    while (true) {
+        long first = __sync_fetch_and_add(&nextpath, CLAIM);
+        long last = min(first + CLAIM, (long)paths.size());
+
+        if (first >= (long)paths.size())
+            return NULL;
+
+        for (long i = first; i < last; ++i) {
+            snapinfo& si = infos[i];
+
+            if (sf.open(paths[i]) < 0) {
+                si.err = errno;
+                continue;
+            }
+            si.hash = sf.hdr->hash;
+            si.err = 0;
+            strncpy(si.host, sf.host, HOSTLEN - 1);
+            si.host[HOSTLEN - 1] = '\0';
+            sf.close();
+        }
+    }
+}
+
+/**************************************************************
+ * addpath - add a snapshot, or every file in a directory
+ *
+ */
+static void addpath(string path)
+{
+    struct stat st;
+    DIR *dir;
+    struct dirent *de;
+
+    if (stat(path.c_str(), &st) < 0 || !S_ISDIR(st.st_mode)) {
+        paths.push_back(path);
+        return;
+    }
+
+    if ((dir = opendir(path.c_str())) == NULL) {
+        cerr << "parmdrift: cannot read " << path << ": "
+             << strerror(errno) << endl;
+        return;
+    }
+    while ((de = readdir(dir)) != NULL)
+        if (de->d_name[0] != '.')
+            paths.push_back(path + "/" + de->d_name);
+    closedir(dir);
+}
+
+/**************************************************************
+ * printdiff - the settings where a cluster differs from the
+ *             baseline
+ *
+ * Both lists are sorted by name, as snapshots store them.
+ *
+ * Returns the number of settings that differ.
+ */
+static int printdiff(const vector<snapparm>& base, const vector<snapparm>& cfg,
+                     bool print)
+{
+    uint i = 0, j = 0;
+    int n = 0;
+
+    while (i < base.size() || j < cfg.size()) {
+        string name, from, to;
+
+        if (j == cfg.size()
+            || (i < base.size() && base[i].name < cfg[j].name)) {
+            name = base[i].name;
+            from = base[i++].valstr();
+            to = "(missing)";
+        } else if (i == base.size() || cfg[j].name < base[i].name) {
+            name = cfg[j].name;
+            from = "(missing)";
+            to = cfg[j++].valstr();
+        } else {
+            name = base[i].name;
+            from = base[i++].valstr();
+            to = cfg[j++].valstr();
+            if (from == to)
+                continue;
+        }
+
+        ++n;
+        if (print)
+            cout << "         " << left << setw(36) << name << right
+                 << " " << from << " -> " << to << endl;
+    }
+    return n;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void usage()
+{
+    cout << "usage: parmdrift [-b baseline] [-j threads] [-H hosts] snapshot|dir ...\n\n"
+         << "  -b file  the approved snapshot; default, the biggest cluster\n"
+         << "  -j n     threads reading snapshots, default one per cpu\n"
+         << "  -H n     hosts to name per cluster, default 5, -1 for all\n";
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    string basefile;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    long nhosts = 5;
+    long bad = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:j:H:")) != -1) {
+        switch (opt) {
+        case 'b': basefile = optarg; break;
+        case 'j': nthreads = atol(optarg); break;
+        case 'H': nhosts = atol(optarg); break;
+        default : usage();
+        }
+    }
+
+    if (optind == argc || nthreads < 1)
+        usage();
+
+    double t0 = now();
+
+    for (int i = optind; i < argc; ++i)
+        addpath(argv[i]);
+    infos.resize(paths.size());
+
+    if (nthreads > (long)(paths.size() + CLAIM - 1) / CLAIM)
+        nthreads = max((long)(paths.size() + CLAIM - 1) / CLAIM, 1L);
+
+    vector<pthread_t> tids(nthreads);
+    for (long t = 1; t < nthreads; ++t)
+        if (pthread_create(&tids[t], NULL, worker, NULL) != 0)
+            tids[t] = 0;
+    worker(NULL);
+    for (long t = 1; t < nthreads; ++t)
+        if (tids[t])
+            pthread_join(tids[t], NULL);
+
+    // Group by hash: sort the indexes of the good snapshots by hash
+    // and cut the runs.
+    //
+    vector<pair<uint64_t, int> > order;
+    for (uint i = 0; i < infos.size(); ++i) {
+        if (infos[i].err) {
+            cerr << "parmdrift: " << paths[i] << ": "
+                 << strerror(infos[i].err) << endl;
+            ++bad;
+        } else {
+            order.push_back(make_pair(infos[i].hash, (int)i));
+        }
+    }
+    sort(order.begin(), order.end());
+
+    vector<cluster> clusters;
+    for (uint i = 0; i < order.size(); ++i) {
+        if (i == 0 || order[i].first != order[i - 1].first) {
+            clusters.resize(clusters.size() + 1);
+            clusters.back().hash = order[i].first;
+        }
+        clusters.back().members.push_back(order[i].second);
+    }
+    stable_sort(clusters.begin(), clusters.end());
+
+    double t1 = now();
+
+    cout << "parmdrift: " << order.size() << " snapshots, " << bad
+         << " unreadable, " << clusters.size() << " configurations, "
+         << fixed << setprecision(2) << t1 - t0 << " s on " << nthreads
+         << " threads\n\n";
+
+    if (clusters.empty())
+        return bad ? 1 : 0;
+
+    snapfile sf;
+    vector<snapparm> base, cfg;
+    uint64_t basehash;
+
+    if (!basefile.empty()) {
+        if (sf.open(basefile) < 0 || sf.decode(base) < 0) {
+            cerr << "parmdrift: cannot read " << basefile << ": "
+                 << strerror(errno ? errno : EINVAL) << endl;
+            return 1;
+        }
+        basehash = sf.hdr->hash;
+    } else {
+        if (sf.open(paths[clusters[0].members[0]]) < 0
+            || sf.decode(base) < 0)
+            return 1;
+        basehash = clusters[0].hash;
+    }
+    sf.close();
+
+    cout << "  hosts  hash\n";
+
+    for (uint c = 0; c < clusters.size(); ++c) {
+        cluster& cl = clusters[c];
+        bool isbase = cl.hash == basehash;
+        int ndiff = 0;
+
+        if (!isbase) {
+            if (sf.open(paths[cl.members[0]]) < 0 || sf.decode(cfg) < 0)
+                continue;
+            sf.close();
+            ndiff = printdiff(base, cfg, false);
+        }
+
+        cout << setw(7) << cl.members.size() << "  " << hex << setfill('0')
+             << setw(16) << cl.hash << dec << setfill(' ') << "  ";
+        if (isbase)
+            cout << "baseline";
+        else
+            cout << ndiff << (ndiff == 1 ? " setting differs"
+                                         : " settings differ");
+        cout << endl;
+
+        if (!isbase)
+            printdiff(base, cfg, true);
+
+        if (nhosts != 0 && !isbase) {
+            long n = nhosts < 0 ? (long)cl.members.size()
+                                : min(nhosts, (long)cl.members.size());
+            cout << "         hosts:";
+            for (long i = 0; i < n; ++i)
+                cout << " " << infos[cl.members[i]].host;
+            if (n < (long)cl.members.size())
+                cout << " and " << cl.members.size() - n << " more";
+            cout << endl;
+        }
+    }
+
+    if (!basefile.empty() && clusters[0].hash != basehash) {
+        bool found = false;
+        for (uint c = 0; c < clusters.size(); ++c)
+            found |= clusters[c].hash == basehash;
+        if (!found)
+            cout << "\n  no host has the baseline configuration\n";
+    }
+
+    return bad ? 1 : 0;
+}
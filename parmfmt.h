@@ -0,0 +1,84 @@
+/******************************************************************************
+**
+**  parmfmt.h - allocation-free parsing and formatting for ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef PARMFMT_H
+#define PARMFMT_H
+
+#include <climits>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+#define FMT_INTLEN      (sizeof(long long) * CHAR_BIT + 2)  // binary, sign, NUL
+
+/**************************************************************
+ * parsestatus - what parseint made of its text
+ *************************************************************/
+enum parsestatus {
+    PARSE_OK,
+    PARSE_EMPTY,            // nothing but white space
+    PARSE_INVALID,          // not a number in the radix, or junk after it
+    PARSE_RANGE,            // a number, but it doesn't fit
+};
+
+/**************************************************************
+ * Numbers
+ *
+ * parseint takes the whole of s, less surrounding white space, as
+ * one number in radix 10 or 16; in radix 16 an 0x prefix is also
+ * taken. A sign is taken in either. Nothing is allocated and no
+ * locale is consulted.
+ *
+ * fmtint and fmtbin write into a caller's buffer, NUL terminated,
+ * and return the length, or 0 if it doesn't fit.
+ *************************************************************/
+std::string_view trim(std::string_view s);
+parsestatus parseint(std::string_view s, int radix, int& num);
+parsestatus parseint(std::string_view s, int radix, long long& num);
+size_t fmtint(char *buf, size_t len, long long num, int radix);
+size_t fmtbin(char *buf, size_t len, unsigned long long num, int bits);
+
+/**************************************************************
+ * Text
+ *
+ * splitws stores up to max white space separated tokens of s as
+ * views into s and returns how many there are, which may be more
+ * than max. nextline takes the first line off s, without its
+ * newline.
+ *************************************************************/
+size_t splitws(std::string_view s, std::string_view *tok, size_t max);
+std::string_view nextline(std::string_view& s);
+
+/**************************************************************
+ * class textfile - reads small sysfs and procfs files
+ *
+ * The path is built in and the file read into buffers that are
+ * part of the object, so rereading a set of files, as refresh
+ * does on every sample, allocates nothing.
+ *************************************************************/
+class textfile {
+public:
+    textfile() {path[0] = '\0';}
+
+    const char *setpath(std::initializer_list<std::string_view> parts);
+    bool   read(std::string_view& text);
+
+    char   path[4096];
+
+private:
+    char   buf[4096];
+};
+
+#endif // PARMFMT_H
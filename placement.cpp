@@ -0,0 +1,359 @@
+/******************************************************************************
+**
+**  placement.cpp - kipmid thread and IPMI IRQ CPU placement for ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  The kipmid threads are found by their comm name in /proc/<pid>/comm,
+**  and the IPMI interrupt lines by the action names in /proc/interrupts.
+**  Everything is read and written directly through procfs, so none of
+**  this forks a shell.
+**
+******************************************************************************/
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <sched.h>
+
+#include "placement.h"
+
+using namespace std;
+
+/**************************************************************
+ * placement::discover - rescan for kipmid threads and ipmi irqs
+ *
+ * Returns the total number of threads and irqs found.
+ */
+int placement::discover()
+{
+    threads.clear();
+    irqs.clear();
+    findthreads();
+    findirqs();
+    return threads.size() + irqs.size();
+}
+
+/**************************************************************
+ * placement::findthreads - walk /proc looking for kipmi<n>
+ *
+ */
+void placement::findthreads()
+{
+    DIR *dp = opendir("/proc");
+    struct dirent *de;
+
+    if (dp == NULL)
+        return;
+
+    while ((de = readdir(dp)) != NULL) {
+        char *end;
+        long pid = strtol(de->d_name, &end, 10);
+
+        if (*end != '\0' || pid <= 0)
+            continue;
+
+        ifstream comm((string("/proc/") + de->d_name + "/comm").c_str());
+        string name;
+
+        if (!getline(comm, name) || name.compare(0, 5, "kipmi") != 0)
+            continue;
+
+        kthread kt;
+        kt.pid = pid;
+        kt.comm = name;
+        readthread(kt);
+        threads.push_back(kt);
+    }
+    closedir(dp);
+}
+
+/**************************************************************
+ * placement::readthread - fetch the affinity and scheduling
+ *                         class of a kipmid thread
+ *
+ */
+void placement::readthread(kthread& kt)
+{
+    cpu_set_t set;
+    struct sched_param sp;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(kt.pid, sizeof(set), &set) == 0)
+        kt.cpus = formatcpus(set);
+    else
+        kt.cpus = "?";
+
+    kt.policy = sched_getscheduler(kt.pid);
+    kt.prio = sched_getparam(kt.pid, &sp) == 0 ? sp.sched_priority : 0;
+}
+
+/**************************************************************
+ * placement::readticks - update the cpu time used by each kipmid
+ *                        thread from /proc/<pid>/stat
+ *
+ * utime and stime are fields 14 and 15. The comm field can hold
+ * spaces, so counting starts after its closing parenthesis.
+ */
+void placement::readticks()
+{
+    char path[64];
+    char line[512];
+
+    for (uint i = 0; i < threads.size(); ++i) {
+        kthread& kt = threads[i];
+        unsigned long long ut, st;
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", kt.pid);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+            continue;
+
+        char *p = fgets(line, sizeof(line), fp) ? strrchr(line, ')') : NULL;
+        if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+                        " %llu %llu", &ut, &st) == 2)
+            kt.ticks = ut + st;
+        fclose(fp);
+    }
+}
+
+/**************************************************************
+ * placement::findirqs - parse /proc/interrupts for ipmi lines
+ *
+ * A line looks like
+ *
+ *   19:     0    12   IO-APIC   19-fasteoi   ipmi_si
+ *
+ * Only numbered lines whose action names mention ipmi are kept.
+ */
+void placement::findirqs()
+{
+    ifstream fin("/proc/interrupts");
+    string line;
+
+    getline(fin, line);                 // skip the CPU header
+
+    while (getline(fin, line)) {
+        size_t colon = line.find(':');
+        if (colon == string::npos || line.find("ipmi") == string::npos)
+            continue;
+
+        char *end;
+        string irqstr = line.substr(0, colon);
+        long irq = strtol(irqstr.c_str(), &end, 10);
+        if (end == irqstr.c_str() || irq < 0)
+            continue;
+
+        // The action name is the last field on the line.
+        //
+        stringstream ss(line.substr(colon + 1));
+        string tok;
+        ipmiirq iq;
+        iq.irq = irq;
+        while (ss >> tok)
+            iq.name = tok;
+
+        ifstream aff(("/proc/irq/" + irqstr.substr(irqstr.find_first_not_of(' '))
+                     + "/smp_affinity_list").c_str());
+        if (!getline(aff, iq.cpus))
+            iq.cpus = "?";
+
+        irqs.push_back(iq);
+    }
+}
+
+/**************************************************************
+ * placement::setaffinity - pin a kipmid thread to a cpu list
+ *
+ * Returns 0 on success, else -1 with errno set.
+ */
+int placement::setaffinity(kthread& kt, string cpus)
+{
+    cpu_set_t set;
+
+    if (!parsecpus(cpus, set)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (sched_setaffinity(kt.pid, sizeof(set), &set) < 0)
+        return -1;
+
+    readthread(kt);
+    return 0;
+}
+
+/**************************************************************
+ * placement::setsched - set the scheduling class of a kipmid thread
+ *
+ * prio is ignored for the non-realtime classes.
+ *
+ * Returns 0 on success, else -1 with errno set.
+ */
+int placement::setsched(kthread& kt, int policy, int prio)
+{
+    struct sched_param sp;
+
+    if (policy < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sp.sched_priority = (policy == SCHED_FIFO || policy == SCHED_RR) ? prio : 0;
+    if (sched_setscheduler(kt.pid, policy, &sp) < 0)
+        return -1;
+
+    readthread(kt);
+    return 0;
+}
+
+/**************************************************************
+ * placement::setirqaffinity - write /proc/irq/N/smp_affinity_list
+ *
+ * Returns 0 on success, else -1 with errno set.
+ */
+int placement::setirqaffinity(ipmiirq& iq, string cpus)
+{
+    cpu_set_t set;
+    stringstream path;
+
+    if (!parsecpus(cpus, set)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    path << "/proc/irq/" << iq.irq << "/smp_affinity_list";
+
+    // The kernel rejects a bad mask at write time, which an ofstream
+    // would only report on flush, so check the stream after closing.
+    //
+    ofstream fout(path.str().c_str());
+    if (!fout)
+        return -1;
+    fout << formatcpus(set) << endl;
+    fout.close();
+    if (fout.fail()) {
+        if (errno == 0)
+            errno = EIO;
+        return -1;
+    }
+
+    ifstream fin(path.str().c_str());
+    getline(fin, iq.cpus);
+    return 0;
+}
+
+/**************************************************************
+ * placement::parsecpus - parse a cpu list like "0-3,6,8-9"
+ *
+ * Trailing white space, as read from sysfs, is allowed; anything
+ * else after the last range, a dangling comma included, is not.
+ *
+ * Returns true if the list was well formed and not empty.
+ */
+bool placement::parsecpus(const string& str, cpu_set_t& set)
+{
+    const char *p = str.c_str();
+    char *end;
+
+    CPU_ZERO(&set);
+
+    while (true) {
+        if (!isdigit((unsigned char)*p))
+            return false;
+        long lo = strtol(p, &end, 10);
+        long hi = lo;
+        p = end;
+
+        if (*p == '-') {
+            if (!isdigit((unsigned char)*++p))
+                return false;
+            hi = strtol(p, &end, 10);
+            if (hi < lo)
+                return false;
+            p = end;
+        }
+
+        if (hi >= CPU_SETSIZE)
+            return false;
+
+        for (long c = lo; c <= hi; ++c)
+            CPU_SET(c, &set);
+
+        if (*p != ',')
+            break;
+        ++p;
+    }
+
+    while (isspace((unsigned char)*p))
+        ++p;
+    return *p == '\0' && CPU_COUNT(&set) > 0;
+}
+
+/**************************************************************
+ * placement::formatcpus - render a cpu set in cpu list format
+ *
+ */
+string placement::formatcpus(const cpu_set_t& set)
+{
+    stringstream ss;
+    bool first = true;
+
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+        if (!CPU_ISSET(c, &set))
+            continue;
+
+        int lo = c;
+        while (c + 1 < CPU_SETSIZE && CPU_ISSET(c + 1, &set))
+            ++c;
+
+        ss << (first ? "" : ",") << lo;
+        if (c > lo)
+            ss << "-" << c;
+        first = false;
+    }
+    return ss.str();
+}
+
+/**************************************************************
+ * placement::policystr - scheduling policy to its short name
+ *
+ */
+string placement::policystr(int policy)
+{
+    switch (policy) {
+    case SCHED_OTHER: return "other";
+    case SCHED_FIFO:  return "fifo";
+    case SCHED_RR:    return "rr";
+    case SCHED_BATCH: return "batch";
+    case SCHED_IDLE:  return "idle";
+    }
+    return "?";
+}
+
+/**************************************************************
+ * placement::strpolicy - short name to scheduling policy
+ *
+ * Returns -1 if the name is not recognized.
+ */
+int placement::strpolicy(const string& str)
+{
+    if (str == "other") return SCHED_OTHER;
+    if (str == "fifo")  return SCHED_FIFO;
+    if (str == "rr")    return SCHED_RR;
+    if (str == "batch") return SCHED_BATCH;
+    if (str == "idle")  return SCHED_IDLE;
+    return -1;
+}
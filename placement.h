@@ -0,0 +1,79 @@
+/******************************************************************************
+**
+**  placement.h - kipmid thread and IPMI IRQ CPU placement for ipmiparm
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sched.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+/**************************************************************
+ * class kthread - a kipmid kernel thread
+ *************************************************************/
+class kthread {
+public:
+    kthread() {pid = 0; policy = SCHED_OTHER; prio = 0; ticks = 0;}
+
+    pid_t  pid;
+    std::string comm;       // kipmi0, kipmi1, ...
+    std::string cpus;       // affinity in cpu list format, e.g. 0-3,6
+    int    policy;          // SCHED_OTHER, SCHED_FIFO, ...
+    int    prio;            // rt priority for FIFO and RR, else 0
+    unsigned long long ticks;   // utime + stime in clock ticks
+};
+
+/**************************************************************
+ * class ipmiirq - an interrupt line owned by an ipmi driver
+ *************************************************************/
+class ipmiirq {
+public:
+    ipmiirq() {irq = -1;}
+
+    int    irq;
+    std::string name;       // action name from /proc/interrupts
+    std::string cpus;       // smp_affinity_list contents
+};
+
+/**************************************************************
+ * class placement - finds and places the kipmid threads and
+ *                   the IPMI interrupt lines.
+ *************************************************************/
+class placement {
+public:
+    placement() {}
+
+    int    discover();
+    int    setaffinity(kthread& kt, std::string cpus);
+    int    setsched(kthread& kt, int policy, int prio);
+    int    setirqaffinity(ipmiirq& iq, std::string cpus);
+    void   readticks();
+
+    static bool   parsecpus(const std::string& str, cpu_set_t& set);
+    static std::string formatcpus(const cpu_set_t& set);
+    static std::string policystr(int policy);
+    static int    strpolicy(const std::string& str);
+
+    std::vector<kthread> threads;
+    std::vector<ipmiirq> irqs;
+
+private:
+    void   findthreads();
+    void   findirqs();
+    void   readthread(kthread& kt);
+};
+
+#endif // PLACEMENT_H
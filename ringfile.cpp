@@ -0,0 +1,386 @@
+/******************************************************************************
+**
+**  ringfile.cpp - fixed-size, memory-mapped, delta-encoded sample recorder
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  The file never grows once created: the writer only stores into the
+**  mapping, and the encode buffer is sized once for the worst case, so a
+**  recorder runs in constant memory for as long as it runs.
+**
+******************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ringfile.h"
+
+using namespace std;
+
+#define VARINT_MAX      10      // bytes in the longest 64-bit varint
+
+/**************************************************************
+ * putvarint - append an unsigned LEB128 varint to a buffer
+ *
+ * Returns the number of bytes stored.
+ */
+static int putvarint(uint8_t *p, uint64_t v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/**************************************************************
+ * getvarint - decode an unsigned LEB128 varint
+ *
+ * Returns the number of bytes consumed, or 0 if the varint runs
+ * past end.
+ */
+static int getvarint(const uint8_t *p, const uint8_t *end, uint64_t& v)
+{
+    int n = 0;
+    int shift = 0;
+
+    v = 0;
+    while (p + n < end && shift < 64) {
+        uint8_t b = p[n++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return n;
+        shift += 7;
+    }
+    return 0;
+}
+
+static inline uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**************************************************************
+ * ringfile::mapfile - map the whole file and point hdr and ring
+ *                     into the mapping
+ *
+ * Returns 0 on success, else -1.
+ */
+int ringfile::mapfile(int prot)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ringhdr))
+        return -1;
+
+    maplen = st.st_size;
+    map = (uint8_t *)mmap(NULL, maplen, prot, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return -1;
+    }
+
+    hdr = (ringhdr *)map;
+    if (memcmp(hdr->magic, RING_MAGIC, sizeof(hdr->magic))
+        || hdr->version != RING_VERSION
+        || hdr->ringoff + hdr->ringsize > maplen
+        || sizeof(ringhdr) + hdr->nameslen > hdr->ringoff) {
+        errno = EINVAL;
+        return -1;
+    }
+    ring = map + hdr->ringoff;
+
+    names.clear();
+    const char *p = (const char *)(map + sizeof(ringhdr));
+    const char *end = p + hdr->nameslen;
+    while (p < end && names.size() < hdr->nfields) {
+        names.push_back(p);
+        p += strlen(p) + 1;
+    }
+    return names.size() == hdr->nfields ? 0 : -1;
+}
+
+/**************************************************************
+ * ringfile::create - open a ring file for recording
+ *
+ * A new or empty file is made a ring of size bytes, RING_DEFSIZE
+ * if size is 0. A ring file holding the same fields is reused,
+ * keeping its history, as long as size is 0 or its own size. A
+ * ring file holding other fields, e.g. from before a module update
+ * added a parameter, is recreated. Any other file is left alone.
+ *
+ * Returns 0 on success, else -1 with errno set. errno is EEXIST
+ * for a ring of the same fields but another size, which ringsize
+ * then gives, and EINVAL for a file that is not a ring file.
+ */
+int ringfile::create(string path, const vector<string>& fields, size_t size)
+{
+    string blob;
+    struct stat st;
+    char magic[sizeof(hdr->magic)];
+
+    for (uint i = 0; i < fields.size(); ++i)
+        blob.append(fields[i].c_str(), fields[i].size() + 1);
+
+    close();
+    if ((fd = open(path.c_str(), O_RDWR | O_CREAT, 0644)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if (st.st_size > 0
+        && (pread(fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)
+            || memcmp(magic, RING_MAGIC, sizeof(magic)))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (st.st_size > 0 && mapfile(PROT_READ | PROT_WRITE) == 0
+        && names == fields) {
+        if (size != 0 && hdr->ringsize != size) {
+            errno = EEXIST;
+            return -1;
+        }
+    } else {
+        uint64_t ringoff = (sizeof(ringhdr) + blob.size() + 4095) & ~4095ULL;
+
+        if (size == 0)
+            size = RING_DEFSIZE;
+
+        if (map)
+            munmap(map, maplen);
+        map = NULL;
+        hdr = NULL;
+
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, ringoff + size) < 0)
+            return -1;
+
+        ringhdr h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, RING_MAGIC, sizeof(h.magic));
+        h.version = RING_VERSION;
+        h.nfields = fields.size();
+        h.nameslen = blob.size();
+        h.keyevery = RING_KEYEVERY;
+        h.ringoff = ringoff;
+        h.ringsize = size;
+
+        if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h)
+            || pwrite(fd, blob.data(), blob.size(), sizeof(h))
+               != (ssize_t)blob.size()
+            || mapfile(PROT_READ | PROT_WRITE) < 0)
+            return -1;
+    }
+
+    last.assign(hdr->nfields, 0);
+    buf.resize(1 + 2 * VARINT_MAX + hdr->nfields * VARINT_MAX);
+    havelast = false;
+    return 0;
+}
+
+/**************************************************************
+ * ringfile::openread - open a ring file for export
+ *
+ * Returns 0 on success, else -1.
+ */
+int ringfile::openread(string path)
+{
+    close();
+    if ((fd = open(path.c_str(), O_RDONLY)) < 0)
+        return -1;
+    return mapfile(PROT_READ);
+}
+
+void ringfile::close()
+{
+    if (map) {
+        msync(map, maplen, MS_ASYNC);
+        munmap(map, maplen);
+    }
+    if (fd >= 0)
+        ::close(fd);
+    map = NULL;
+    hdr = NULL;
+    ring = NULL;
+    fd = -1;
+}
+
+/**************************************************************
+ * ringfile::put - copy bytes into the ring at a running position
+ *
+ */
+void ringfile::put(uint64_t pos, const uint8_t *src, size_t len)
+{
+    size_t off = pos % hdr->ringsize;
+    size_t n = hdr->ringsize - off < len ? hdr->ringsize - off : len;
+
+    memcpy(ring + off, src, n);
+    memcpy(ring, src + n, len - n);
+}
+
+/**************************************************************
+ * ringfile::get - copy bytes out of a ring image at a running
+ *                 position
+ *
+ */
+void ringfile::get(const uint8_t *from, uint64_t pos, uint8_t *dst, size_t len)
+{
+    size_t off = pos % hdr->ringsize;
+    size_t n = hdr->ringsize - off < len ? hdr->ringsize - off : len;
+
+    memcpy(dst, from + off, n);
+    memcpy(dst + n, from, len - n);
+}
+
+/**************************************************************
+ * ringfile::append - add a record to the ring
+ *
+ * The oldest records are dropped to make room. tail is advanced
+ * before their bytes are overwritten and head only after the new
+ * record is complete, so a concurrent reader never sees a partly
+ * written record between tail and head.
+ *
+ * Returns 0 on success, else -1.
+ */
+int ringfile::append(int64_t ms, const vector<int64_t>& vals)
+{
+    uint8_t *body = &buf[VARINT_MAX];
+    uint8_t lenbuf[VARINT_MAX];
+    bool key;
+    int n = 0;
+
+    if (hdr == NULL || vals.size() != hdr->nfields)
+        return -1;
+
+    key = !havelast || hdr->records % hdr->keyevery == 0;
+
+    body[n++] = key ? 'K' : 'D';
+    n += putvarint(body + n, zigzag(key ? ms : ms - lastms));
+    for (uint i = 0; i < vals.size(); ++i)
+        n += putvarint(body + n, zigzag(key ? vals[i] : vals[i] - last[i]));
+
+    int ln = putvarint(lenbuf, n);
+    uint64_t need = ln + n;
+    if (need > hdr->ringsize)
+        return -1;
+
+    uint64_t head = hdr->head;
+    uint64_t tail = hdr->tail;
+
+    while (head + need - tail > hdr->ringsize) {
+        uint8_t tmp[VARINT_MAX];
+        uint64_t len;
+        get(ring, tail, tmp, sizeof(tmp));
+        int m = getvarint(tmp, tmp + sizeof(tmp), len);
+        if (m == 0)
+            return -1;
+        tail += m + len;
+    }
+    __atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+
+    memcpy(body - ln, lenbuf, ln);
+    put(head, body - ln, need);
+
+    __atomic_store_n(&hdr->head, head + need, __ATOMIC_RELEASE);
+    hdr->records++;
+
+    last = vals;
+    lastms = ms;
+    havelast = true;
+    return 0;
+}
+
+/**************************************************************
+ * ringfile::exportcsv - write the records in a time range as CSV
+ *
+ * from and to are in milliseconds since the epoch, 0 for no limit.
+ * The ring is copied out first so the recorder can keep running.
+ * Anything it overwrote during the copy lies before the tail it
+ * published afterwards, so decoding starts from that tail.
+ *
+ * Returns the number of rows written.
+ */
+int ringfile::exportcsv(ostream& out, int64_t from, int64_t to)
+{
+    vector<uint8_t> img(hdr->ringsize);
+    vector<int64_t> vals(hdr->nfields, 0);
+    vector<uint8_t> rec;
+    int64_t ms = 0;
+    bool synced = false;
+    int rows = 0;
+
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    memcpy(&img[0], ring, hdr->ringsize);
+    uint64_t pos = __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+
+    out << "time_ms";
+    for (uint i = 0; i < names.size(); ++i)
+        out << "," << names[i];
+    out << "\n";
+
+    while (pos < head) {
+        uint8_t tmp[VARINT_MAX];
+        uint64_t len;
+        get(&img[0], pos, tmp, sizeof(tmp));
+        int m = getvarint(tmp, tmp + sizeof(tmp), len);
+        if (m == 0 || len == 0 || pos + m + len > head)
+            break;
+
+        rec.resize(len);
+        get(&img[0], pos + m, &rec[0], len);
+        pos += m + len;
+
+        const uint8_t *p = &rec[0];
+        const uint8_t *end = p + len;
+        bool key = *p++ == 'K';
+        uint64_t v;
+
+        if (!key && !synced)
+            continue;
+
+        if ((m = getvarint(p, end, v)) == 0)
+            break;
+        p += m;
+        ms = key ? unzigzag(v) : ms + unzigzag(v);
+
+        uint i;
+        for (i = 0; i < vals.size(); ++i) {
+            if ((m = getvarint(p, end, v)) == 0)
+                break;
+            p += m;
+            vals[i] = key ? unzigzag(v) : vals[i] + unzigzag(v);
+        }
+        if (i < vals.size())
+            break;
+        synced = true;
+
+        if ((from && ms < from) || (to && ms > to))
+            continue;
+
+        out << ms;
+        for (i = 0; i < vals.size(); ++i)
+            out << "," << vals[i];
+        out << "\n";
+        ++rows;
+    }
+    return rows;
+}
@@ -0,0 +1,93 @@
+/******************************************************************************
+**
+**  ringfile.h - fixed-size, memory-mapped, delta-encoded sample recorder
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef RINGFILE_H
+#define RINGFILE_H
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define RING_MAGIC      "IPMIREC1"
+#define RING_VERSION    1
+#define RING_KEYEVERY   64      // a keyframe every this many records
+#define RING_DEFSIZE    (1024 * 1024)   // ring of a new file given size 0
+
+/**************************************************************
+ * ringhdr - the header at the start of the ring file
+ *
+ * head and tail are running byte counts, so the oldest and the
+ * next record are at tail and head modulo ringsize, and the ring
+ * is full when head - tail reaches ringsize. The field names
+ * follow the header as NUL terminated strings.
+ *************************************************************/
+struct ringhdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nfields;
+    uint32_t nameslen;
+    uint32_t keyevery;
+    uint64_t ringoff;       // file offset of the ring
+    uint64_t ringsize;      // bytes in the ring
+    uint64_t head;
+    uint64_t tail;
+    uint64_t records;       // records ever written
+};
+
+/**************************************************************
+ * class ringfile - writer and reader of a ring file
+ *
+ * Each record is a varint body length followed by the body: a
+ * type byte, K for a keyframe or D for a delta, then the time in
+ * milliseconds and one zigzag varint per field. Keyframes hold
+ * absolute values, deltas the change since the previous record.
+ * Once the ring wraps the oldest records can be deltas whose
+ * keyframe was overwritten; readers skip to the next keyframe.
+ *************************************************************/
+class ringfile {
+public:
+    ringfile() {fd = -1; map = NULL; maplen = 0; hdr = NULL; ring = NULL;
+                havelast = false;}
+    ~ringfile() {close();}
+
+    int    create(std::string path, const std::vector<std::string>& fields,
+                  size_t size);
+    int    openread(std::string path);
+    int    append(int64_t ms, const std::vector<int64_t>& vals);
+    int    exportcsv(std::ostream& out, int64_t from, int64_t to);
+    void   close();
+    size_t ringsize() {return hdr ? hdr->ringsize : 0;}
+
+    std::vector<std::string> names;
+
+private:
+    int      fd;
+    uint8_t *map;
+    size_t   maplen;
+    ringhdr *hdr;
+    uint8_t *ring;
+
+    std::vector<int64_t> last;  // values of the previous record written
+    int64_t  lastms;
+    bool     havelast;
+    std::vector<uint8_t> buf;   // reused encode buffer
+
+    int    mapfile(int flags);
+    void   put(uint64_t pos, const uint8_t *src, size_t len);
+    void   get(const uint8_t *from, uint64_t pos, uint8_t *dst, size_t len);
+};
+
+#endif // RINGFILE_H
@@ -0,0 +1,165 @@
+/*
+ * sdrbench - time the sdrconv kernels
+ *
+ * Builds -s sensors with random SDR factors, formats and thresholds,
+ * and converts -r passes of random raw readings with the C, SSE2 and
+ * AVX2 kernels, checking every pass against the C kernel bit for bit.
+ *
+ *	$ gcc -O2 -o sdrbench sdrbench.c sdrconv.c -lm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sdrconv.h"
+
+typedef void (*kernel_fn)(const struct sdr_soa *, const uint8_t *,
+			  float *, uint8_t *, size_t);
+
+static void convert_c(const struct sdr_soa *s, const uint8_t *raw,
+		      float *y, uint8_t *status, size_t n)
+{
+	sdr_convert_c(s, raw, y, status, 0, n);
+}
+
+static const struct {
+	const char	*name;
+	kernel_fn	fn;
+	const char	*cpu;		/* NULL for any */
+} kernels[] = {
+	{ "c",    convert_c,        NULL },
+	{ "sse2", sdr_convert_sse,  "sse2" },
+	{ "avx2", sdr_convert_avx2, "avx2" },
+};
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cpu_has(const char *cpu)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (!strcmp(cpu, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	if (!strcmp(cpu, "sse2"))
+		return __builtin_cpu_supports("sse2");
+#endif
+	(void)cpu;
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: sdrbench [-s sensors] [-r passes]\n\n"
+		"  -s sensors  sensors per pass, default 100000\n"
+		"  -r passes   passes per kernel, default 200\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sdr_soa s;
+	size_t nsens = 100000, i;
+	int passes = 200, opt, k, p;
+	uint8_t *raw, *st, *refst;
+	float *y, *refy;
+	double base = 0;
+
+	while ((opt = getopt(argc, argv, "s:r:")) != -1) {
+		switch (opt) {
+		case 's': nsens = atol(optarg); break;
+		case 'r': passes = atoi(optarg); break;
+		default: usage();
+		}
+	}
+	if (nsens == 0 || passes <= 0)
+		usage();
+
+	srandom(1);
+	if (sdr_soa_init(&s, nsens) < 0) {
+		perror("sdrbench");
+		return 1;
+	}
+	for (i = 0; i < nsens; i++) {
+		uint8_t th[SDR_NTHRESH];
+		int lo = random() % 64, hi = 192 + random() % 64;
+
+		th[SDR_T_LNR] = lo;
+		th[SDR_T_LCR] = lo + 8;
+		th[SDR_T_LNC] = lo + 16;
+		th[SDR_T_UNC] = hi - 16;
+		th[SDR_T_UCR] = hi - 8;
+		th[SDR_T_UNR] = hi;
+		sdr_soa_add(&s, random() % 1024 - 512, random() % 1024 - 512,
+			    random() % 16 - 8, random() % 16 - 8,
+			    random() % 16 ? random() % 3 : SDR_NOANALOG, 0,
+			    th, random() % 64);
+	}
+
+	raw = malloc(nsens * passes);
+	y = malloc(nsens * sizeof(float));
+	refy = malloc(nsens * sizeof(float));
+	st = malloc(nsens);
+	refst = malloc(nsens);
+	if (!raw || !y || !refy || !st || !refst) {
+		perror("sdrbench");
+		return 1;
+	}
+	for (i = 0; i < nsens * passes; i++)
+		raw[i] = random();
+
+	printf("%zu sensors, %d passes, sdr_convert uses %s\n\n",
+	       nsens, passes, sdr_kernel());
+	printf("%-6s %12s %12s %10s\n", "kernel", "ns/reading", "Mreadings/s",
+	       "speedup");
+
+	for (k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++) {
+		int64_t t0, t;
+		size_t bad = 0;
+		double ns;
+
+		if (kernels[k].cpu && !cpu_has(kernels[k].cpu)) {
+			printf("%-6s %12s\n", kernels[k].name, "n/a");
+			continue;
+		}
+
+		t0 = now_ns();
+		for (p = 0; p < passes; p++)
+			kernels[k].fn(&s, raw + (size_t)p * nsens, y, st, nsens);
+		t = now_ns() - t0;
+
+		// then every pass again, untimed, bit for bit against the
+		// C kernel
+		//
+		for (p = 0; p < passes; p++) {
+			const uint8_t *r = raw + (size_t)p * nsens;
+
+			kernels[k].fn(&s, r, y, st, nsens);
+			sdr_convert_c(&s, r, refy, refst, 0, nsens);
+			for (i = 0; i < nsens; i++)
+				if (memcmp(&y[i], &refy[i], sizeof(float))
+				    || st[i] != refst[i])
+					bad++;
+		}
+
+		ns = (double)t / ((double)nsens * passes);
+		if (base == 0)
+			base = ns;
+		printf("%-6s %12.3f %12.1f %9.1fx", kernels[k].name, ns,
+		       1e3 / ns, base / ns);
+		if (bad)
+			printf("  %zu MISMATCHES", bad);
+		printf("\n");
+	}
+
+	sdr_soa_free(&s);
+	return 0;
+}
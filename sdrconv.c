@@ -0,0 +1,374 @@
+/*
+ * sdrconv.c - bulk conversion of raw IPMI sensor readings, see sdrconv.h
+ *
+ * The vector kernels use a separate multiply and add, not FMA, and
+ * contraction is off for the whole file, so they round exactly as the
+ * C code does. That matters at the thresholds: a reading equal to a
+ * threshold converts to the same float as the threshold did, and the
+ * <= or >= compare has to see that.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include "sdrconv.h"
+
+#ifdef __GNUC__
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SDR_HAVE_X86	1
+#endif
+
+/*
+ * spread8[m] has byte j set to 1 where bit j of m is set, which turns
+ * a compare's movemask into one status bit per sensor.
+ */
+static uint64_t spread8[256];
+static uint32_t spread4[16];
+
+static void init_spread(void)
+{
+	int m, j;
+
+	if (spread8[255])
+		return;
+	for (m = 0; m < 256; m++)
+		for (j = 0; j < 8; j++)
+			if (m & (1 << j)) {
+				spread8[m] |= (uint64_t)1 << (8 * j);
+				if (m < 16)
+					spread4[m] |= (uint32_t)1 << (8 * j);
+			}
+}
+
+static int grow(struct sdr_soa *s, size_t cap)
+{
+	struct sdr_soa t = *s;
+	float **fa[3 + SDR_NTHRESH];
+	int i, k;
+
+	/* aligned_alloc wants a size that is a multiple of the alignment */
+	cap = (cap + 31) & ~(size_t)31;
+	fa[0] = &t.mul;
+	fa[1] = &t.add;
+	fa[2] = &t.wrap;
+	for (k = 0; k < SDR_NTHRESH; k++)
+		fa[3 + k] = &t.thresh[k];
+
+	for (i = 0; i < 3 + SDR_NTHRESH; i++) {
+		float *p = aligned_alloc(32, cap * sizeof(float));
+
+		if (p == NULL)
+			goto fail;
+		if (s->n)
+			memcpy(p, *fa[i], s->n * sizeof(float));
+		*fa[i] = p;
+	}
+	t.lin = aligned_alloc(32, cap);
+	if (t.lin == NULL)
+		goto fail;
+	if (s->n)
+		memcpy(t.lin, s->lin, s->n);
+	t.cap = cap;
+
+	sdr_soa_free(s);
+	*s = t;
+	return 0;
+
+fail:
+	while (i-- > 0)
+		free(*fa[i]);
+	errno = ENOMEM;
+	return -1;
+}
+
+int sdr_soa_init(struct sdr_soa *s, size_t cap)
+{
+	init_spread();
+	memset(s, 0, sizeof(*s));
+	return grow(s, cap ? cap : 8);
+}
+
+void sdr_soa_free(struct sdr_soa *s)
+{
+	int k;
+
+	free(s->mul);
+	free(s->add);
+	free(s->wrap);
+	for (k = 0; k < SDR_NTHRESH; k++)
+		free(s->thresh[k]);
+	free(s->lin);
+	s->mul = s->add = s->wrap = NULL;
+	memset(s->thresh, 0, sizeof(s->thresh));
+	s->lin = NULL;
+	s->n = s->cap = s->nlin = 0;
+}
+
+static float linearize(int lin, float y)
+{
+	switch (lin) {
+	case 1:	 return logf(y);
+	case 2:	 return log10f(y);
+	case 3:	 return log2f(y);
+	case 4:	 return expf(y);
+	case 5:	 return powf(10.0f, y);
+	case 6:	 return exp2f(y);
+	case 7:	 return 1.0f / y;
+	case 8:	 return y * y;
+	case 9:	 return y * y * y;
+	case 10: return sqrtf(y);
+	case 11: return cbrtf(y);
+	default: return y;
+	}
+}
+
+static inline float linear1(const struct sdr_soa *s, size_t i, uint8_t x)
+{
+	float xf = x;
+
+	if (x >= 128)
+		xf -= s->wrap[i];
+	return s->mul[i] * xf + s->add[i];
+}
+
+static inline uint8_t status1(const struct sdr_soa *s, size_t i, float y)
+{
+	if (y != y)
+		return SDR_INVALID;
+	return (y <= s->thresh[SDR_T_LNC][i] ? SDR_LNC : 0)
+	     | (y <= s->thresh[SDR_T_LCR][i] ? SDR_LCR : 0)
+	     | (y <= s->thresh[SDR_T_LNR][i] ? SDR_LNR : 0)
+	     | (y >= s->thresh[SDR_T_UNC][i] ? SDR_UNC : 0)
+	     | (y >= s->thresh[SDR_T_UCR][i] ? SDR_UCR : 0)
+	     | (y >= s->thresh[SDR_T_UNR][i] ? SDR_UNR : 0);
+}
+
+/*
+ * Sensor i's raw reading x in units.
+ */
+float sdr_convert1(const struct sdr_soa *s, size_t i, uint8_t x)
+{
+	float y = linear1(s, i, x);
+
+	return s->lin[i] ? linearize(s->lin[i], y) : y;
+}
+
+/*
+ * Add a sensor from its full SDR fields: M and B as the signed 10-bit
+ * values, the signed 4-bit exponents, the analog data format and
+ * linearization, and the raw thresholds with the readable mask (bit k
+ * for threshold k). Returns its index, or -1 if out of memory.
+ *
+ * OEM non-linear sensors (linearization 0x70-0x7f) need Get Sensor
+ * Reading Factors for every reading; they are taken as linear with
+ * the factors in the SDR.
+ */
+int sdr_soa_add(struct sdr_soa *s, int m, int b, int bexp, int rexp,
+		int format, int lin, const uint8_t raw[SDR_NTHRESH],
+		unsigned readable)
+{
+	size_t i = s->n;
+	int k;
+
+	if (i == s->cap && grow(s, s->cap * 2) < 0)
+		return -1;
+
+	if (format == SDR_NOANALOG) {
+		s->mul[i] = NAN;
+		s->add[i] = NAN;
+	} else {
+		s->mul[i] = m * pow(10.0, rexp);
+		s->add[i] = b * pow(10.0, bexp + rexp);
+	}
+	s->wrap[i] = format == SDR_TWOS ? 256.0f
+		   : format == SDR_ONES ? 255.0f : 0.0f;
+	s->lin[i] = lin >= 1 && lin <= 11 ? lin : 0;
+	if (s->lin[i])
+		s->nlin++;
+
+	for (k = 0; k < SDR_NTHRESH; k++) {
+		if (readable & (1 << k) && format != SDR_NOANALOG)
+			s->thresh[k][i] = sdr_convert1(s, i, raw[k]);
+		else
+			s->thresh[k][i] = k < SDR_T_UNC ? -INFINITY : INFINITY;
+	}
+
+	s->n++;
+	return i;
+}
+
+/*
+ * Append sensor i of src to s. Returns its index in s, or -1.
+ */
+int sdr_soa_take(struct sdr_soa *s, const struct sdr_soa *src, size_t i)
+{
+	size_t j = s->n;
+	int k;
+
+	if (j == s->cap && grow(s, s->cap * 2) < 0)
+		return -1;
+
+	s->mul[j] = src->mul[i];
+	s->add[j] = src->add[i];
+	s->wrap[j] = src->wrap[i];
+	for (k = 0; k < SDR_NTHRESH; k++)
+		s->thresh[k][j] = src->thresh[k][i];
+	s->lin[j] = src->lin[i];
+	if (s->lin[j])
+		s->nlin++;
+
+	s->n++;
+	return j;
+}
+
+void sdr_convert_c(const struct sdr_soa *s, const uint8_t *raw,
+		   float *y, uint8_t *status, size_t from, size_t to)
+{
+	size_t i;
+
+	for (i = from; i < to; i++) {
+		y[i] = linear1(s, i, raw[i]);
+		status[i] = status1(s, i, y[i]);
+	}
+}
+
+#ifdef SDR_HAVE_X86
+
+__attribute__((target("sse2")))
+void sdr_convert_sse(const struct sdr_soa *s, const uint8_t *raw,
+		     float *y, uint8_t *status, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 half = _mm_set1_ps(127.5f);
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		int32_t b4;
+		__m128i xi;
+		__m128 x, v;
+		uint32_t st;
+
+		memcpy(&b4, raw + i, 4);
+		xi = _mm_unpacklo_epi8(_mm_cvtsi32_si128(b4), zero);
+		xi = _mm_unpacklo_epi16(xi, zero);
+		x = _mm_cvtepi32_ps(xi);
+		x = _mm_sub_ps(x, _mm_and_ps(_mm_cmpgt_ps(x, half),
+					     _mm_load_ps(s->wrap + i)));
+		v = _mm_add_ps(_mm_mul_ps(_mm_load_ps(s->mul + i), x),
+			       _mm_load_ps(s->add + i));
+		_mm_storeu_ps(y + i, v);
+
+#define LE(t)	_mm_movemask_ps(_mm_cmple_ps(v, _mm_load_ps(s->thresh[t] + i)))
+#define GE(t)	_mm_movemask_ps(_mm_cmpge_ps(v, _mm_load_ps(s->thresh[t] + i)))
+		st = spread4[LE(SDR_T_LNC)]
+		   | spread4[LE(SDR_T_LCR)] << 1
+		   | spread4[LE(SDR_T_LNR)] << 2
+		   | spread4[GE(SDR_T_UNC)] << 3
+		   | spread4[GE(SDR_T_UCR)] << 4
+		   | spread4[GE(SDR_T_UNR)] << 5
+		   | spread4[_mm_movemask_ps(_mm_cmpunord_ps(v, v))] << 7;
+#undef LE
+#undef GE
+		memcpy(status + i, &st, 4);
+	}
+	sdr_convert_c(s, raw, y, status, i, n);
+}
+
+__attribute__((target("avx2")))
+void sdr_convert_avx2(const struct sdr_soa *s, const uint8_t *raw,
+		      float *y, uint8_t *status, size_t n)
+{
+	const __m256 half = _mm256_set1_ps(127.5f);
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i b8 = _mm_loadl_epi64((const __m128i *)(raw + i));
+		__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b8));
+		__m256 v;
+		uint64_t st;
+
+		x = _mm256_sub_ps(x, _mm256_and_ps(
+			_mm256_cmp_ps(x, half, _CMP_GT_OQ),
+			_mm256_load_ps(s->wrap + i)));
+		v = _mm256_add_ps(_mm256_mul_ps(_mm256_load_ps(s->mul + i), x),
+				  _mm256_load_ps(s->add + i));
+		_mm256_storeu_ps(y + i, v);
+
+#define CMP(t, op) _mm256_movemask_ps(_mm256_cmp_ps(v,			\
+			_mm256_load_ps(s->thresh[t] + i), op))
+		st = spread8[CMP(SDR_T_LNC, _CMP_LE_OQ)]
+		   | spread8[CMP(SDR_T_LCR, _CMP_LE_OQ)] << 1
+		   | spread8[CMP(SDR_T_LNR, _CMP_LE_OQ)] << 2
+		   | spread8[CMP(SDR_T_UNC, _CMP_GE_OQ)] << 3
+		   | spread8[CMP(SDR_T_UCR, _CMP_GE_OQ)] << 4
+		   | spread8[CMP(SDR_T_UNR, _CMP_GE_OQ)] << 5
+		   | spread8[_mm256_movemask_ps(_mm256_cmp_ps(v, v,
+						_CMP_UNORD_Q))] << 7;
+#undef CMP
+		memcpy(status + i, &st, 8);
+	}
+	sdr_convert_c(s, raw, y, status, i, n);
+}
+
+const char *sdr_kernel(void)
+{
+	if (__builtin_cpu_supports("avx2"))
+		return "avx2";
+	if (__builtin_cpu_supports("sse2"))
+		return "sse2";
+	return "c";
+}
+
+#else /* !SDR_HAVE_X86 */
+
+void sdr_convert_sse(const struct sdr_soa *s, const uint8_t *raw,
+		     float *y, uint8_t *status, size_t n)
+{
+	sdr_convert_c(s, raw, y, status, 0, n);
+}
+
+void sdr_convert_avx2(const struct sdr_soa *s, const uint8_t *raw,
+		      float *y, uint8_t *status, size_t n)
+{
+	sdr_convert_c(s, raw, y, status, 0, n);
+}
+
+const char *sdr_kernel(void)
+{
+	return "c";
+}
+
+#endif /* SDR_HAVE_X86 */
+
+/*
+ * Convert raw[i] for every sensor i in s into y[i] and set status[i].
+ */
+void sdr_convert(const struct sdr_soa *s, const uint8_t *raw,
+		 float *y, uint8_t *status)
+{
+	static const char *kernel;
+	size_t i;
+
+	if (kernel == NULL)
+		kernel = sdr_kernel();
+
+	if (kernel[0] == 'a')
+		sdr_convert_avx2(s, raw, y, status, s->n);
+	else if (kernel[0] == 's')
+		sdr_convert_sse(s, raw, y, status, s->n);
+	else
+		sdr_convert_c(s, raw, y, status, 0, s->n);
+
+	for (i = 0; s->nlin && i < s->n; i++) {
+		if (s->lin[i] == 0)
+			continue;
+		y[i] = linearize(s->lin[i], y[i]);
+		status[i] = status1(s, i, y[i]);
+	}
+}
@@ -0,0 +1,88 @@
+/*
+ * sdrconv.h - bulk conversion of raw IPMI sensor readings
+ *
+ * A threshold sensor's full SDR gives the conversion
+ *
+ *	y = L[(M * x + B * 10^Bexp) * 10^Rexp]
+ *
+ * from the raw 8-bit reading x to units, where L is the linearization
+ * function, usually none. With the exponents folded in that is just
+ * y = mul * x + add, so the factors are kept as a structure of arrays,
+ * one entry per sensor, and sdr_convert does a whole array of readings
+ * at a time: sign-extend x by the sensor's analog data format, apply
+ * mul and add, and compare y with the six thresholds.
+ *
+ * sdr_convert picks AVX2, SSE2 or plain C at run time; the others
+ * are exported for the benchmark and to check one against another.
+ * Linear sensors go through the vector kernels; the few that name a
+ * linearization function are redone in C afterwards.
+ */
+
+#ifndef SDRCONV_H
+#define SDRCONV_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* analog data format, sensor units 1 bits 7:6 */
+#define SDR_UNSIGNED	0
+#define SDR_ONES	1
+#define SDR_TWOS	2
+#define SDR_NOANALOG	3
+
+/* sdr_convert status bits, set when y is past the threshold */
+#define SDR_LNC		0x01
+#define SDR_LCR		0x02
+#define SDR_LNR		0x04
+#define SDR_UNC		0x08
+#define SDR_UCR		0x10
+#define SDR_UNR		0x20
+#define SDR_INVALID	0x80	/* no analog reading */
+
+enum sdr_threshold { SDR_T_LNC, SDR_T_LCR, SDR_T_LNR,
+		     SDR_T_UNC, SDR_T_UCR, SDR_T_UNR, SDR_NTHRESH };
+
+/*
+ * Conversion factors for n sensors. Unreadable thresholds are -inf
+ * for the lower ones and +inf for the upper ones, so they never trip.
+ * The arrays are allocated a multiple of 32 long and 32-byte aligned.
+ */
+struct sdr_soa {
+	size_t		n;
+	size_t		cap;
+	float		*mul;		/* M * 10^Rexp */
+	float		*add;		/* B * 10^(Bexp + Rexp) */
+	float		*wrap;		/* subtracted from x >= 128: 0, 255, 256 */
+	float		*thresh[SDR_NTHRESH];
+	uint8_t		*lin;		/* linearization, 0 for linear */
+	size_t		nlin;		/* sensors with lin != 0 */
+};
+
+int sdr_soa_init(struct sdr_soa *s, size_t cap);
+void sdr_soa_free(struct sdr_soa *s);
+int sdr_soa_add(struct sdr_soa *s, int m, int b, int bexp, int rexp,
+		int format, int lin, const uint8_t raw[SDR_NTHRESH],
+		unsigned readable);
+int sdr_soa_take(struct sdr_soa *s, const struct sdr_soa *src, size_t i);
+
+float sdr_convert1(const struct sdr_soa *s, size_t i, uint8_t x);
+
+void sdr_convert(const struct sdr_soa *s, const uint8_t *raw,
+		 float *y, uint8_t *status);
+void sdr_convert_c(const struct sdr_soa *s, const uint8_t *raw,
+		   float *y, uint8_t *status, size_t from, size_t to);
+void sdr_convert_sse(const struct sdr_soa *s, const uint8_t *raw,
+		     float *y, uint8_t *status, size_t n);
+void sdr_convert_avx2(const struct sdr_soa *s, const uint8_t *raw,
+		      float *y, uint8_t *status, size_t n);
+const char *sdr_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDRCONV_H */
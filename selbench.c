@@ -0,0 +1,183 @@
+/*
+ * selbench - time selscan's filter and decode on a synthetic SEL dump
+ *
+ * Writes -g MiB of random but plausible SEL records (mostly system
+ * events, a year of timestamps, every sensor type) to -o, maps it,
+ * and times the C and AVX2 filters on one thread, the AVX2 filter on
+ * -j threads, and filter plus decode to /dev/null on -j threads. The
+ * match counts have to agree.
+ *
+ *	$ gcc -O2 -o selbench selbench.c seldecode.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "seldecode.h"
+
+#define T0	1700000000u		/* start of the synthetic year */
+#define YEAR	(365u * 86400)
+
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static uint64_t xorshift(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return rng;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int generate(const char *path, size_t nrecs)
+{
+	static uint8_t buf[SEL_RECSIZE * 65536];
+	size_t i, j, n;
+	FILE *fp = fopen(path, "w");
+
+	if (fp == NULL)
+		return -1;
+
+	for (i = 0; i < nrecs; i += n) {
+		n = nrecs - i < 65536 ? nrecs - i : 65536;
+		for (j = 0; j < n; j++) {
+			uint8_t *r = buf + j * SEL_RECSIZE;
+			uint64_t x = xorshift(), y = xorshift();
+			uint32_t ts = T0 + (uint32_t)((i + j) * (uint64_t)YEAR
+						      / nrecs);
+
+			r[0] = i + j;
+			r[1] = (i + j) >> 8;
+			r[2] = (x & 31) ? SEL_SYSTEM : 0xc0 + (x >> 8 & 0x3f);
+			r[3] = ts;
+			r[4] = ts >> 8;
+			r[5] = ts >> 16;
+			r[6] = ts >> 24;
+			r[7] = 0x20;
+			r[8] = 0;
+			r[9] = 0x04;
+			r[10] = (x >> 16) % 0x2d;
+			r[11] = x >> 24;
+			r[12] = ((x >> 32) & 3 ? 0x01 : 0x6f) | (x >> 34 & 0x80);
+			r[13] = (y & 0x0f) % 12;
+			r[14] = y >> 8;
+			r[15] = y >> 16;
+		}
+		if (fwrite(buf, SEL_RECSIZE, n, fp) != n) {
+			fclose(fp);
+			return -1;
+		}
+	}
+	return fclose(fp);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: selbench [-g MiB] [-o file] [-j threads] [-k]\n\n"
+		"  -g MiB      size of the synthetic dump, default 2048\n"
+		"  -o file     where to write it, default /tmp/selbench.sel\n"
+		"  -j threads  threads for the parallel runs, default one per cpu\n"
+		"  -k          keep the file\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = "/tmp/selbench.sel";
+	long mib = 2048;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int keep = 0, opt, r;
+	struct sel_filt f;
+	struct stat st;
+	uint8_t *map;
+	size_t n, first = 0;
+	FILE *null;
+	int fd;
+
+	while ((opt = getopt(argc, argv, "g:o:j:k")) != -1) {
+		switch (opt) {
+		case 'g': mib = atol(optarg); break;
+		case 'o': path = optarg; break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'k': keep = 1; break;
+		default: usage();
+		}
+	}
+	if (mib <= 0 || nthreads < 1)
+		usage();
+
+	n = (size_t)mib * 1024 * 1024 / SEL_RECSIZE;
+	printf("writing %zu records to %s\n", n, path);
+	if (generate(path, n) < 0) {
+		perror(path);
+		return 1;
+	}
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		perror(path);
+		return 1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror(path);
+		return 1;
+	}
+	null = fopen("/dev/null", "w");
+
+	// temperature and voltage threshold events in the middle half year
+	//
+	sel_filt_init(&f);
+	sel_filt_stype(&f, 0x01);
+	sel_filt_stype(&f, 0x02);
+	sel_filt_etype(&f, 0x01);
+	sel_filt_time(&f, T0 + YEAR / 4, T0 + YEAR / 4 * 3);
+
+	printf("filter kernel %s, %d threads\n\n", sel_kernel(), nthreads);
+	printf("%-22s %10s %10s %12s\n", "run", "ms", "GB/s", "matches");
+
+	// the first pass also pulls the file into the page cache
+	//
+	for (r = -1; r < 4; r++) {
+		static const char *names[] = {
+			"filter c, 1 thread", "filter avx2, 1 thread",
+			"filter avx2, N threads", "decode, N threads",
+		};
+		sel_filter_fn fn = r == 0 ? sel_filter_c : sel_filter;
+		int threads = r < 2 ? 1 : nthreads;
+		int64_t t0 = now_ns(), t;
+		size_t m;
+
+		m = sel_scan(&f, fn, map, n, threads, r == 3 ? null : NULL);
+		t = now_ns() - t0;
+		if (r < 0) {
+			first = m;
+			continue;
+		}
+		if (r == 1 && strcmp(sel_kernel(), "avx2")) {
+			printf("%-22s %10s\n", names[r], "n/a");
+			continue;
+		}
+		printf("%-22s %10.1f %10.2f %12zu%s\n", names[r], t / 1e6,
+		       (double)st.st_size / t, m, m == first ? "" : "  MISMATCH");
+	}
+
+	munmap(map, st.st_size);
+	if (!keep)
+		unlink(path);
+	return 0;
+}
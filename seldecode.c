@@ -0,0 +1,449 @@
+/*
+ * seldecode.c - filter and decode raw SEL records, see seldecode.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "seldecode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEL_HAVE_X86	1
+#endif
+
+static const char *sensortypes[] = {
+	"reserved", "temperature", "voltage", "current", "fan",
+	"physical security", "platform security", "processor",
+	"power supply", "power unit", "cooling device", "other units",
+	"memory", "drive slot", "post memory resize", "system firmware",
+	"event logging disabled", "watchdog 1", "system event",
+	"critical interrupt", "button/switch", "module/board",
+	"microcontroller", "add-in card", "chassis", "chip set",
+	"other fru", "cable/interconnect", "terminator",
+	"system boot initiated", "boot error", "os boot",
+	"os critical stop", "slot/connector", "system acpi power state",
+	"watchdog 2", "platform alert", "entity presence",
+	"monitor asic", "lan", "management subsystem health", "battery",
+	"session audit", "version change", "fru state",
+};
+
+static const char *thresholds[] = {
+	"lower non-critical going low", "lower non-critical going high",
+	"lower critical going low", "lower critical going high",
+	"lower non-recoverable going low", "lower non-recoverable going high",
+	"upper non-critical going low", "upper non-critical going high",
+	"upper critical going low", "upper critical going high",
+	"upper non-recoverable going low", "upper non-recoverable going high",
+};
+
+#define NELEM(a)	(sizeof(a) / sizeof((a)[0]))
+
+void sel_filt_init(struct sel_filt *f)
+{
+	memset(f, 0, sizeof(*f));
+	f->to = 0xffffffff;
+	f->rhi = 0xff;
+}
+
+/*
+ * Match only records with a timestamp in [from, to].
+ */
+void sel_filt_time(struct sel_filt *f, uint32_t from, uint32_t to)
+{
+	f->from = from;
+	f->to = to;
+	if (f->rhi > SEL_OEM_TS_MAX)
+		f->rhi = SEL_OEM_TS_MAX;
+}
+
+/*
+ * Add a sensor or event type to the set to match. Only system event
+ * records have them. Returns -1 if the set is full.
+ */
+int sel_filt_stype(struct sel_filt *f, int type)
+{
+	if (f->nstype == SEL_MAXSET)
+		return -1;
+	f->stype[f->nstype++] = type;
+	f->rlo = f->rhi = SEL_SYSTEM;
+	return 0;
+}
+
+int sel_filt_etype(struct sel_filt *f, int type)
+{
+	if (f->netype == SEL_MAXSET)
+		return -1;
+	f->etype[f->netype++] = type & 0x7f;
+	f->rlo = f->rhi = SEL_SYSTEM;
+	return 0;
+}
+
+static int inset(const uint8_t *set, int n, uint8_t v)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (set[i] == v)
+			return 1;
+	return 0;
+}
+
+int sel_match(const struct sel_filt *f, const uint8_t *rec)
+{
+	uint32_t ts = rec[3] | rec[4] << 8 | rec[5] << 16
+		    | (uint32_t)rec[6] << 24;
+
+	if (rec[2] < f->rlo || rec[2] > f->rhi)
+		return 0;
+	if (ts < f->from || ts > f->to)
+		return 0;
+	if (f->nstype && !inset(f->stype, f->nstype, rec[10]))
+		return 0;
+	if (f->netype && !inset(f->etype, f->netype, rec[12] & 0x7f))
+		return 0;
+	return 1;
+}
+
+/*
+ * Put the index of every record of recs[0..n) that matches f in idx.
+ * Returns how many did.
+ */
+size_t sel_filter_c(const struct sel_filt *f, const uint8_t *recs,
+		    size_t n, uint32_t *idx)
+{
+	size_t i, m = 0;
+
+	for (i = 0; i < n; i++)
+		if (sel_match(f, recs + i * SEL_RECSIZE))
+			idx[m++] = i;
+	return m;
+}
+
+#ifdef SEL_HAVE_X86
+
+/*
+ * Each 128-bit lane holds one record. The shuffle turns it into four
+ * dwords, timestamp, sensor type, event type and record type, and
+ * each dword is checked against a range and, for the two types,
+ * against the sets. A record matches when all four dwords pass.
+ */
+__attribute__((target("avx2")))
+size_t sel_filter_avx2(const struct sel_filt *f, const uint8_t *recs,
+		       size_t n, uint32_t *idx)
+{
+	const __m256i shuf = _mm256_setr_epi8(
+		3, 4, 5, 6, 10, -1, -1, -1, 12, -1, -1, -1, 2, -1, -1, -1,
+		3, 4, 5, 6, 10, -1, -1, -1, 12, -1, -1, -1, 2, -1, -1, -1);
+	const __m256i fmask = _mm256_setr_epi32(-1, -1, 0x7f, -1,
+						-1, -1, 0x7f, -1);
+	const int32_t b = INT32_MIN;
+	const __m256i bias = _mm256_set1_epi32(b);
+	__m256i lo = _mm256_setr_epi32(
+		f->from ^ b, b, b, f->rlo ^ b, f->from ^ b, b, b, f->rlo ^ b);
+	__m256i hi = _mm256_setr_epi32(
+		f->to ^ b, ~b, ~b, f->rhi ^ b, f->to ^ b, ~b, ~b, f->rhi ^ b);
+	__m256i always, sets[SEL_MAXSET];
+	int nsets = f->nstype > f->netype ? f->nstype : f->netype;
+	int sa = f->nstype ? 0 : -1, ea = f->netype ? 0 : -1;
+	size_t i, m = 0;
+	int k;
+
+	always = _mm256_setr_epi32(-1, sa, ea, -1, -1, sa, ea, -1);
+	for (k = 0; k < nsets; k++) {
+		int st = f->nstype ? f->stype[k < f->nstype ? k : f->nstype - 1] : 0;
+		int et = f->netype ? f->etype[k < f->netype ? k : f->netype - 1] : 0;
+
+		sets[k] = _mm256_setr_epi32(0, st, et, 0, 0, st, et, 0);
+	}
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m256i v = _mm256_loadu_si256(
+			(const __m256i *)(recs + i * SEL_RECSIZE));
+		__m256i x = _mm256_and_si256(_mm256_shuffle_epi8(v, shuf), fmask);
+		__m256i xb = _mm256_xor_si256(x, bias);
+		__m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(lo, xb),
+					      _mm256_cmpgt_epi32(xb, hi));
+		__m256i ok = always;
+		int mm;
+
+		for (k = 0; k < nsets; k++)
+			ok = _mm256_or_si256(ok, _mm256_cmpeq_epi32(x, sets[k]));
+		ok = _mm256_andnot_si256(bad, ok);
+
+		mm = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+		if ((mm & 0x0f) == 0x0f)
+			idx[m++] = i;
+		if ((mm & 0xf0) == 0xf0)
+			idx[m++] = i + 1;
+	}
+	if (i < n && sel_match(f, recs + i * SEL_RECSIZE))
+		idx[m++] = i;
+	return m;
+}
+
+const char *sel_kernel(void)
+{
+	return __builtin_cpu_supports("avx2") ? "avx2" : "c";
+}
+
+#else /* !SEL_HAVE_X86 */
+
+size_t sel_filter_avx2(const struct sel_filt *f, const uint8_t *recs,
+		       size_t n, uint32_t *idx)
+{
+	return sel_filter_c(f, recs, n, idx);
+}
+
+const char *sel_kernel(void)
+{
+	return "c";
+}
+
+#endif /* SEL_HAVE_X86 */
+
+size_t sel_filter(const struct sel_filt *f, const uint8_t *recs,
+		  size_t n, uint32_t *idx)
+{
+	static const char *kernel;
+
+	if (kernel == NULL)
+		kernel = sel_kernel();
+	if (kernel[0] == 'a')
+		return sel_filter_avx2(f, recs, n, idx);
+	return sel_filter_c(f, recs, n, idx);
+}
+
+static int fmt_time(uint32_t ts, char *buf, size_t len)
+{
+	struct tm tm;
+	time_t t = ts;
+
+	if (ts < 0x20000000)
+		return snprintf(buf, len, "+%us", ts);
+	gmtime_r(&t, &tm);
+	return strftime(buf, len, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+/*
+ * Decode one record into buf as a line of comma separated fields:
+ * record id, time, generator, sensor type, sensor number, direction,
+ * event, and the three event data bytes.
+ *
+ * Returns the length of the line, as snprintf does.
+ */
+int sel_decode(const uint8_t *rec, char *buf, size_t len)
+{
+	uint32_t ts = rec[3] | rec[4] << 8 | rec[5] << 16
+		    | (uint32_t)rec[6] << 24;
+	unsigned id = rec[0] | rec[1] << 8;
+	uint8_t type = rec[2];
+	uint8_t st = rec[10];
+	uint8_t et = rec[12] & 0x7f;
+	uint8_t off = rec[13] & 0x0f;
+	char when[32], stbuf[16], evbuf[32];
+	const char *stname, *event;
+
+	if (type > SEL_OEM_TS_MAX)
+		return snprintf(buf, len,
+				"%u,,,oem 0x%02x,,,,"
+				"%02x %02x %02x %02x %02x %02x %02x %02x "
+				"%02x %02x %02x %02x %02x\n", id, type,
+				rec[3], rec[4], rec[5], rec[6], rec[7], rec[8],
+				rec[9], rec[10], rec[11], rec[12], rec[13],
+				rec[14], rec[15]);
+
+	fmt_time(ts, when, sizeof(when));
+
+	if (type != SEL_SYSTEM)
+		return snprintf(buf, len,
+				"%u,%s,,oem 0x%02x,,,,"
+				"%02x %02x %02x %02x %02x %02x %02x %02x %02x\n",
+				id, when, type, rec[7], rec[8], rec[9], rec[10],
+				rec[11], rec[12], rec[13], rec[14], rec[15]);
+
+	if (st < NELEM(sensortypes)) {
+		stname = sensortypes[st];
+	} else {
+		snprintf(stbuf, sizeof(stbuf), "oem 0x%02x", st);
+		stname = stbuf;
+	}
+
+	if (et == 0x01 && off < NELEM(thresholds)) {
+		event = thresholds[off];
+	} else {
+		snprintf(evbuf, sizeof(evbuf), "%s 0x%02x offset %u",
+			 et == 0x6f ? "specific" : "generic", et, off);
+		event = evbuf;
+	}
+
+	return snprintf(buf, len, "%u,%s,0x%04x,%s,%u,%s,%s,%02x %02x %02x\n",
+			id, when, rec[7] | rec[8] << 8, stname, rec[11],
+			rec[12] & 0x80 ? "deassert" : "assert", event,
+			rec[13], rec[14], rec[15]);
+}
+
+#define SCAN_CHUNK	(1 << 20)	/* records per chunk */
+#define SCAN_AHEAD	4		/* chunks in hand per thread */
+
+struct scanchunk {
+	const uint8_t	*recs;
+	size_t		n;
+	size_t		matches;
+	char		*out;
+	size_t		outlen;
+	int		done;
+};
+
+struct scan {
+	const struct sel_filt *f;
+	sel_filter_fn	fn;
+	struct scanchunk *chunks;
+	size_t		nchunks;
+	size_t		next;		/* next chunk to take */
+	size_t		written;	/* chunks written out */
+	size_t		ahead;
+	int		decode;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+};
+
+static void scan_chunk(struct scan *sc, struct scanchunk *c, uint32_t *idx)
+{
+	size_t cap = 0, i;
+
+	c->matches = sc->fn(sc->f, c->recs, c->n, idx);
+	c->out = NULL;
+	c->outlen = 0;
+	if (!sc->decode || c->matches == 0)
+		return;
+
+	for (i = 0; i < c->matches; i++) {
+		int len;
+
+		if (cap - c->outlen < 256) {
+			char *p = realloc(c->out, cap ? cap * 2 : 64 * 1024);
+
+			if (p == NULL)
+				break;
+			c->out = p;
+			cap = cap ? cap * 2 : 64 * 1024;
+		}
+		len = sel_decode(c->recs + (size_t)idx[i] * SEL_RECSIZE,
+				 c->out + c->outlen, cap - c->outlen);
+		c->outlen += len;
+	}
+}
+
+struct scanworker {
+	struct scan	*sc;
+	uint32_t	*idx;		/* SCAN_CHUNK matches */
+	pthread_t	tid;
+};
+
+static void *scan_worker(void *arg)
+{
+	struct scanworker *w = arg;
+	struct scan *sc = w->sc;
+	size_t i;
+
+	for (;;) {
+		pthread_mutex_lock(&sc->lock);
+		while (sc->next < sc->nchunks
+		       && sc->next >= sc->written + sc->ahead)
+			pthread_cond_wait(&sc->cond, &sc->lock);
+		i = sc->next < sc->nchunks ? sc->next++ : sc->nchunks;
+		pthread_mutex_unlock(&sc->lock);
+		if (i == sc->nchunks)
+			break;
+
+		scan_chunk(sc, &sc->chunks[i], w->idx);
+
+		pthread_mutex_lock(&sc->lock);
+		sc->chunks[i].done = 1;
+		pthread_cond_broadcast(&sc->cond);
+		pthread_mutex_unlock(&sc->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Filter recs[0..n) with fn and, if out isn't NULL, decode the matches
+ * to it in order, on nthreads threads. Returns the number of matches.
+ */
+size_t sel_scan(const struct sel_filt *f, sel_filter_fn fn,
+		const uint8_t *recs, size_t n, int nthreads, FILE *out)
+{
+	struct scan sc;
+	struct scanworker *w;
+	size_t i, matches = 0;
+	int t;
+
+	if (nthreads < 1)
+		nthreads = 1;
+	memset(&sc, 0, sizeof(sc));
+	sc.f = f;
+	sc.fn = fn;
+	sc.decode = out != NULL;
+	sc.ahead = (size_t)nthreads * SCAN_AHEAD;
+	sc.nchunks = (n + SCAN_CHUNK - 1) / SCAN_CHUNK;
+	sc.chunks = calloc(sc.nchunks + 1, sizeof(*sc.chunks));
+	w = calloc(nthreads, sizeof(*w));
+	for (t = 0; w && t < nthreads; t++) {
+		w[t].sc = &sc;
+		w[t].idx = malloc(SCAN_CHUNK * sizeof(uint32_t));
+		if (w[t].idx == NULL)
+			break;
+	}
+	if (sc.chunks == NULL || w == NULL || t < nthreads) {
+		for (t = 0; w && t < nthreads; t++)
+			free(w[t].idx);
+		free(sc.chunks);
+		free(w);
+		return 0;
+	}
+	for (i = 0; i < sc.nchunks; i++) {
+		sc.chunks[i].recs = recs + i * SCAN_CHUNK * SEL_RECSIZE;
+		sc.chunks[i].n = i + 1 < sc.nchunks ? SCAN_CHUNK
+			       : n - i * SCAN_CHUNK;
+	}
+	pthread_mutex_init(&sc.lock, NULL);
+	pthread_cond_init(&sc.cond, NULL);
+
+	for (t = 0; t < nthreads; t++)
+		pthread_create(&w[t].tid, NULL, scan_worker, &w[t]);
+
+	// write the chunks out in order as they finish
+	//
+	for (i = 0; i < sc.nchunks; i++) {
+		struct scanchunk *c = &sc.chunks[i];
+
+		pthread_mutex_lock(&sc.lock);
+		while (!c->done)
+			pthread_cond_wait(&sc.cond, &sc.lock);
+		pthread_mutex_unlock(&sc.lock);
+
+		if (out && c->outlen)
+			fwrite(c->out, 1, c->outlen, out);
+		free(c->out);
+		matches += c->matches;
+
+		pthread_mutex_lock(&sc.lock);
+		sc.written = i + 1;
+		pthread_cond_broadcast(&sc.cond);
+		pthread_mutex_unlock(&sc.lock);
+	}
+
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(w[t].tid, NULL);
+		free(w[t].idx);
+	}
+	pthread_mutex_destroy(&sc.lock);
+	pthread_cond_destroy(&sc.cond);
+	free(sc.chunks);
+	free(w);
+	return matches;
+}
@@ -0,0 +1,72 @@
+/*
+ * seldecode.h - filter and decode raw SEL records
+ *
+ * A SEL dump is a run of 16-byte records as returned by Get SEL Entry:
+ *
+ *	0-1	record id
+ *	2	record type: 0x02 system event, 0xc0-0xdf OEM with a
+ *		timestamp, 0xe0-0xff OEM without
+ *	3-6	timestamp, seconds since 1970 or since init if < 0x20000000
+ *	7-8	generator id
+ *	9	event message format revision
+ *	10	sensor type
+ *	11	sensor number
+ *	12	event direction (bit 7) and event/reading type code
+ *	13-15	event data 1-3
+ *
+ * sel_filter picks out the records that match a sel_filt: a timestamp
+ * range, and a set of sensor types and a set of event types. Every
+ * condition is a compare on a fixed byte offset, so the AVX2 kernel
+ * shuffles the fields of two records into place and compares them in
+ * one register; the C kernel does one record at a time.
+ *
+ * sel_scan splits a run of records into chunks for a pool of threads
+ * that filter and decode them, and writes the chunks out in order.
+ */
+
+#ifndef SELDECODE_H
+#define SELDECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define SEL_RECSIZE	16
+#define SEL_MAXSET	16	/* sensor or event types in one filter */
+#define SEL_SYSTEM	0x02
+#define SEL_OEM_TS_MAX	0xdf	/* last record type with a timestamp */
+
+struct sel_filt {
+	uint32_t	from;		/* timestamps, inclusive */
+	uint32_t	to;
+	uint8_t		rlo;		/* record types, inclusive */
+	uint8_t		rhi;
+	int		nstype;		/* 0 for any sensor type */
+	int		netype;		/* 0 for any event type */
+	uint8_t		stype[SEL_MAXSET];
+	uint8_t		etype[SEL_MAXSET];
+};
+
+void sel_filt_init(struct sel_filt *f);
+void sel_filt_time(struct sel_filt *f, uint32_t from, uint32_t to);
+int sel_filt_stype(struct sel_filt *f, int type);
+int sel_filt_etype(struct sel_filt *f, int type);
+
+int sel_match(const struct sel_filt *f, const uint8_t *rec);
+size_t sel_filter_c(const struct sel_filt *f, const uint8_t *recs,
+		    size_t n, uint32_t *idx);
+size_t sel_filter_avx2(const struct sel_filt *f, const uint8_t *recs,
+		       size_t n, uint32_t *idx);
+size_t sel_filter(const struct sel_filt *f, const uint8_t *recs,
+		  size_t n, uint32_t *idx);
+const char *sel_kernel(void);
+
+int sel_decode(const uint8_t *rec, char *buf, size_t len);
+
+typedef size_t (*sel_filter_fn)(const struct sel_filt *f,
+				const uint8_t *recs, size_t n, uint32_t *idx);
+
+size_t sel_scan(const struct sel_filt *f, sel_filter_fn fn,
+		const uint8_t *recs, size_t n, int nthreads, FILE *out);
+
+#endif /* SELDECODE_H */
@@ -0,0 +1,116 @@
+/*
+ * selscan - filter and decode raw SEL dumps
+ *
+ * Memory-maps each dump file, a run of 16-byte SEL records, picks out
+ * the records that match the -s, -e, -f and -t filters and decodes them
+ * as comma separated lines, on -j threads. See seldecode.h for the
+ * record layout and the output fields.
+ *
+ * -s and -e may be given up to 16 times each, and match any of their
+ * values. Times are seconds since the epoch.
+ *
+ *	$ gcc -O2 -o selscan selscan.c seldecode.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "seldecode.h"
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: selscan [-s type]... [-e type]... [-f from] [-t to]"
+		" [-j threads] [-c] [-C] file...\n\n"
+		"  -s type     sensor type to match, e.g. 0x01 for temperature\n"
+		"  -e type     event/reading type to match, e.g. 0x01 for"
+		" threshold\n"
+		"  -f from     first timestamp to match\n"
+		"  -t to       last timestamp to match\n"
+		"  -j threads  decode on this many threads, default one per cpu\n"
+		"  -c          print only the number of matches\n"
+		"  -C          use the C filter, not the vector one\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sel_filt f;
+	sel_filter_fn fn = sel_filter;
+	uint32_t from = 0, to = 0xffffffff;
+	int timed = 0, count = 0;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t total = 0, matches = 0;
+	int opt, rc = 0;
+
+	sel_filt_init(&f);
+
+	while ((opt = getopt(argc, argv, "s:e:f:t:j:cC")) != -1) {
+		switch (opt) {
+		case 's':
+			if (sel_filt_stype(&f, strtol(optarg, NULL, 0)) < 0)
+				usage();
+			break;
+		case 'e':
+			if (sel_filt_etype(&f, strtol(optarg, NULL, 0)) < 0)
+				usage();
+			break;
+		case 'f': from = strtoul(optarg, NULL, 0); timed = 1; break;
+		case 't': to = strtoul(optarg, NULL, 0); timed = 1; break;
+		case 'j': nthreads = atoi(optarg); break;
+		case 'c': count = 1; break;
+		case 'C': fn = sel_filter_c; break;
+		default: usage();
+		}
+	}
+	if (optind == argc || nthreads < 1)
+		usage();
+	if (timed)
+		sel_filt_time(&f, from, to);
+
+	for (; optind < argc; optind++) {
+		const char *path = argv[optind];
+		struct stat st;
+		uint8_t *map;
+		size_t n;
+		int fd;
+
+		if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+			perror(path);
+			rc = 1;
+			continue;
+		}
+		if (st.st_size % SEL_RECSIZE)
+			fprintf(stderr, "%s: ignoring %d bytes past the last"
+				" whole record\n", path,
+				(int)(st.st_size % SEL_RECSIZE));
+		n = st.st_size / SEL_RECSIZE;
+		if (n == 0) {
+			close(fd);
+			continue;
+		}
+
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			perror(path);
+			rc = 1;
+			continue;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+		matches += sel_scan(&f, fn, map, n, nthreads,
+				    count ? NULL : stdout);
+		total += n;
+		munmap(map, st.st_size);
+	}
+
+	if (count)
+		printf("%zu of %zu records\n", matches, total);
+	return rc;
+}
@@ -0,0 +1,367 @@
+/*
+ * sensched.c - poll sensors at their own intervals within a BMC budget,
+ *		see sensched.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipmicmd.h"
+#include "sensched.h"
+
+#define SS_BITS		6	/* log2 SS_SLOTS */
+#define SS_MASK		(SS_SLOTS - 1)
+#define SS_SPAN		((uint64_t)1 << (SS_BITS * SS_LEVELS))
+#define SS_TIMEOUT_MS	6000	/* the driver answers every request by then */
+
+static int64_t mono_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * File sensor i by its due tick: in the bottom level if it is due
+ * within SS_SLOTS ticks, else in the level whose slots span its
+ * distance, to be cascaded down as the wheel turns.
+ */
+static void wheel_add(struct sensched *ss, int i)
+{
+	struct ss_sensor *s = &ss->s[i];
+	uint64_t delta;
+	int level, slot;
+
+	if (s->due < ss->tick)
+		s->due = ss->tick;
+	delta = s->due - ss->tick;
+	if (delta >= SS_SPAN)
+		s->due = ss->tick + SS_SPAN - 1;
+
+	for (level = 0; level < SS_LEVELS - 1; level++)
+		if (delta < (uint64_t)1 << (SS_BITS * (level + 1)))
+			break;
+	slot = (s->due >> (SS_BITS * level)) & SS_MASK;
+	s->next = ss->wheel[level][slot];
+	ss->wheel[level][slot] = i;
+}
+
+static void cascade(struct sensched *ss, int level, int slot)
+{
+	int i = ss->wheel[level][slot], next;
+
+	ss->wheel[level][slot] = SS_NONE;
+	for (; i != SS_NONE; i = next) {
+		next = ss->s[i].next;
+		wheel_add(ss, i);
+	}
+}
+
+static void rq_push(struct sensched *ss, int i)
+{
+	ss->s[i].next = SS_NONE;
+	if (ss->rq_tail == SS_NONE)
+		ss->rq_head = i;
+	else
+		ss->s[ss->rq_tail].next = i;
+	ss->rq_tail = i;
+	if (++ss->rq_len > ss->rq_max)
+		ss->rq_max = ss->rq_len;
+}
+
+static int rq_pop(struct sensched *ss)
+{
+	int i = ss->rq_head;
+
+	if (i != SS_NONE) {
+		ss->rq_head = ss->s[i].next;
+		if (ss->rq_head == SS_NONE)
+			ss->rq_tail = SS_NONE;
+		ss->rq_len--;
+	}
+	return i;
+}
+
+/*
+ * Turn the wheel through tick now, moving every sensor that comes due
+ * onto the ready queue.
+ */
+static void advance(struct sensched *ss, uint64_t now)
+{
+	int level, i, next;
+
+	for (; ss->tick <= now; ss->tick++) {
+		uint64_t t = ss->tick;
+
+		for (level = SS_LEVELS - 1; level > 0; level--)
+			if (t && (t & (((uint64_t)1 << (SS_BITS * level)) - 1)) == 0)
+				cascade(ss, level,
+					(t >> (SS_BITS * level)) & SS_MASK);
+
+		i = ss->wheel[0][t & SS_MASK];
+		ss->wheel[0][t & SS_MASK] = SS_NONE;
+		for (; i != SS_NONE; i = next) {
+			next = ss->s[i].next;
+			rq_push(ss, i);
+		}
+	}
+}
+
+/*
+ * Sensor i's answer is in or given up on: due again one interval after
+ * it was last due, skipping any due times already past.
+ */
+static void reschedule(struct sensched *ss, int i)
+{
+	struct ss_sensor *s = &ss->s[i];
+	uint64_t ival = (s->interval_ms + SS_TICK_MS - 1) / SS_TICK_MS;
+	uint64_t k;
+
+	if (ival == 0)
+		ival = 1;
+	s->due += ival;
+	if (s->due < ss->tick) {
+		k = (ss->tick - s->due + ival - 1) / ival;
+		s->missed += k;
+		s->due += k * ival;
+	}
+	wheel_add(ss, i);
+}
+
+int ss_init(struct sensched *ss, const struct sdr_repo *r,
+	    const uint32_t *interval_ms, const struct ss_budget *b)
+{
+	int i, l, k;
+
+	memset(ss, 0, sizeof(*ss));
+	ss->repo = r;
+	ss->n = r->n;
+	ss->budget = *b;
+	if (ss->budget.inflight < 1)
+		ss->budget.inflight = 1;
+	if (ss->budget.burst < 1)
+		ss->budget.burst = 1;
+	ss->tokens = ss->budget.burst;
+
+	ss->s = calloc(r->n ? r->n : 1, sizeof(*ss->s));
+	ss->fl = calloc(ss->budget.inflight, sizeof(*ss->fl));
+	if (ss->s == NULL || ss->fl == NULL) {
+		ss_free(ss);
+		return -1;
+	}
+	for (k = 0; k < ss->budget.inflight; k++)
+		ss->fl[k].sensor = SS_NONE;
+	for (l = 0; l < SS_LEVELS; l++)
+		for (k = 0; k < SS_SLOTS; k++)
+			ss->wheel[l][k] = SS_NONE;
+	ss->rq_head = ss->rq_tail = SS_NONE;
+
+	// everything is due at once to begin with
+	for (i = 0; i < ss->n; i++) {
+		ss->s[i].flags = SDR_NOT_READ;
+		if (r->sensors[i].owner != IPMI_BMC_SLAVE_ADDR)
+			continue;
+		ss->s[i].interval_ms = interval_ms[i];
+		if (interval_ms[i])
+			wheel_add(ss, i);
+	}
+	return 0;
+}
+
+void ss_free(struct sensched *ss)
+{
+	free(ss->s);
+	free(ss->fl);
+	ss->s = NULL;
+	ss->fl = NULL;
+}
+
+static void answer(struct sensched *ss, struct ss_inflight *f,
+		   const uchar *rsp, int rlen, int64_t now,
+		   void (*reading)(struct sensched *, int, void *), void *arg)
+{
+	struct ss_sensor *s = &ss->s[f->sensor];
+	int i = f->sensor;
+
+	f->sensor = SS_NONE;
+	ss->nfl--;
+
+	s->late_sum_ms += now - (ss->t0_ms + (int64_t)s->due * SS_TICK_MS);
+	if (rsp == NULL || rlen < 3 || rsp[0] != 0) {
+		s->flags = SDR_NOT_READ;
+		s->fails++;
+	} else if ((rsp[2] & 0x20) || !(rsp[2] & 0x40)) {
+		s->flags = SDR_UNAVAILABLE;
+		s->fails++;
+	} else {
+		s->raw = rsp[1];
+		s->flags = 0;
+		if (s->last_ok_ms) {
+			int64_t age = now - s->last_ok_ms;
+
+			s->age_sum_ms += age;
+			if (age > s->age_max_ms)
+				s->age_max_ms = age;
+		}
+		s->last_ok_ms = now;
+		s->reads++;
+	}
+	if (reading)
+		reading(ss, i, arg);
+	reschedule(ss, i);
+}
+
+/*
+ * Poll for run_ms milliseconds, or until *stop if run_ms is 0, calling
+ * reading after every answer. Returns 0, or -1 if the driver failed;
+ * either way run_ms is set for ss_report.
+ */
+int ss_run(struct sensched *ss, int fd, int64_t run_ms,
+	   void (*reading)(struct sensched *ss, int i, void *arg), void *arg,
+	   volatile sig_atomic_t *stop)
+{
+	uchar req[1], rsp[8];
+	int64_t now, start, wait;
+	long rspid;
+	int i, k, rc, rlen;
+
+	start = ss->t0_ms = ss->tokens_ms = mono_ms();
+
+	for (now = start; !*stop && (!run_ms || now - start < run_ms);
+	     now = mono_ms()) {
+		advance(ss, (now - ss->t0_ms) / SS_TICK_MS);
+
+		// refill the bucket
+		if (ss->budget.rate > 0) {
+			ss->tokens += (now - ss->tokens_ms) * ss->budget.rate
+				      / 1000;
+			if (ss->tokens > ss->budget.burst)
+				ss->tokens = ss->budget.burst;
+		}
+		ss->tokens_ms = now;
+
+		// send what is ready, as far as the budget goes
+		while (ss->rq_len) {
+			if (ss->nfl == ss->budget.inflight) {
+				ss->held_inflight++;
+				break;
+			}
+			if (ss->budget.rate > 0 && ss->tokens < 1) {
+				ss->held_rate++;
+				break;
+			}
+			i = rq_pop(ss);
+			for (k = 0; ss->fl[k].sensor != SS_NONE; k++)
+				;
+
+			req[0] = ss->repo->sensors[i].number;
+			ss->fl[k].msgid = ipmicmd_send(fd,
+				IPMI_SYSTEM_INTERFACE_ADDR_TYPE,
+				IPMI_GET_SENSOR_READING, IPMI_NETFN_SENSOR,
+				ss->repo->sensors[i].lun, req, 1);
+			ss->fl[k].sensor = i;
+			ss->fl[k].sent_ms = now;
+			ss->nfl++;
+			if (ss->fl[k].msgid < 0) {
+				answer(ss, &ss->fl[k], NULL, 0, now, reading,
+				       arg);
+				continue;
+			}
+			ss->tokens -= 1;
+			ss->sent++;
+		}
+
+		// wait for an answer, the next tick or the next token
+		wait = ss->t0_ms + (int64_t)ss->tick * SS_TICK_MS - now;
+		if (ss->rq_len && ss->nfl < ss->budget.inflight
+		    && ss->budget.rate > 0) {
+			int64_t t = (int64_t)((1 - ss->tokens) * 1000
+					      / ss->budget.rate) + 1;
+
+			if (t < wait)
+				wait = t;
+		}
+		if (wait < 0)
+			wait = 0;
+		if (run_ms && start + run_ms - now < wait)
+			wait = start + run_ms - now;
+
+		if (ss->nfl == 0) {
+			struct timespec ts = { wait / 1000,
+					       wait % 1000 * 1000000 };
+
+			nanosleep(&ts, NULL);
+			continue;
+		}
+
+		rc = ipmicmd_recv(fd, rsp, sizeof(rsp), &rlen, &rspid, wait);
+		if (rc < 0) {
+			ss->run_ms = mono_ms() - start;
+			return -1;
+		}
+		now = mono_ms();
+		for (k = 0; k < ss->budget.inflight; k++) {
+			struct ss_inflight *f = &ss->fl[k];
+
+			if (f->sensor == SS_NONE)
+				continue;
+			if (rc == 0 && f->msgid == rspid)
+				answer(ss, f, rsp, rlen, now, reading, arg);
+			else if (now - f->sent_ms > SS_TIMEOUT_MS)
+				answer(ss, f, NULL, 0, now, reading, arg);
+		}
+	}
+	ss->run_ms = mono_ms() - start;
+	return 0;
+}
+
+void ss_report(const struct sensched *ss, FILE *fp)
+{
+	int64_t end = ss->t0_ms + ss->run_ms;
+	int i, polled = 0, fresh = 0;
+
+	fprintf(fp, "%3s  %-16s %8s %7s %6s %6s %9s %9s %8s\n", "num", "id",
+		"target", "reads", "fails", "missed", "mean age", "max age",
+		"late");
+	for (i = 0; i < ss->n; i++) {
+		const struct ss_sensor *s = &ss->s[i];
+		int64_t worst = s->age_max_ms;
+		uint64_t n = s->reads + s->fails;
+
+		if (s->interval_ms == 0)
+			continue;
+		polled++;
+		// a sensor that has gone quiet is as stale as it is now
+		if (s->last_ok_ms == 0)
+			worst = ss->run_ms;
+		else if (end - s->last_ok_ms > worst)
+			worst = end - s->last_ok_ms;
+		if (worst <= s->interval_ms * 3 / 2)
+			fresh++;
+
+		fprintf(fp, "%3d  %-16s %6.1f s %7llu %6llu %6llu %7.2f s "
+			"%7.2f s %6.0f ms\n", ss->repo->sensors[i].number,
+			ss->repo->sensors[i].id, s->interval_ms / 1e3,
+			(unsigned long long)s->reads,
+			(unsigned long long)s->fails,
+			(unsigned long long)s->missed,
+			s->reads > 1 ? s->age_sum_ms / 1e3 / (s->reads - 1) : 0,
+			worst / 1e3, n ? (double)s->late_sum_ms / n : 0);
+	}
+
+	fprintf(fp, "\n%llu requests in %.1f s, %.1f/s; budget %d in flight",
+		(unsigned long long)ss->sent, ss->run_ms / 1e3,
+		ss->run_ms ? ss->sent * 1e3 / ss->run_ms : 0,
+		ss->budget.inflight);
+	if (ss->budget.rate > 0)
+		fprintf(fp, ", %.1f/s", ss->budget.rate);
+	fprintf(fp, "\nheld back by in-flight cap %llu, by rate cap %llu; "
+		"longest ready queue %d\n",
+		(unsigned long long)ss->held_inflight,
+		(unsigned long long)ss->held_rate, ss->rq_max);
+	fprintf(fp, "%d of %d sensors never older than 1.5 times their "
+		"interval\n", fresh, polled);
+}
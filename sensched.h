@@ -0,0 +1,102 @@
+/*
+ * sensched.h - poll sensors at their own intervals within a BMC budget
+ *
+ * Each sensor of an sdr_repo gets its own poll interval. The due times
+ * are kept in a hierarchical timer wheel of SS_LEVELS levels of
+ * SS_SLOTS slots, SS_TICK_MS a tick at the bottom, so adding, expiring
+ * and rescheduling a sensor costs the same however many there are and
+ * however long their intervals. Every sensor due in a tick joins the
+ * ready queue together, and the queue is sent as a pipeline of Get
+ * Sensor Reading requests on one driver session, matched back by
+ * msgid, within the budget: at most inflight requests outstanding and
+ * rate requests a second on average, in bursts of up to burst.
+ *
+ * A sensor is rescheduled when its answer comes, at its previous due
+ * time plus its interval, so intervals don't drift; if the BMC fell
+ * so far behind that the next due time has passed too, the missed
+ * polls are counted and skipped rather than sent in a burst.
+ *
+ * Freshness is the age of a sensor's last good reading. ss_report
+ * prints, per sensor and overall, the target interval against the
+ * achieved mean and worst age, and how often the budget held reads
+ * back.
+ */
+
+#ifndef SENSCHED_H
+#define SENSCHED_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <signal.h>
+
+#include "ipmisdr.h"
+
+#define SS_TICK_MS	50
+#define SS_SLOTS	64
+#define SS_LEVELS	3	/* 64^3 ticks of 50 ms, about 3.6 hours */
+#define SS_NONE		(-1)
+
+struct ss_budget {
+	int		inflight;	/* requests outstanding at once */
+	double		rate;		/* requests a second, 0 for no limit */
+	double		burst;		/* token bucket depth */
+};
+
+struct ss_sensor {
+	uint32_t	interval_ms;	/* 0: not polled */
+	uint64_t	due;		/* tick */
+	int		next;		/* wheel slot or ready queue link */
+
+	uint64_t	reads;		/* good readings */
+	uint64_t	fails;
+	uint64_t	missed;		/* due times skipped, behind */
+	int64_t		last_ok_ms;	/* 0 before the first good reading */
+	int64_t		age_sum_ms;	/* over good readings after the first */
+	int64_t		age_max_ms;
+	int64_t		late_sum_ms;	/* answer time less due time */
+
+	uint8_t		raw;		/* last good reading */
+	uint8_t		flags;		/* SDR_UNAVAILABLE, SDR_NOT_READ */
+};
+
+struct ss_inflight {
+	long		msgid;
+	int		sensor;		/* SS_NONE if the slot is free */
+	int64_t		sent_ms;
+};
+
+struct sensched {
+	const struct sdr_repo *repo;
+	struct ss_sensor *s;
+	int		n;
+
+	int		wheel[SS_LEVELS][SS_SLOTS];	/* list heads */
+	uint64_t	tick;		/* next tick to expire */
+	int64_t		t0_ms;		/* CLOCK_MONOTONIC of tick 0 */
+
+	int		rq_head, rq_tail;	/* ready queue, linked by next */
+	int		rq_len;
+
+	struct ss_budget budget;
+	double		tokens;
+	int64_t		tokens_ms;
+	struct ss_inflight *fl;
+	int		nfl;
+
+	/* totals */
+	uint64_t	sent;
+	uint64_t	held_inflight;	/* times the in-flight cap held reads */
+	uint64_t	held_rate;	/* times the rate cap held reads */
+	int		rq_max;
+	int64_t		run_ms;
+};
+
+int ss_init(struct sensched *ss, const struct sdr_repo *r,
+	    const uint32_t *interval_ms, const struct ss_budget *b);
+void ss_free(struct sensched *ss);
+int ss_run(struct sensched *ss, int fd, int64_t run_ms,
+	   void (*reading)(struct sensched *ss, int i, void *arg), void *arg,
+	   volatile sig_atomic_t *stop);
+void ss_report(const struct sensched *ss, FILE *fp);
+
+#endif /* SENSCHED_H */
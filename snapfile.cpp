@@ -0,0 +1,274 @@
+/******************************************************************************
+**
+**  snapfile.cpp - compact binary snapshot of the ipmi kmod parameters
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+**  A snapshot is a few hundred bytes, written once to a temporary file
+**  and renamed into place, so a collector copying snapshots off a fleet
+**  never picks up a partly written one.
+**
+******************************************************************************/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include "snapfile.h"
+
+using namespace std;
+
+#define VARINT_MAX      10      // bytes in the longest 64-bit varint
+
+static int putvarint(uint8_t *p, uint64_t v)
+{
+    int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int getvarint(const uint8_t *p, const uint8_t *end, uint64_t& v)
+{
+    int n = 0;
+    int shift = 0;
+
+    v = 0;
+    while (p + n < end && shift < 64) {
+        uint8_t b = p[n++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return n;
+        shift += 7;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * snapparm::valstr - the value as text, for reports
+ *
+ */
+string snapparm::valstr() const
+{
+    if (isstring)
+        return strval;
+
+    stringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+/**************************************************************
+ * snapfile::fnv1a - 64-bit FNV-1a hash
+ *
+ */
+uint64_t snapfile::fnv1a(const uint8_t *p, size_t len, uint64_t h)
+{
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**************************************************************
+ * snapfile::create - write a snapshot of parms with this host's
+ *                    identity
+ *
+ * Returns 0 on success, else -1.
+ */
+int snapfile::create(string path, vector<snapparm> parms)
+{
+    string ident;
+    string body;
+    char buf[256];
+    struct utsname un;
+    struct timespec now;
+    uint8_t vb[VARINT_MAX];
+
+    if (gethostname(buf, sizeof(buf)) < 0)
+        buf[0] = '\0';
+    buf[sizeof(buf) - 1] = '\0';
+    ident.append(buf, strlen(buf) + 1);
+
+    string mid;
+    ifstream fin("/etc/machine-id");
+    getline(fin, mid);
+    ident.append(mid.c_str(), mid.size() + 1);
+
+    if (uname(&un) < 0)
+        un.release[0] = '\0';
+    ident.append(un.release, strlen(un.release) + 1);
+
+    sort(parms.begin(), parms.end());
+    for (uint i = 0; i < parms.size(); ++i) {
+        body.append(parms[i].name.c_str(), parms[i].name.size() + 1);
+        if (parms[i].isstring) {
+            body += 's';
+            body.append(parms[i].strval.c_str(), parms[i].strval.size() + 1);
+        } else {
+            int64_t v = parms[i].value;
+            body += 'i';
+            body.append((char *)vb, putvarint(vb,
+                        ((uint64_t)v << 1) ^ (uint64_t)(v >> 63)));
+        }
+    }
+
+    snaphdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+    h.version = SNAP_VERSION;
+    h.nparms = parms.size();
+    h.identlen = ident.size();
+    h.parmslen = body.size();
+    clock_gettime(CLOCK_REALTIME, &now);
+    h.time_ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    h.hash = fnv1a((const uint8_t *)body.data(), body.size());
+
+    string tmp = path + ".tmp";
+    ofstream fout(tmp.c_str(), ios::binary | ios::trunc);
+    fout.write((const char *)&h, sizeof(h));
+    fout.write(ident.data(), ident.size());
+    fout.write(body.data(), body.size());
+    fout.close();
+
+    if (fout.fail() || rename(tmp.c_str(), path.c_str()) < 0) {
+        int err = errno;
+        unlink(tmp.c_str());
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/**************************************************************
+ * snapfile::open - map a snapshot and check it
+ *
+ * Returns 0 on success, else -1 with errno EINVAL if the file is
+ * not a snapshot of this version, is truncated or fails its hash.
+ */
+int snapfile::open(string path)
+{
+    struct stat st;
+    int fd;
+
+    close();
+    if ((fd = ::open(path.c_str(), O_RDONLY)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snaphdr)) {
+        ::close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    maplen = st.st_size;
+    map = (uint8_t *)mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        return -1;
+    }
+
+    const snaphdr *h = (const snaphdr *)map;
+    const char *id = (const char *)(map + sizeof(snaphdr));
+
+    if (memcmp(h->magic, SNAP_MAGIC, sizeof(h->magic))
+        || h->version != SNAP_VERSION
+        || sizeof(snaphdr) + (uint64_t)h->identlen + h->parmslen > maplen
+        || h->identlen == 0 || id[h->identlen - 1] != '\0'
+        || fnv1a(map + sizeof(snaphdr) + h->identlen, h->parmslen) != h->hash) {
+        close();
+        errno = EINVAL;
+        return -1;
+    }
+
+    hdr = h;
+    parms = map + sizeof(snaphdr) + h->identlen;
+
+    const char *end = id + h->identlen;
+    host = id;
+    id += strlen(id) + 1;
+    machineid = id < end ? id : "";
+    id += id < end ? strlen(id) + 1 : 0;
+    kernel = id < end ? id : "";
+    return 0;
+}
+
+/**************************************************************
+ * snapfile::decode - the parameters of an open snapshot
+ *
+ * Returns the number decoded, or -1 if the parameter bytes are
+ * malformed.
+ */
+int snapfile::decode(vector<snapparm>& out) const
+{
+    const uint8_t *p = parms;
+    const uint8_t *end;
+
+    out.clear();
+    if (hdr == NULL)
+        return -1;
+    end = parms + hdr->parmslen;
+
+    while (p < end) {
+        snapparm sp;
+        const uint8_t *nul = (const uint8_t *)memchr(p, 0, end - p);
+
+        if (nul == NULL || nul + 1 >= end)
+            return -1;
+        sp.name.assign((const char *)p, nul - p);
+        p = nul + 1;
+
+        if (*p == 's') {
+            ++p;
+            if ((nul = (const uint8_t *)memchr(p, 0, end - p)) == NULL)
+                return -1;
+            sp.isstring = true;
+            sp.strval.assign((const char *)p, nul - p);
+            p = nul + 1;
+        } else if (*p == 'i') {
+            uint64_t v;
+            int n = getvarint(++p, end, v);
+            if (n == 0)
+                return -1;
+            sp.value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            p += n;
+        } else {
+            return -1;
+        }
+        out.push_back(sp);
+    }
+    return out.size() == hdr->nparms ? (int)out.size() : -1;
+}
+
+void snapfile::close()
+{
+    if (map)
+        munmap(map, maplen);
+    map = NULL;
+    maplen = 0;
+    hdr = NULL;
+    parms = NULL;
+    host = machineid = kernel = "";
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+**
+**  snapfile.h - compact binary snapshot of the ipmi kmod parameters
+**
+**    This file is part of ipmiparm.
+**
+**    ipmiparm is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**  GNU General Public License http://www.gnu.org/licenses/gpl.html
+**
+******************************************************************************/
+
+#ifndef SNAPFILE_H
+#define SNAPFILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define SNAP_MAGIC      "IPMISNP1"
+#define SNAP_VERSION    1
+
+/**************************************************************
+ * snaphdr - the header at the start of a snapshot file
+ *
+ * The header is followed by the host identity, identlen bytes of
+ * NUL terminated strings (hostname, machine id, kernel release),
+ * then by the parameters, parmslen bytes. Each parameter is its
+ * name, kmod.parm, NUL terminated, a type byte, 'i' or 's', and
+ * the value: a zigzag varint or a NUL terminated string. The
+ * parameters are sorted by name, so hash, the 64-bit FNV-1a of
+ * the parameter bytes, is the same on every host with the same
+ * settings whatever order sysfs lists them in.
+ *************************************************************/
+struct snaphdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nparms;
+    uint32_t identlen;
+    uint32_t parmslen;
+    uint64_t time_ms;       // when taken, ms since the epoch
+    uint64_t hash;          // FNV-1a of the parameter bytes
+};
+
+/**************************************************************
+ * snapparm - one parameter, as written or decoded
+ *************************************************************/
+struct snapparm {
+    snapparm() {isstring = false; value = 0;}
+
+    std::string name;           // kmod.parm
+    bool        isstring;
+    int64_t     value;
+    std::string strval;
+
+    bool operator<(const snapparm& p) const {return name < p.name;}
+    std::string valstr() const;
+};
+
+/**************************************************************
+ * class snapfile - writer and reader of a snapshot file
+ *
+ * Readers map the file; open checks the lengths and the hash and
+ * leaves hdr, host, machineid and kernel pointing into the
+ * mapping, so a caller that only wants to group snapshots by hash
+ * never copies or decodes the parameters.
+ *************************************************************/
+class snapfile {
+public:
+    snapfile() {map = NULL; maplen = 0; hdr = NULL; parms = NULL;
+                host = machineid = kernel = "";}
+    ~snapfile() {close();}
+
+    static int create(std::string path, std::vector<snapparm> parms);
+    static uint64_t fnv1a(const uint8_t *p, size_t len,
+                          uint64_t h = 0xcbf29ce484222325ULL);
+
+    int    open(std::string path);
+    int    decode(std::vector<snapparm>& out) const;
+    void   close();
+
+    const snaphdr *hdr;
+    const char    *host;
+    const char    *machineid;
+    const char    *kernel;
+
+private:
+    uint8_t       *map;
+    size_t         maplen;
+    const uint8_t *parms;
+};
+
+#endif // SNAPFILE_H
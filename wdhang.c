@@ -0,0 +1,347 @@
+/*
+ * Watchdog Driver Hang Detector
+ *
+ * simple.c prints "If I hang here, my ipmi_watchdog is buggy..." and
+ * leaves it to whoever is watching. This runs the same ioctls, plus
+ * WDIOC_KEEPALIVE and WDIOC_GETTIMELEFT, over and over on a worker
+ * thread while the main thread supervises it:
+ *
+ *  - any ioctl still running after its deadline is reported as a
+ *    hang, with the ioctl and the iteration it hung in
+ *  - every ioctl's latency goes into a per-ioctl log2 histogram
+ *  - a latency more than -o times the median of that ioctl so far
+ *    is reported as an outlier
+ *
+ * A hang that outlasts the give-up time ends the run, since a thread
+ * stuck in the driver can't be cancelled. The exit status is 0 for a
+ * clean run, 1 if there were outliers and 3 if anything hung, so a
+ * soak test script only needs to check it.
+ *
+ *	$ gcc -o wdhang wdhang.c -lpthread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/watchdog.h>
+
+#define NBUCKETS	32	/* log2 buckets of 1us */
+#define MEDIAN_MIN	100	/* samples before outliers are judged */
+
+enum { OP_SETTIMEOUT, OP_SETOPTIONS, OP_KEEPALIVE, OP_GETTIMELEFT, NOPS };
+
+static const char *opname[NOPS] = {
+	"SETTIMEOUT", "SETOPTIONS", "KEEPALIVE", "GETTIMELEFT"
+};
+
+struct opstats {
+	uint64_t	calls;
+	uint64_t	errors;
+	uint64_t	outliers;
+	uint64_t	hangs;
+	int64_t		min;
+	int64_t		max;
+	double		sum;
+	uint64_t	hist[NBUCKETS];
+};
+
+/*
+ * What the worker is doing, for the supervisor. inflight is the
+ * ioctl in progress or -1, start when it was entered. The fields
+ * are only accessed with atomics.
+ */
+struct state {
+	int		inflight;
+	int64_t		start;
+	uint64_t	iter;
+};
+
+static struct state cur = { -1, 0, 0 };
+static struct opstats ops[NOPS];
+static int fd;
+static int timeout = 120;
+static int interval_ms = 100;
+static uint64_t maxiter;
+static double outfactor = 10.0;
+static volatile sig_atomic_t stop;
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static inline int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket(int64_t ns)
+{
+	int b = 0;
+	int64_t us = ns / 1000;
+
+	while (us > 0 && b < NBUCKETS - 1) {
+		us >>= 1;
+		++b;
+	}
+	return b;
+}
+
+/*
+ * Median estimate from the histogram: the upper bound of the bucket
+ * holding the middle sample, in ns.
+ */
+static int64_t median(struct opstats *os)
+{
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < NBUCKETS; b++) {
+		seen += os->hist[b];
+		if (seen * 2 >= os->calls)
+			break;
+	}
+	return (1LL << b) * 1000;
+}
+
+static void record(int op, int64_t ns, int rc)
+{
+	struct opstats *os = &ops[op];
+
+	if (os->calls >= MEDIAN_MIN && ns > outfactor * median(os)) {
+		os->outliers++;
+		printf("OUTLIER: %s took %.3f ms (median < %.3f ms)"
+		       " iteration %llu\n", opname[op], ns / 1e6,
+		       median(os) / 1e6, (unsigned long long)cur.iter);
+		fflush(stdout);
+	}
+
+	os->calls++;
+	if (rc < 0)
+		os->errors++;
+	if (ns < os->min || os->calls == 1)
+		os->min = ns;
+	if (ns > os->max)
+		os->max = ns;
+	os->sum += ns;
+	os->hist[bucket(ns)]++;
+}
+
+static int timed_ioctl(int op, unsigned long req, void *arg)
+{
+	int64_t t0, t1;
+	int rc;
+
+	t0 = now_ns();
+	__atomic_store_n(&cur.start, t0, __ATOMIC_RELEASE);
+	__atomic_store_n(&cur.inflight, op, __ATOMIC_RELEASE);
+
+	rc = ioctl(fd, req, arg);
+
+	t1 = now_ns();
+	__atomic_store_n(&cur.inflight, -1, __ATOMIC_RELEASE);
+
+	record(op, t1 - t0, rc);
+	return rc;
+}
+
+static void *worker(void *arg)
+{
+	int option = WDIOS_ENABLECARD;
+	struct timespec pause = {
+		interval_ms / 1000, (interval_ms % 1000) * 1000000L
+	};
+
+	(void)arg;
+	while (!stop && (maxiter == 0 || cur.iter < maxiter)) {
+		int time = timeout;
+		int left;
+
+		timed_ioctl(OP_SETTIMEOUT, WDIOC_SETTIMEOUT, &time);
+		timed_ioctl(OP_SETOPTIONS, WDIOC_SETOPTIONS, &option);
+		timed_ioctl(OP_KEEPALIVE, WDIOC_KEEPALIVE, NULL);
+		timed_ioctl(OP_GETTIMELEFT, WDIOC_GETTIMELEFT, &left);
+
+		__atomic_add_fetch(&cur.iter, 1, __ATOMIC_RELEASE);
+		if (interval_ms)
+			nanosleep(&pause, NULL);
+	}
+	return NULL;
+}
+
+static void report(void)
+{
+	int op, b;
+
+	printf("\n%-12s %10s %6s %6s %6s %10s %10s %10s\n", "ioctl", "calls",
+	       "errors", "outlr", "hangs", "min ms", "mean ms", "max ms");
+	for (op = 0; op < NOPS; op++) {
+		struct opstats *os = &ops[op];
+
+		printf("%-12s %10llu %6llu %6llu %6llu %10.3f %10.3f %10.3f\n",
+		       opname[op], (unsigned long long)os->calls,
+		       (unsigned long long)os->errors,
+		       (unsigned long long)os->outliers,
+		       (unsigned long long)os->hangs, os->min / 1e6,
+		       os->calls ? os->sum / os->calls / 1e6 : 0.0,
+		       os->max / 1e6);
+	}
+
+	printf("\nlatency histogram (calls per bucket)\n%12s", "< us");
+	for (op = 0; op < NOPS; op++)
+		printf(" %12s", opname[op]);
+	printf("\n");
+	for (b = 0; b < NBUCKETS; b++) {
+		uint64_t any = 0;
+
+		for (op = 0; op < NOPS; op++)
+			any |= ops[op].hist[b];
+		if (!any)
+			continue;
+		printf("%12llu", 1ULL << b);
+		for (op = 0; op < NOPS; op++)
+			printf(" %12llu", (unsigned long long)ops[op].hist[b]);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wdhang [-d dev] [-t secs] [-D ms] [-G secs] [-i ms]"
+		" [-n iters] [-T secs] [-o factor]\n\n"
+		"  -d dev     watchdog device, default /dev/watchdog\n"
+		"  -t secs    watchdog timeout to set, default 120\n"
+		"  -D ms      per-ioctl deadline, default 1000\n"
+		"  -G secs    give up on a hung ioctl after this, default 30\n"
+		"  -i ms      pause between iterations, default 100\n"
+		"  -n iters   stop after this many iterations\n"
+		"  -T secs    stop after this many seconds\n"
+		"  -o factor  outlier threshold over the median, default 10\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	char *dev = "/dev/watchdog";
+	int deadline_ms = 1000;
+	int giveup = 30;
+	int duration = 0;
+	int opt, op;
+	int rc = 0;
+	int64_t begin;
+	uint64_t flagged = UINT64_MAX;
+	pthread_t tid;
+
+	while ((opt = getopt(argc, argv, "d:t:D:G:i:n:T:o:")) != -1) {
+		switch (opt) {
+		case 'd': dev = optarg; break;
+		case 't': timeout = atoi(optarg); break;
+		case 'D': deadline_ms = atoi(optarg); break;
+		case 'G': giveup = atoi(optarg); break;
+		case 'i': interval_ms = atoi(optarg); break;
+		case 'n': maxiter = strtoull(optarg, NULL, 0); break;
+		case 'T': duration = atoi(optarg); break;
+		case 'o': outfactor = atof(optarg); break;
+		default: usage();
+		}
+	}
+
+	if (timeout <= 0 || deadline_ms <= 0 || giveup <= 0 || interval_ms < 0
+	    || outfactor <= 1.0)
+		usage();
+
+	fd = open(dev, O_RDWR);
+
+	if (fd == -1) {
+		fprintf(stderr, "Watchdog device not enabled.\n");
+		fflush(stderr);
+		exit(-1);
+	}
+
+	signal(SIGINT, onstop);
+	signal(SIGTERM, onstop);
+
+	if (pthread_create(&tid, NULL, worker, NULL)) {
+		fprintf(stderr, "cannot start the worker thread\n");
+		exit(-1);
+	}
+
+	/*
+	 * Supervise. Poll four times per deadline, so a hang is flagged
+	 * within 1.25 deadlines of the ioctl being entered.
+	 */
+	begin = now_ns();
+	while (1) {
+		struct timespec ts = {
+			deadline_ms / 4000, (deadline_ms / 4 % 1000) * 1000000L
+		};
+		uint64_t iter;
+		int64_t start, stuck;
+
+		if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+			ts.tv_nsec = 250000;
+		nanosleep(&ts, NULL);
+
+		if (duration && now_ns() - begin >= duration * 1000000000LL)
+			stop = 1;
+
+		op = __atomic_load_n(&cur.inflight, __ATOMIC_ACQUIRE);
+		start = __atomic_load_n(&cur.start, __ATOMIC_ACQUIRE);
+		iter = __atomic_load_n(&cur.iter, __ATOMIC_ACQUIRE);
+
+		if (op < 0) {
+			if (stop || (maxiter && iter >= maxiter))
+				break;
+			continue;
+		}
+
+		stuck = now_ns() - start;
+
+		if (stuck > deadline_ms * 1000000LL
+		    && flagged != iter * NOPS + op) {
+			flagged = iter * NOPS + op;
+			ops[op].hangs++;
+			rc = 3;
+			printf("HANG: %s has not returned after %d ms"
+			       " (iteration %llu)\n", opname[op], deadline_ms,
+			       (unsigned long long)iter);
+			printf("If I hang here, my ipmi_watchdog is buggy...\n");
+			fflush(stdout);
+		}
+
+		if (stuck > giveup * 1000000000LL) {
+			printf("GIVING UP: %s stuck for %d s\n",
+			       opname[op], giveup);
+			report();
+			_exit(3);
+		}
+	}
+
+	pthread_join(tid, NULL);
+	report();
+
+	for (op = 0; op < NOPS; op++)
+		if (ops[op].outliers && rc == 0)
+			rc = 1;
+
+	/* magic close, so the soak test doesn't leave the watchdog armed */
+	if (write(fd, "V", 1) != 1)
+		perror("magic close failed: ");
+	close(fd);
+	return rc;
+}
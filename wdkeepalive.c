@@ -0,0 +1,551 @@
+/*
+ * Watchdog Keepalive Daemon
+ *
+ * Arms /dev/watchdog the way simple.c does, then pets it from a
+ * timerfd loop until SIGINT or SIGTERM, when it does a magic close
+ * so the watchdog is disarmed rather than left to fire.
+ *
+ * Every pet records the gap since the previous one in a log2
+ * histogram and asks how much time was left, so the report shows
+ * how close host load ever pushed petting to the timeout. SIGUSR1
+ * prints the report on demand; it is also printed every -s seconds
+ * and at exit.
+ *
+ * With -I the BMC watchdog is driven directly with the Set, Get and
+ * Reset Watchdog Timer commands through /dev/ipmi0, bypassing the
+ * ipmi_watchdog module for hosts where it misbehaves. Don't use -I
+ * while ipmi_watchdog has /dev/watchdog open; both would be driving
+ * the same BMC timer. -B runs both paths back to back and compares
+ * their round trip times and jitter.
+ *
+ *	$ gcc -o wdkeepalive wdkeepalive.c ipmicmd.c iptrace.c -lm
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <linux/types.h>
+#include <linux/watchdog.h>
+
+#include "ipmicmd.h"
+
+#define NBUCKETS	32	/* log2 buckets of 1us up to ~35 minutes */
+
+#define IPMI_NETFN_APP		0x06
+#define IPMI_RESET_WDT		0x22
+#define IPMI_SET_WDT		0x24
+#define IPMI_GET_WDT		0x25
+#define WDT_USE_SMS_OS		0x04
+#define WDT_DONT_STOP		0x40	/* set: timer keeps running */
+#define WDT_ACTION_RESET	0x01
+
+/*
+ * A way of driving the watchdog. Times are in milliseconds, which
+ * is finer than the ioctls need but matches the 100 ms resolution
+ * of the BMC timer.
+ */
+struct wdpath {
+	const char	*name;
+	int		(*arm)(int timeout);
+	int		(*pet)(void);
+	int		(*left)(int *ms);
+	void		(*disarm)(void);
+};
+
+struct petstats {
+	uint64_t	pets;
+	uint64_t	overruns;	/* timer expirations we slept through */
+	uint64_t	errors;		/* failed keepalives */
+	int64_t		mingap;		/* ns between pets */
+	int64_t		maxgap;
+	double		sumjit;		/* ns, for the mean absolute jitter */
+	int64_t		maxcall;	/* ns spent in one keepalive */
+	int		minleft;	/* ms, lowest time left reported */
+	int		haveleft;
+	uint64_t	hist[NBUCKETS];	/* gap jitter, |gap - interval| */
+};
+
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t report;
+
+static char *dev = "/dev/watchdog";
+static int fd = -1;		/* /dev/watchdog */
+static int ipmi_fd = -1;	/* /dev/ipmi0 */
+
+/*
+ * The /dev/watchdog ioctl path
+ */
+static int dev_arm(int timeout)
+{
+	int option = WDIOS_ENABLECARD;
+
+	fd = open(dev, O_RDWR);
+
+	if (fd == -1) {
+		fprintf(stderr, "Watchdog device not enabled.\n");
+		fflush(stderr);
+		return -1;
+	}
+
+	if (ioctl(fd, WDIOC_SETTIMEOUT, &timeout) < 0)
+		perror("SETTIMEOUT ioctl failed: ");
+
+	if (ioctl(fd, WDIOC_SETOPTIONS, &option) < 0)
+		perror("SETOPTIONS ioctl failed: ");
+
+	/* the driver may have rounded the timeout */
+	ioctl(fd, WDIOC_GETTIMEOUT, &timeout);
+	return timeout;
+}
+
+static int dev_pet(void)
+{
+	return ioctl(fd, WDIOC_KEEPALIVE, 0);
+}
+
+static int dev_left(int *ms)
+{
+	int left;
+
+	if (ioctl(fd, WDIOC_GETTIMELEFT, &left) < 0)
+		return -1;
+	*ms = left * 1000;
+	return 0;
+}
+
+static void dev_disarm(void)
+{
+	/*
+	 * Magic close: writing 'V' tells the driver this close is
+	 * deliberate, so it disarms the watchdog instead of letting it
+	 * fire. Drivers built with nowayout ignore it.
+	 */
+	if (write(fd, "V", 1) != 1)
+		perror("magic close failed: ");
+	close(fd);
+	fd = -1;
+}
+
+/*
+ * The direct IPMI path, through the getInfoIPMI command layer
+ */
+static int ipmi_wdt(uchar cmd, uchar *data, uchar len, uchar *rsp, int *rlen)
+{
+	uchar buf[16];
+	int rc;
+
+	if (rsp == NULL)
+		rsp = buf;
+
+	rc = ipmicmd_fd(ipmi_fd, IPMI_SYSTEM_INTERFACE_ADDR_TYPE, cmd,
+			IPMI_NETFN_APP, 0, data, len, rsp, sizeof(buf), rlen);
+	if (rc < 0 || *rlen < 1)
+		return -1;
+	if (rsp[0] != 0) {
+		if (Verbose)
+			fprintf(stderr, "%s: watchdog cmd 0x%02x completion "
+				"code 0x%02x\n", toolname, cmd, rsp[0]);
+		return -1;
+	}
+	return 0;
+}
+
+static int ipmi_set(int timeout, uchar use)
+{
+	uchar data[6];
+	int rlen;
+	int count = timeout * 10;	/* 100 ms units */
+
+	if (count > 0xffff)
+		count = 0xffff;
+
+	data[0] = use;
+	data[1] = (use & WDT_DONT_STOP) ? WDT_ACTION_RESET : 0;
+	data[2] = 0;			/* no pretimeout */
+	data[3] = 1 << WDT_USE_SMS_OS;	/* clear the SMS/OS expired flag */
+	data[4] = count & 0xff;
+	data[5] = count >> 8;
+	return ipmi_wdt(IPMI_SET_WDT, data, sizeof(data), NULL, &rlen);
+}
+
+static int ipmi_arm(int timeout)
+{
+	int rlen;
+
+	if ((ipmi_fd = ipmi_open()) < 0)
+		return -1;
+
+	if (ipmi_set(timeout, WDT_USE_SMS_OS | WDT_DONT_STOP) < 0
+	    || ipmi_wdt(IPMI_RESET_WDT, NULL, 0, NULL, &rlen) < 0) {
+		fprintf(stderr, "%s: cannot arm the BMC watchdog\n", toolname);
+		close(ipmi_fd);
+		ipmi_fd = -1;
+		return -1;
+	}
+	return timeout;
+}
+
+static int ipmi_pet(void)
+{
+	int rlen;
+
+	return ipmi_wdt(IPMI_RESET_WDT, NULL, 0, NULL, &rlen);
+}
+
+static int ipmi_left(int *ms)
+{
+	uchar rsp[16];
+	int rlen;
+
+	if (ipmi_wdt(IPMI_GET_WDT, NULL, 0, rsp, &rlen) < 0 || rlen < 9)
+		return -1;
+	*ms = (rsp[7] | rsp[8] << 8) * 100;
+	return 0;
+}
+
+static void ipmi_disarm(void)
+{
+	/* the IPMI equivalent of the magic close: stop the timer */
+	if (ipmi_set(0, WDT_USE_SMS_OS) < 0)
+		fprintf(stderr, "%s: cannot stop the BMC watchdog\n", toolname);
+	close(ipmi_fd);
+	ipmi_fd = -1;
+}
+
+static struct wdpath paths[] = {
+	{ "/dev/watchdog", dev_arm, dev_pet, dev_left, dev_disarm },
+	{ "/dev/ipmi0", ipmi_arm, ipmi_pet, ipmi_left, ipmi_disarm },
+};
+
+static void onstop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static void onreport(int sig)
+{
+	(void)sig;
+	report = 1;
+}
+
+static inline int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket(int64_t ns)
+{
+	int b = 0;
+	int64_t us = ns / 1000;
+
+	while (us > 0 && b < NBUCKETS - 1) {
+		us >>= 1;
+		++b;
+	}
+	return b;
+}
+
+static void stats_init(struct petstats *ps)
+{
+	memset(ps, 0, sizeof(*ps));
+	ps->mingap = INT64_MAX;
+}
+
+static void stats_print(struct petstats *ps, int64_t interval, int timeout)
+{
+	int b, last = 0;
+
+	printf("\npets %llu  overruns %llu  errors %llu\n",
+	       (unsigned long long)ps->pets,
+	       (unsigned long long)ps->overruns,
+	       (unsigned long long)ps->errors);
+
+	if (ps->pets < 2) {
+		fflush(stdout);
+		return;
+	}
+
+	printf("gap ms  min %.3f  max %.3f  target %.3f  mean |jitter| %.3f\n",
+	       ps->mingap / 1e6, ps->maxgap / 1e6, interval / 1e6,
+	       ps->sumjit / (ps->pets - 1) / 1e6);
+	printf("keepalive call max %.3f ms\n", ps->maxcall / 1e6);
+	printf("worst margin to the %d s timeout: %.3f s",
+	       timeout, timeout - ps->maxgap / 1e9);
+	if (ps->haveleft)
+		printf("  (lowest time left reported: %.1f s)",
+		       ps->minleft / 1e3);
+	printf("\n");
+
+	if (ps->maxgap > (int64_t)timeout * 500000000LL)
+		printf("WARNING: a pet came more than half the timeout late\n");
+
+	for (b = 0; b < NBUCKETS; b++)
+		if (ps->hist[b])
+			last = b;
+
+	printf("jitter histogram\n");
+	for (b = 0; b <= last; b++)
+		printf("  < %10llu us  %llu\n", 1ULL << b,
+		       (unsigned long long)ps->hist[b]);
+	fflush(stdout);
+}
+
+static int cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Print min, median, 99th percentile, max and standard deviation of
+ * n round trip times. Sorts rtt in place.
+ */
+static void rtt_print(const char *what, int64_t *rtt, int n)
+{
+	double mean = 0, var = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		mean += rtt[i];
+	mean /= n;
+	for (i = 0; i < n; i++)
+		var += (rtt[i] - mean) * (rtt[i] - mean);
+
+	qsort(rtt, n, sizeof(*rtt), cmp64);
+	printf("  %-8s min %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f  "
+	       "stddev %8.1f us\n", what, rtt[0] / 1e3, rtt[n / 2] / 1e3,
+	       rtt[(n * 99) / 100] / 1e3, rtt[n - 1] / 1e3,
+	       sqrt(var / n) / 1e3);
+}
+
+/*
+ * The A/B benchmark: arm each path in turn, pet it n times back to
+ * back reading the time left after each pet, and disarm it again.
+ */
+static void bench(int n, int timeout)
+{
+	int64_t *pet = calloc(n, sizeof(*pet));
+	int64_t *left = calloc(n, sizeof(*left));
+	unsigned p;
+
+	if (pet == NULL || left == NULL) {
+		perror("calloc failed: ");
+		return;
+	}
+
+	for (p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+		struct wdpath *wp = &paths[p];
+		int i, errs = 0, ms;
+
+		printf("\n%s\n", wp->name);
+		if (wp->arm(timeout) < 0)
+			continue;
+
+		for (i = 0; i < n && !stop; i++) {
+			int64_t t0 = now_ns();
+
+			if (wp->pet() < 0)
+				errs++;
+			pet[i] = now_ns() - t0;
+
+			t0 = now_ns();
+			if (wp->left(&ms) < 0)
+				errs++;
+			left[i] = now_ns() - t0;
+		}
+
+		wp->disarm();
+		if (i == 0)
+			continue;
+		rtt_print("pet", pet, i);
+		rtt_print("timeleft", left, i);
+		printf("  %d errors\n", errs);
+	}
+	fflush(stdout);
+	free(pet);
+	free(left);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wdkeepalive [-d dev | -I] [-t secs] [-p ms] [-r prio]"
+		" [-m] [-s secs] [-n pets] [-v]\n"
+		"       wdkeepalive -B count [-d dev] [-t secs]\n\n"
+		"  -d dev    watchdog device, default /dev/watchdog\n"
+		"  -I        drive the BMC watchdog directly through /dev/ipmi0\n"
+		"  -t secs   watchdog timeout, default 120\n"
+		"  -p ms     pet interval, default 1000\n"
+		"  -r prio   run SCHED_FIFO at this priority\n"
+		"  -m        lock all memory with mlockall\n"
+		"  -s secs   print the report this often, default 0 (never)\n"
+		"  -n pets   stop after this many pets\n"
+		"  -B count  compare count pets on both paths and exit\n"
+		"  -v        verbose\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	int time = 120;
+	int interval_ms = 1000;
+	int rtprio = 0;
+	int lock = 0;
+	int every = 0;
+	int nbench = 0;
+	long maxpets = 0;
+	int tfd, opt;
+	int64_t interval, last = 0, lastreport;
+	struct itimerspec its;
+	struct sigaction sa;
+	struct petstats ps;
+	struct wdpath *wp = &paths[0];
+
+	strncpy(toolname, "wdkeepalive", sizeof(toolname) - 1);
+
+	while ((opt = getopt(argc, argv, "d:It:p:r:ms:n:B:v")) != -1) {
+		switch (opt) {
+		case 'd': dev = optarg; break;
+		case 'I': wp = &paths[1]; break;
+		case 't': time = atoi(optarg); break;
+		case 'p': interval_ms = atoi(optarg); break;
+		case 'r': rtprio = atoi(optarg); break;
+		case 'm': lock = 1; break;
+		case 's': every = atoi(optarg); break;
+		case 'n': maxpets = atol(optarg); break;
+		case 'B': nbench = atoi(optarg); break;
+		case 'v': Verbose = 1; break;
+		default: usage();
+		}
+	}
+
+	if (time <= 0 || interval_ms <= 0 || interval_ms >= time * 1000)
+		usage();
+
+	if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		perror("mlockall failed: ");
+
+	if (rtprio) {
+		struct sched_param sp = { .sched_priority = rtprio };
+
+		if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+			perror("SCHED_FIFO failed: ");
+	}
+
+	/*
+	 * Without SA_RESTART, which signal() would set, a signal breaks
+	 * the wait for the next tick, so a SIGUSR1 report is printed
+	 * right away rather than after the tick.
+	 */
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = onstop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sa.sa_handler = onreport;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	if (nbench > 0) {
+		bench(nbench, time);
+		return 0;
+	}
+
+	if ((time = wp->arm(time)) < 0)
+		exit(-1);
+
+	printf("Timeout set for: %d seconds, petting %s every %d ms\n",
+	       time, wp->name, interval_ms);
+	fflush(stdout);
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tfd < 0) {
+		perror("timerfd_create failed: ");
+		goto out;
+	}
+
+	interval = (int64_t)interval_ms * 1000000;
+	its.it_interval.tv_sec = interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(tfd, 0, &its, NULL) < 0) {
+		perror("timerfd_settime failed: ");
+		goto out;
+	}
+
+	stats_init(&ps);
+	lastreport = now_ns();
+
+	while (!stop && (maxpets == 0 || ps.pets < (uint64_t)maxpets)) {
+		uint64_t expired;
+		int64_t t0, t1, gap;
+		int left;
+
+		if (read(tfd, &expired, sizeof(expired)) != sizeof(expired)) {
+			if (errno == EINTR) {
+				if (report) {
+					stats_print(&ps, interval, time);
+					report = 0;
+				}
+				continue;
+			}
+			perror("timerfd read failed: ");
+			break;
+		}
+
+		t0 = now_ns();
+		if (wp->pet() < 0)
+			ps.errors++;
+		t1 = now_ns();
+
+		if (wp->left(&left) == 0) {
+			if (!ps.haveleft || left < ps.minleft)
+				ps.minleft = left;
+			ps.haveleft = 1;
+		}
+
+		ps.pets++;
+		ps.overruns += expired - 1;
+		if (t1 - t0 > ps.maxcall)
+			ps.maxcall = t1 - t0;
+
+		if (last) {
+			gap = t0 - last;
+			if (gap < ps.mingap)
+				ps.mingap = gap;
+			if (gap > ps.maxgap)
+				ps.maxgap = gap;
+			ps.sumjit += llabs(gap - interval);
+			ps.hist[bucket(llabs(gap - interval))]++;
+		}
+		last = t0;
+
+		if (report || (every && t1 - lastreport >= every * 1000000000LL)) {
+			stats_print(&ps, interval, time);
+			lastreport = t1;
+			report = 0;
+		}
+	}
+
+	stats_print(&ps, interval, time);
+
+out:
+	wp->disarm();
+	printf("Watchdog closed\n");
+	return 0;
+}